@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "command.h"
+using namespace openutils;
+
+static const double POW10[] = {1.0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9}; // supported decimal scales
+static const double MAX_SCALED_VALUE = 1e15;  // scaled values must be well inside the exact integer range of a double
+
+/**
+* Writes an unsigned integer into a buffer in reverse digit order. Returns the number of digits.
+*/
+static int reverseDigits(char *digits, unsigned long long value)
+{
+   int n = 0;
+   do
+   {
+      digits[n++] = (char)('0' + value % 10);
+      value /= 10;
+   }
+   while(value != 0);
+   return n;
+}
+
+/**
+* Scales a positive value by 10^decimals and rounds the exact binary product half to even, as printf does.
+*/
+static unsigned long long roundScaled(double value, int decimals)
+{
+   double scaled, err;  // value * 10^decimals split into the rounded product and its exact remainder
+   double whole, frac;  // integer and fraction parts of the rounded product
+   unsigned long long units;
+
+   scaled = value * POW10[decimals];
+   err = fma(value, POW10[decimals], -scaled);  // exact: value * 10^decimals = scaled + err
+   whole = floor(scaled);
+   frac = scaled - whole - 0.5;                 // exact.  Sign tells if the fraction is above or below one half.
+
+   units = (unsigned long long)whole;
+   if(frac > 0.0 || (frac == 0.0 && (err > 0.0 || (err == 0.0 && (units & 1)))))
+      units++;
+   return units;
+}
+
+/**
+* Formats value with the given number of decimals. Produces the same text as printf("%.*lf", decimals, value):
+* the exact binary value is rounded half to even. Returns the number of characters written (without '\0'),
+* or -1 if the buffer is too small.
+*/
+int openutils::FormatFixed(char *buffer, int size, double value, int decimals)
+{
+   char digits[32];     // digits of the scaled value (reversed)
+   unsigned long long units;
+   int numDigits, len = 0, n;
+   bool bNegative = signbit(value) != 0;
+
+   if(decimals < 0 || decimals > 9 || !isfinite(value) || fabs(value) * POW10[decimals] >= MAX_SCALED_VALUE)
+   {
+      n = snprintf(buffer, size, "%.*lf", decimals, value);
+      return (n < 0 || n >= size) ? -1 : n;
+   }
+
+   units = roundScaled(fabs(value), decimals);
+   numDigits = reverseDigits(digits, units);
+   while(numDigits <= decimals) digits[numDigits++] = '0';  // leading zeros of "0.0x"
+
+   if(size < (bNegative ? 1 : 0) + numDigits + (decimals > 0 ? 1 : 0) + 1) return -1;
+
+   if(bNegative) buffer[len++] = '-';
+   for(n = numDigits - 1; n >= 0; n--)
+   {
+      buffer[len++] = digits[n];
+      if(n == decimals && decimals > 0) buffer[len++] = '.';
+   }
+   buffer[len] = '\0';
+   return len;
+}
+
+/**
+* Scales value by 10^decimals and rounds it to the integer whose digits printf("%.*lf", decimals, value) writes.
+* Values too large to scale exactly are rounded to the nearest integer (and NaN and infinities give 0).
+*/
+long long openutils::ScaleFixed(double value, int decimals)
+{
+   long long units;
+
+   if(!isfinite(value)) return 0;
+   if(decimals < 0 || decimals > 9 || fabs(value) * POW10[decimals] >= MAX_SCALED_VALUE)
+      return llround(value * pow(10.0, decimals));
+   units = (long long)roundScaled(fabs(value), decimals);
+   return value < 0.0 ? -units : units;
+}
+
+/**
+* Formats an integer. Produces the same text as printf("%d"). Returns the number of characters written
+* (without '\0'), or -1 if the buffer is too small.
+*/
+int openutils::FormatInt(char *buffer, int size, int value)
+{
+   char digits[16];
+   unsigned long long mag = value < 0 ? (unsigned long long)(-(long long)value) : (unsigned long long)value;
+   int numDigits = reverseDigits(digits, mag), len = 0, n;
+
+   if(size < (value < 0 ? 1 : 0) + numDigits + 1) return -1;
+
+   if(value < 0) buffer[len++] = '-';
+   for(n = numDigits - 1; n >= 0; n--) buffer[len++] = digits[n];
+   buffer[len] = '\0';
+   return len;
+}
+
+// class CCommandWriter
+
+CCommandWriter::CCommandWriter(char *buffer, int size)
+{
+   m_buffer = buffer;
+   m_nSize = size;
+   m_nLength = 0;
+   m_bOverflow = false;
+   if(m_nSize > 0) m_buffer[0] = '\0';
+}
+
+/**
+* Starts a new command. Any previous command in the buffer is discarded.
+* @param keyword command keyword e.g. "ROTATE_JOINT"
+*/
+CCommandWriter &CCommandWriter::Begin(const char *keyword)
+{
+   m_nLength = 0;
+   m_bOverflow = false;
+   Append(keyword, (int)strlen(keyword));
+   return *this;
+}
+
+CCommandWriter &CCommandWriter::Word(const char *word)
+{
+   Append(" ", 1);
+   Append(word, (int)strlen(word));
+   return *this;
+}
+
+CCommandWriter &CCommandWriter::Int(int value)
+{
+   char str[16];
+   Append(" ", 1);
+   Append(str, FormatInt(str, sizeof(str), value));
+   return *this;
+}
+
+CCommandWriter &CCommandWriter::Fixed(double value, int decimals)
+{
+   char str[352];  // big enough for printf("%.9lf", DBL_MAX)
+   Append(" ", 1);
+   Append(str, FormatFixed(str, sizeof(str), value, decimals));
+   return *this;
+}
+
+/**
+* Terminates the command with '\n'. Returns the command string (always '\0' terminated).
+*/
+const char *CCommandWriter::End()
+{
+   Append("\n", 1);
+   return m_buffer;
+}
+
+void CCommandWriter::Append(const char *str, int len)
+{
+   if(len < 0 || m_nLength + len >= m_nSize)
+   {
+      m_bOverflow = true;
+      return;
+   }
+   memcpy(m_buffer + m_nLength, str, len);
+   m_nLength += len;
+   m_buffer[m_nLength] = '\0';
+}
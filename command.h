@@ -0,0 +1,34 @@
+#ifndef _COMMAND_H_
+#define _COMMAND_H_
+
+namespace openutils
+{
+
+   /// Builds robot command strings directly in a caller supplied buffer without printf.
+   /// Numbers are written with integer arithmetic and give the same text as printf("%d") and printf("%.*lf").
+   class CCommandWriter
+   {
+   private:
+      char *m_buffer; /// output buffer
+      int m_nSize; /// size of output buffer (including room for '\0')
+      int m_nLength; /// number of characters written
+      bool m_bOverflow; /// true if a write did not fit in the buffer
+   public:
+      CCommandWriter(char *buffer, int size); /// attaches the writer to a buffer
+      CCommandWriter &Begin(const char *keyword); /// starts a new command with its keyword
+      CCommandWriter &Word(const char *word); /// appends a space and a word
+      CCommandWriter &Int(int value); /// appends a space and an integer
+      CCommandWriter &Fixed(double value, int decimals); /// appends a space and a fixed point number
+      const char *End(); /// appends the trailing '\n' and returns the command string
+      int GetLength() { return m_nLength; } /// returns the command length (without '\0')
+      bool IsOverflow() { return m_bOverflow; } /// returns true if the command was truncated
+   private:
+      void Append(const char *str, int len); /// appends characters
+   };
+
+   int FormatFixed(char *buffer, int size, double value, int decimals); /// same text as printf("%.*lf")
+   int FormatInt(char *buffer, int size, int value); /// same text as printf("%d")
+   long long ScaleFixed(double value, int decimals); /// value * 10^decimals rounded as printf("%.*lf") rounds it
+}
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef _ENGINE_H_
+#define _ENGINE_H_
+
+// SCARA controller engine.  A SESSION is one robot job: its robot connection, transform matrix, arm model, current
+// joint angles, motor speed, path cache and log file.  Sessions share nothing, so a program embedding the engine (the
+// lab6lib library, built from the same sources with LAB6_LIBRARY defined) can run several jobs at the same time, one
+// thread per session.  A session must only be used by one thread at a time.
+
+typedef struct SESSION SESSION;  // one robot job (see lab6.cpp)
+
+SESSION *createSession();                                   // new job: home position, first arm model, no log
+void destroySession(SESSION *S);                            // closes the robot connection and the log file of a job
+bool openLogFile(SESSION *S, const char *strFileName);      // mirrors the output of a job to a log file
+void setSessionOutput(SESSION *S, bool bConsole, bool bQuiet); // console output on/off, all output on/off
+void setSessionBlocks(SESSION *S, bool bOffer);            // offers trajectory blocks when a job connects
+bool connectSession(SESSION *S, const char *host, int port); // connects a job to a simulator
+unsigned long runSessionFile(SESSION *S, const char *strFileName); // processes a commands file.  Returns lines done
+unsigned long getSessionSends(SESSION *S);                  // number of commands a job has sent to its robot
+double estimateJobSeconds(const char *strFileName, const char *strModelFile); // predicted run time of a file (s)
+
+#endif
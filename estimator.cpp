@@ -0,0 +1,398 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "estimator.h"
+#include "trace.h"
+#include "scara.h"
+using namespace openutils;
+
+static const double ESTIMATE_PACING_SEC = 0.2;     // CRobot's pacing
+static const double ESTIMATE_LATENCY_SEC = 0.001;  // a connection on the same host
+static const double ESTIMATE_MIN_PIVOT = 1.0e-12;  // smaller pivots (relative to the diagonal) mean a singular fit
+
+/**
+* Solves the normal equations of a least squares fit for the active columns. Columns that turn out to be linear
+* combinations of the others are made inactive.
+* @param AtA normal matrix (ESTIMATE_NUM_FEATURES x ESTIMATE_NUM_FEATURES)
+* @param Aty right hand side
+* @param active columns in the fit
+* @param x receives the coefficients (0 for inactive columns)
+*/
+static void solveNormalEquations(const double AtA[][ESTIMATE_NUM_FEATURES], const double *Aty, bool *active,
+                                 double *x)
+{
+   const int N = ESTIMATE_NUM_FEATURES;
+   double M[ESTIMATE_NUM_FEATURES][ESTIMATE_NUM_FEATURES + 1], f, scale;
+   int index[ESTIMATE_NUM_FEATURES], n = 0, i, j, k, pivot;
+
+   for(i = 0; i < N; i++)
+   {
+      x[i] = 0.0;
+      if(active[i]) index[n++] = i;
+   }
+   for(i = 0; i < n; i++)
+   {
+      for(j = 0; j < n; j++) M[i][j] = AtA[index[i]][index[j]];
+      M[i][n] = Aty[index[i]];
+   }
+
+   // Gaussian elimination with partial pivoting
+   for(k = 0; k < n; k++)
+   {
+      pivot = k;
+      for(i = k + 1; i < n; i++)
+         if(fabs(M[i][k]) > fabs(M[pivot][k])) pivot = i;
+      scale = AtA[index[k]][index[k]];
+      if(fabs(M[pivot][k]) <= ESTIMATE_MIN_PIVOT * scale)
+      {
+         active[index[k]] = false;  // depends on the columns before it
+         solveNormalEquations(AtA, Aty, active, x);
+         return;
+      }
+      for(j = k; j <= n; j++) std::swap(M[k][j], M[pivot][j]);
+      for(i = k + 1; i < n; i++)
+      {
+         f = M[i][k] / M[k][k];
+         for(j = k; j <= n; j++) M[i][j] -= f * M[k][j];
+      }
+   }
+   for(k = n - 1; k >= 0; k--)
+   {
+      f = M[k][n];
+      for(j = k + 1; j < n; j++) f -= M[k][j] * x[index[j]];
+      x[index[k]] = f / M[k][k];
+   }
+}
+
+CJobEstimator::CJobEstimator()
+{
+   memcpy(m_model.degPerSec, MOTOR_SPEED_DEG_PER_SEC, sizeof(m_model.degPerSec));
+   m_model.commandSec = 0.0;
+   m_model.penSec = 0.0;
+   m_model.colorSec = 0.0;
+   m_model.pacingSec = ESTIMATE_PACING_SEC;
+   m_model.latencySec = ESTIMATE_LATENCY_SEC;
+   Reset();
+}
+
+/**
+* Starts a new estimate: home position, MEDIUM speed (as the simulator starts) and nothing sent.
+*/
+void CJobEstimator::Reset()
+{
+   m_ang1 = m_ang2 = 0.0;
+   m_nSpeed = 1;
+   m_nSends = m_nCommands = 0;
+   m_tSendSec = m_tDoneSec = 0.0;
+   m_moveSec = 0.0;
+   m_jointDeg[0] = m_jointDeg[1] = m_jointDeg[2] = 0.0;
+   m_nPenChanges = m_nColorChanges = 0;
+}
+
+/**
+* Reads a model file written by SaveModel.
+* @param fileName model file
+* @return true if read, false if the file is missing or is not a complete model (the model is then unchanged)
+*/
+bool CJobEstimator::LoadModel(const char *fileName)
+{
+   char line[ESTIMATE_LINE_SIZE];
+   ESTIMATE_MODEL model;
+   FILE *fi = NULL;
+   int version = 0, numItems = 0;
+
+   if(fopen_s(&fi, fileName, "r") != 0 || fi == NULL) return false;
+   while(fgets(line, sizeof(line), fi) != NULL)
+   {
+      if(sscanf_s(line, "ESTIMATE_MODEL %d", &version) == 1) continue;
+      if(sscanf_s(line, "DEG_PER_SEC %lf %lf %lf", &model.degPerSec[0], &model.degPerSec[1],
+                  &model.degPerSec[2]) == 3)
+         numItems += model.degPerSec[0] > 0.0 && model.degPerSec[1] > 0.0 && model.degPerSec[2] > 0.0;
+      else if(sscanf_s(line, "COMMAND_SEC %lf", &model.commandSec) == 1) numItems++;
+      else if(sscanf_s(line, "PEN_SEC %lf", &model.penSec) == 1) numItems++;
+      else if(sscanf_s(line, "COLOR_SEC %lf", &model.colorSec) == 1) numItems++;
+      else if(sscanf_s(line, "PACING_SEC %lf", &model.pacingSec) == 1) numItems++;
+      else if(sscanf_s(line, "LATENCY_SEC %lf", &model.latencySec) == 1) numItems++;
+   }
+   fclose(fi);
+
+   if(version != ESTIMATE_MODEL_VERSION || numItems != 6) return false;
+   m_model = model;
+   return true;
+}
+
+/**
+* Writes the model as text, one parameter per line.
+* @param fileName model file
+* @return true if written
+*/
+bool CJobEstimator::SaveModel(const char *fileName)
+{
+   FILE *fo = NULL;
+
+   if(fopen_s(&fo, fileName, "w") != 0 || fo == NULL) return false;
+   fprintf(fo, "ESTIMATE_MODEL %d\n", ESTIMATE_MODEL_VERSION);
+   fprintf(fo, "DEG_PER_SEC %.9g %.9g %.9g\n", m_model.degPerSec[0], m_model.degPerSec[1], m_model.degPerSec[2]);
+   fprintf(fo, "COMMAND_SEC %.9g\n", m_model.commandSec);
+   fprintf(fo, "PEN_SEC %.9g\n", m_model.penSec);
+   fprintf(fo, "COLOR_SEC %.9g\n", m_model.colorSec);
+   fprintf(fo, "PACING_SEC %.9g\n", m_model.pacingSec);
+   fprintf(fo, "LATENCY_SEC %.9g\n", m_model.latencySec);
+   return fclose(fo) == 0;
+}
+
+/**
+* Adds one send of the controller. It leaves one pacing interval after the send before it.
+* @param data whole command lines
+* @param len number of bytes
+*/
+void CJobEstimator::Add(const char *data, int len)
+{
+   char line[ESTIMATE_LINE_SIZE];
+   const char *end = data + len, *eol;
+   size_t n;
+
+   if(m_nSends > 0) m_tSendSec += m_model.pacingSec;
+   m_nSends++;
+   while(data < end)
+   {
+      eol = (const char *)memchr(data, '\n', end - data);
+      if(eol == NULL) eol = end;
+      n = (size_t)(eol - data) < sizeof(line) - 1 ? (size_t)(eol - data) : sizeof(line) - 1;
+      memcpy(line, data, n);
+      line[n] = '\0';
+      AddLine(line, m_tSendSec + m_model.latencySec);
+      data = eol + 1;
+   }
+}
+
+/**
+* Adds one command line. The simulator starts it when it has arrived and the line before it is done.
+* @param line command line
+* @param tArriveSec time the line reaches the simulator
+*/
+void CJobEstimator::AddLine(const char *line, double tArriveSec)
+{
+   double features[ESTIMATE_NUM_FEATURES];
+   int speed;
+
+   if(!GetFeatures(line, features)) return;
+   m_nCommands++;
+   m_tDoneSec = (tArriveSec > m_tDoneSec ? tArriveSec : m_tDoneSec) + GetBusySec(features);
+   for(speed = 0; speed < 3; speed++)
+   {
+      m_jointDeg[speed] += features[1 + speed];
+      m_moveSec += features[1 + speed] / m_model.degPerSec[speed];
+   }
+   if(features[4] > 0.0) m_nPenChanges++;
+   if(features[5] > 0.0) m_nColorChanges++;
+}
+
+/**
+* Gets the features of one command line and carries it out (joint angles and motor speed):
+*    [0] 1 (every command)
+*    [1..3] largest joint move (deg) at LOW, MEDIUM or HIGH (the current speed only)
+*    [4] 1 for PEN_UP and PEN_DOWN
+*    [5] 1 for PEN_COLOR and CYCLE_PEN_COLORS
+* @param line command line
+* @param features receives ESTIMATE_NUM_FEATURES values
+* @return false for a blank line (no command)
+*/
+bool CJobEstimator::GetFeatures(const char *line, double *features)
+{
+   double ang1, ang2;
+
+   memset(features, 0, ESTIMATE_NUM_FEATURES * sizeof(double));
+   line += strspn(line, " \t\r");
+   if(*line == '\0') return false;
+   features[0] = 1.0;
+
+   if(sscanf_s(line, "ROTATE_JOINT ANG1 %lf ANG2 %lf", &ang1, &ang2) == 2 || strncmp(line, "HOME", 4) == 0)
+   {
+      if(*line == 'H') ang1 = ang2 = 0.0;
+      features[1 + m_nSpeed] = fmax(fabs(ang1 - m_ang1), fabs(ang2 - m_ang2));
+      m_ang1 = ang1;
+      m_ang2 = ang2;
+   }
+   else if(strncmp(line, "MOTOR_SPEED ", 12) == 0)
+   {
+      if(strncmp(line + 12, "LOW", 3) == 0) m_nSpeed = 0;
+      else if(strncmp(line + 12, "MEDIUM", 6) == 0) m_nSpeed = 1;
+      else if(strncmp(line + 12, "HIGH", 4) == 0) m_nSpeed = 2;
+   }
+   else if(strncmp(line, "PEN_UP", 6) == 0 || strncmp(line, "PEN_DOWN", 8) == 0)
+   {
+      features[4] = 1.0;
+   }
+   else if(strncmp(line, "PEN_COLOR ", 10) == 0 || strncmp(line, "CYCLE_PEN_COLORS ", 17) == 0)
+   {
+      features[5] = 1.0;
+   }
+   return true;
+}
+
+/**
+* Simulator time of a command line from its features.
+*/
+double CJobEstimator::GetBusySec(const double *features)
+{
+   return features[0] * m_model.commandSec + features[1] / m_model.degPerSec[0] +
+          features[2] / m_model.degPerSec[1] + features[3] / m_model.degPerSec[2] + features[4] * m_model.penSec +
+          features[5] * m_model.colorSec;
+}
+
+/**
+* Adds up the features of the lines a trace record completes. A line split across records belongs to the record
+* holding its end.
+* @param data record data
+* @param len number of bytes
+* @param partial line started by the records before (updated)
+* @param features receives the sum of the features
+*/
+void CJobEstimator::AddTraceRecord(const char *data, int len, std::string *partial, double *features)
+{
+   double lineFeatures[ESTIMATE_NUM_FEATURES];
+   const char *end = data + len, *eol;
+   int i;
+
+   memset(features, 0, ESTIMATE_NUM_FEATURES * sizeof(double));
+   while(data < end)
+   {
+      eol = (const char *)memchr(data, '\n', end - data);
+      if(eol == NULL)
+      {
+         partial->append(data, end - data);
+         break;
+      }
+      partial->append(data, eol - data);
+      if(partial->size() < ESTIMATE_LINE_SIZE && GetFeatures(partial->c_str(), lineFeatures))
+         for(i = 0; i < ESTIMATE_NUM_FEATURES; i++) features[i] += lineFeatures[i];
+      partial->clear();
+      data = eol + 1;
+   }
+}
+
+/**
+* Fits the model to recorded traces. The direction of a trace is that of its first record.
+*
+* Simulator side traces (reads):  a stand-in simulator records every line when it starts on it and a blank line
+* when it waits for data, so the time from a record to the next is the time it took to carry out the lines of the
+* first. Those intervals are fitted to the features of their lines (see GetFeatures) by least squares with no
+* negative times. Parameters whose features never occur are not changed.
+*
+* Controller side traces (sends):  the pacing is the median time between sends.
+*
+* The latency cannot be seen from one side and is not changed. The estimator is reset.
+* @param traceFiles trace files
+* @param numTraces number of trace files
+* @param fit receives the results
+* @return false if a trace cannot be read or the traces hold no usable interval
+*/
+bool CJobEstimator::Calibrate(const char *const *traceFiles, int numTraces, ESTIMATE_FIT *fit)
+{
+   const int N = ESTIMATE_NUM_FEATURES;
+   std::vector<double> intervals;          // features and measured time of every busy interval
+   std::vector<double> sendIntervals;      // times between sends
+   double features[ESTIMATE_NUM_FEATURES], nextFeatures[ESTIMATE_NUM_FEATURES];
+   double AtA[ESTIMATE_NUM_FEATURES][ESTIMATE_NUM_FEATURES], Aty[ESTIMATE_NUM_FEATURES], x[ESTIMATE_NUM_FEATURES];
+   double y, e, worst;
+   bool active[ESTIMATE_NUM_FEATURES], bHaveRecord;
+   unsigned long long tUs;
+   std::string partial;
+   TRACE_RECORD rec;
+   int direction, t, i, j, k;
+   size_t n;
+
+   memset(fit, 0, sizeof(ESTIMATE_FIT));
+   for(t = 0; t < numTraces; t++)
+   {
+      CTraceReader reader;
+      if(!reader.Open(traceFiles[t])) return false;
+      fit->numTraces++;
+      Reset();
+      partial.clear();
+      memset(features, 0, sizeof(features));
+      bHaveRecord = false;
+      direction = 0;
+      tUs = 0;
+      while(reader.Next(&rec))
+      {
+         if(direction == 0) direction = rec.type;
+         if(rec.type != direction) continue;
+         if(direction == TRACE_SEND)
+         {
+            if(bHaveRecord) sendIntervals.push_back((rec.timeUs - tUs) / 1.0e6);
+         }
+         else
+         {
+            AddTraceRecord(rec.data, rec.len, &partial, nextFeatures);
+            if(bHaveRecord && features[0] > 0.0)
+            {
+               intervals.insert(intervals.end(), features, features + N);
+               intervals.push_back((rec.timeUs - tUs) / 1.0e6);
+            }
+            memcpy(features, nextFeatures, sizeof(features));
+         }
+         tUs = rec.timeUs;
+         bHaveRecord = true;
+      }
+   }
+   Reset();
+
+   // pacing
+   fit->numSendIntervals = (unsigned long)sendIntervals.size();
+   if(!sendIntervals.empty())
+   {
+      std::nth_element(sendIntervals.begin(), sendIntervals.begin() + sendIntervals.size() / 2, sendIntervals.end());
+      m_model.pacingSec = sendIntervals[sendIntervals.size() / 2];
+   }
+
+   // simulator timing:  least squares, dropping the most negative coefficient until there are none
+   fit->numIntervals = (unsigned long)(intervals.size() / (N + 1));
+   if(fit->numIntervals == 0) return fit->numSendIntervals > 0;
+   memset(AtA, 0, sizeof(AtA));
+   memset(Aty, 0, sizeof(Aty));
+   for(n = 0; n < intervals.size(); n += N + 1)
+   {
+      y = intervals[n + N];
+      for(i = 0; i < N; i++)
+      {
+         Aty[i] += intervals[n + i] * y;
+         for(j = 0; j < N; j++) AtA[i][j] += intervals[n + i] * intervals[n + j];
+      }
+   }
+   for(i = 0; i < N; i++) active[i] = AtA[i][i] > 0.0;
+   for(;;)
+   {
+      solveNormalEquations(AtA, Aty, active, x);
+      for(k = -1, worst = 0.0, i = 0; i < N; i++)
+         if(active[i] && x[i] < worst)
+         {
+            worst = x[i];
+            k = i;
+         }
+      if(k < 0) break;
+      active[k] = false;
+   }
+
+   // a zero time per degree means the traces did not show that speed
+   for(i = 0; i < N; i++) fit->bFitted[i] = AtA[i][i] > 0.0 && (i < 1 || i > 3 || x[i] > 0.0);
+   if(fit->bFitted[0]) m_model.commandSec = x[0];
+   for(i = 0; i < 3; i++)
+      if(fit->bFitted[1 + i]) m_model.degPerSec[i] = 1.0 / x[1 + i];
+   if(fit->bFitted[4]) m_model.penSec = x[4];
+   if(fit->bFitted[5]) m_model.colorSec = x[5];
+
+   for(n = 0; n < intervals.size(); n += N + 1)
+   {
+      y = GetBusySec(&intervals[n]);
+      e = y - intervals[n + N];
+      fit->measuredSec += intervals[n + N];
+      fit->predictedSec += y;
+      fit->rmsErrorSec += e * e;
+   }
+   fit->rmsErrorSec = sqrt(fit->rmsErrorSec / fit->numIntervals);
+   return true;
+}
@@ -0,0 +1,81 @@
+#ifndef _ESTIMATOR_H_
+#define _ESTIMATOR_H_
+
+#include <string>
+
+#define ESTIMATE_MODEL_FILE "estimator.txt"  /// model file used when none is given
+#define ESTIMATE_MODEL_VERSION 1             /// version of the model file format
+#define ESTIMATE_LINE_SIZE 256               /// longest robot command line
+#define ESTIMATE_MAX_TRACES 64               /// most traces one calibration reads
+#define ESTIMATE_NUM_FEATURES 6              /// commands, joint travel at LOW, MEDIUM, HIGH, pen changes, color changes
+
+namespace openutils
+{
+
+   /// timing of the simulator and of the link to it
+   struct ESTIMATE_MODEL
+   {
+      double degPerSec[3]; /// joint speed at LOW, MEDIUM and HIGH (the largest joint move sets the time)
+      double commandSec; /// time the simulator takes for any command line
+      double penSec; /// extra time of PEN_UP and PEN_DOWN
+      double colorSec; /// extra time of PEN_COLOR and CYCLE_PEN_COLORS
+      double pacingSec; /// controller delay after every send (CRobot pacing)
+      double latencySec; /// time from a send to its arrival at the simulator
+   };
+
+   /// results of a calibration
+   struct ESTIMATE_FIT
+   {
+      int numTraces; /// traces read
+      unsigned long numIntervals; /// simulator busy intervals fitted (simulator side traces)
+      unsigned long numSendIntervals; /// intervals between sends used for the pacing (controller side traces)
+      double measuredSec; /// total time of the busy intervals fitted
+      double predictedSec; /// the same total predicted by the fitted model
+      double rmsErrorSec; /// RMS error of the fitted model over the busy intervals
+      bool bFitted[ESTIMATE_NUM_FEATURES]; /// commandSec, the 3 speeds, penSec, colorSec:  true if the traces set it
+   };
+
+   /// Predicts how long the simulator takes to carry out the commands a controller sends, without the simulator.
+   /// Every send leaves the controller one pacing interval after the one before it and arrives one latency later;
+   /// the simulator carries out its lines one after the other, a ROTATE_JOINT taking as long as its largest joint
+   /// move at the current MOTOR_SPEED. The model can be calibrated from traces: the lines a stand-in simulator
+   /// carries out in real time (-standin -realtime -record) give the simulator timing, and the sends of a controller
+   /// trace give its pacing.
+   class CJobEstimator
+   {
+   private:
+      ESTIMATE_MODEL m_model; /// timing used
+      double m_ang1, m_ang2; /// current joint angles (deg)
+      int m_nSpeed; /// current motor speed (0 = LOW, 1 = MEDIUM, 2 = HIGH)
+      unsigned long m_nSends; /// sends added
+      unsigned long m_nCommands; /// command lines added
+      double m_tSendSec; /// time of the last send
+      double m_tDoneSec; /// time the simulator finishes the last command
+      double m_moveSec; /// time spent moving the joints
+      double m_jointDeg[3]; /// joint travel at LOW, MEDIUM and HIGH
+      unsigned long m_nPenChanges, m_nColorChanges; /// PEN_UP/PEN_DOWN and PEN_COLOR/CYCLE_PEN_COLORS lines
+   public:
+      CJobEstimator(); /// default model (the stand-in simulator's speeds, CRobot's pacing)
+      void SetModel(const ESTIMATE_MODEL *model) { m_model = *model; } /// timing of the following estimates
+      const ESTIMATE_MODEL *GetModel() { return &m_model; } /// returns the timing used
+      bool LoadModel(const char *fileName); /// reads a model file.  false if missing or damaged
+      bool SaveModel(const char *fileName); /// writes the model file.  false if it cannot be written
+      void Reset(); /// home position, MEDIUM speed, nothing sent
+      void Add(const char *data, int len); /// adds one send of whole command lines
+      double GetTotalSec() { return m_tDoneSec; } /// returns the predicted time from the first send to the end
+      double GetMotionSec() { return m_moveSec; } /// returns the time spent moving the joints
+      double GetJointDeg(int speed) { return m_jointDeg[speed]; } /// returns the joint travel at a motor speed
+      unsigned long GetNumSends() { return m_nSends; } /// returns the number of sends added
+      unsigned long GetNumCommands() { return m_nCommands; } /// returns the number of command lines added
+      unsigned long GetNumPenChanges() { return m_nPenChanges; } /// returns the number of PEN_UP/PEN_DOWN lines
+      unsigned long GetNumColorChanges() { return m_nColorChanges; } /// returns the number of color lines
+      bool Calibrate(const char *const *traceFiles, int numTraces, ESTIMATE_FIT *fit); /// fits the model to traces
+   private:
+      bool GetFeatures(const char *line, double *features); /// features of one line (see Calibrate)
+      double GetBusySec(const double *features); /// simulator time of a line from its features
+      void AddLine(const char *line, double tArriveSec); /// adds one command line
+      void AddTraceRecord(const char *data, int len, std::string *partial, double *features); /// adds up lines
+   };
+}
+
+#endif
@@ -0,0 +1,112 @@
+#include <chrono>
+#include <thread>
+#include "executor.h"
+#include "trace.h"
+using namespace openutils;
+
+// class CTask
+
+CTask::~CTask()
+{
+   if(m_handle) m_handle.destroy();
+}
+
+// class CExecutor
+
+CExecutor::~CExecutor()
+{
+   for(size_t n = 0; n < m_tasks.size(); n++) m_tasks[n].destroy();
+}
+
+/**
+* Adds a coroutine. The executor owns it from now on.
+* @param task the coroutine (suspended at its start)
+*/
+void CExecutor::Spawn(CTask &&task)
+{
+   m_tasks.push_back(task.m_handle);
+   m_ready.push_back(task.m_handle);
+   task.m_handle = nullptr;
+}
+
+/**
+* Runs the coroutines until all of them have finished. Coroutines whose time has come join the back of the ready
+* queue so a coroutine waiting for a time that has already passed cannot starve the others.
+*/
+void CExecutor::Run()
+{
+   unsigned long long tNowUs, tNextUs;  // current time, earliest timer
+   size_t n;                            // timer index
+
+   while(!m_tasks.empty())
+   {
+      tNowUs = TraceClockUs();
+      for(n = 0; n < m_timers.size();)
+      {
+         if(m_timers[n].timeUs <= tNowUs)
+         {
+            m_ready.push_back(m_timers[n].handle);
+            m_timers.erase(m_timers.begin() + n);
+         }
+         else
+         {
+            n++;
+         }
+      }
+
+      if(!m_ready.empty())
+      {
+         std::coroutine_handle<> handle = m_ready.front();
+         m_ready.pop_front();
+         Resume(handle);
+      }
+      else if(!m_timers.empty())
+      {
+         tNextUs = m_timers[0].timeUs;
+         for(n = 1; n < m_timers.size(); n++) if(m_timers[n].timeUs < tNextUs) tNextUs = m_timers[n].timeUs;
+         std::this_thread::sleep_for(std::chrono::microseconds(tNextUs - tNowUs));
+      }
+      else
+      {
+         break;  // every coroutine is suspended outside the executor
+      }
+   }
+}
+
+/**
+* Resumes a coroutine. A finished coroutine is destroyed and the exception it ended with (if any) is rethrown.
+* @param handle the coroutine
+*/
+void CExecutor::Resume(std::coroutine_handle<> handle)
+{
+   std::exception_ptr exception;  // exception that ended the coroutine
+   size_t n;                      // task index
+
+   handle.resume();
+   if(!handle.done()) return;
+
+   for(n = 0; n < m_tasks.size(); n++)
+   {
+      if(m_tasks[n].address() == handle.address())
+      {
+         exception = m_tasks[n].promise().m_exception;
+         m_tasks[n].destroy();
+         m_tasks.erase(m_tasks.begin() + n);
+         break;
+      }
+   }
+   if(exception) std::rethrow_exception(exception);
+}
+
+/**
+* Queues the suspended coroutine: at the back of the ready queue for Yield (or a time that has passed), with the
+* timers for WaitUntil.
+* @param handle the suspended coroutine
+*/
+void CExecutor::CAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+   if(m_timeUs <= TraceClockUs())
+      m_executor->m_ready.push_back(handle);
+   else
+      m_executor->m_timers.push_back({m_timeUs, handle});
+}
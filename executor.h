@@ -0,0 +1,77 @@
+#ifndef _EXECUTOR_H_
+#define _EXECUTOR_H_
+
+#include <coroutine>
+#include <exception>
+#include <deque>
+#include <vector>
+
+namespace openutils
+{
+
+   /// A coroutine run by CExecutor.  It starts suspended and is owned by the executor once spawned.
+   class CTask
+   {
+   public:
+      struct promise_type
+      {
+         std::exception_ptr m_exception; /// exception that ended the coroutine (empty if it returned)
+
+         CTask get_return_object() { return CTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+         std::suspend_always initial_suspend() noexcept { return {}; }
+         std::suspend_always final_suspend() noexcept { return {}; }
+         void return_void() {}
+         void unhandled_exception() { m_exception = std::current_exception(); }
+      };
+
+      CTask(CTask &&task) noexcept : m_handle(task.m_handle) { task.m_handle = nullptr; } /// move constructor
+      CTask(const CTask &) = delete;
+      CTask &operator = (const CTask &) = delete;
+      ~CTask(); /// destroys the coroutine if it was never spawned
+   private:
+      explicit CTask(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+      std::coroutine_handle<promise_type> m_handle; /// the coroutine
+      friend class CExecutor;
+   };
+
+   /// Runs coroutines on the calling thread.  A coroutine gives the thread to the others with co_await Yield() or
+   /// co_await WaitUntil(timeUs).  The executor only sleeps when every coroutine is waiting for a time.
+   class CExecutor
+   {
+   public:
+      /// awaitable of Yield and WaitUntil
+      class CAwaiter
+      {
+      private:
+         CExecutor *m_executor; /// executor to resume from
+         unsigned long long m_timeUs; /// TraceClockUs time to resume at (0 = as soon as possible)
+      public:
+         CAwaiter(CExecutor *executor, unsigned long long timeUs) : m_executor(executor), m_timeUs(timeUs) {}
+         bool await_ready() { return false; } /// always suspends so the other coroutines get a turn
+         void await_suspend(std::coroutine_handle<> handle); /// queues the coroutine to be resumed
+         void await_resume() {}
+      };
+   private:
+      /// coroutine waiting for a time
+      struct TIMER
+      {
+         unsigned long long timeUs; /// TraceClockUs time to resume at
+         std::coroutine_handle<> handle; /// the coroutine
+      };
+
+      std::vector<std::coroutine_handle<CTask::promise_type>> m_tasks; /// spawned coroutines that have not finished
+      std::deque<std::coroutine_handle<>> m_ready; /// coroutines to resume, in order
+      std::vector<TIMER> m_timers; /// coroutines waiting for a time
+   public:
+      CExecutor() {} /// constructor
+      ~CExecutor(); /// destroys unfinished coroutines
+      void Spawn(CTask &&task); /// adds a coroutine.  It first runs when Run is called
+      void Run(); /// runs until every coroutine has finished.  Rethrows the first exception a coroutine threw
+      CAwaiter Yield() { return CAwaiter(this, 0); } /// co_await to let the other coroutines run
+      CAwaiter WaitUntil(unsigned long long timeUs) { return CAwaiter(this, timeUs); } /// co_await to sleep
+   private:
+      void Resume(std::coroutine_handle<> handle); /// resumes a coroutine and destroys it if it finished
+   };
+}
+
+#endif
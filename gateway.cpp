@@ -0,0 +1,258 @@
+#include <string.h>
+#include <stdio.h>
+#include "gateway.h"
+using namespace openutils;
+
+CCommandGateway::CCommandGateway(int port, int maxQueuedLines) : m_server(port, GATEWAY_MAX_PRODUCERS)
+{
+   for(int n = 0; n < GATEWAY_MAX_PRODUCERS; n++) m_producers[n].client = NULL;
+   m_nMaxQueuedLines = maxQueuedLines < 1 ? 1 : maxQueuedLines;
+   m_nNext = 0;
+}
+
+CCommandGateway::~CCommandGateway()
+{
+   for(int n = 0; n < GATEWAY_MAX_PRODUCERS; n++) CloseProducer(&m_producers[n]);
+   m_server.Close();
+}
+
+/**
+* Serves producers until the handler returns GATEWAY_STOP. Throws CSocketException if the gateway cannot listen.
+* @param handler called for every received line
+* @param onConnect called for every new producer connection (NULL for none)
+* @param context passed to the handlers
+*/
+void CCommandGateway::Run(GatewayLineHandler handler, GatewayConnectHandler onConnect, void *context)
+{
+   fd_set readSet, writeSet;            // sockets to wait for
+   struct timeval noWait = {0, 0};      // poll only
+   char line[GATEWAY_LINE_SIZE];        // line being handled
+   char message[GATEWAY_LINE_SIZE];     // handler error message
+   bool bQueued, bFree;                 // true if any lines are queued, true if a producer slot is free
+   int n, k, status;
+
+   m_server.Listen(true);
+
+   while(true)
+   {
+      // wait for connections, data and room for replies.  Producers at their backpressure limit are not read.
+      FD_ZERO(&readSet);
+      FD_ZERO(&writeSet);
+      bQueued = bFree = false;
+      for(n = 0; n < GATEWAY_MAX_PRODUCERS; n++)
+      {
+         PRODUCER *p = &m_producers[n];
+         if(p->client == NULL)
+         {
+            bFree = true;
+            continue;
+         }
+         if(p->outLength > 0) FD_SET(p->client->GetSocket(), &writeSet);
+         if(IsBacklogged(p)) continue;  // not read or served until it takes its replies
+         if(p->numLines > 0) bQueued = true;
+         if(!p->bDisconnected && p->numLines < m_nMaxQueuedLines && p->length < GATEWAY_BUFFER_SIZE - 1)
+            FD_SET(p->client->GetSocket(), &readSet);
+      }
+      if(bFree) FD_SET(m_server.GetSocket(), &readSet);
+
+      if(select(0, &readSet, &writeSet, NULL, bQueued ? &noWait : NULL) == SOCKET_ERROR)
+         throw CSocketException(WSAGetLastError(), "select failed: Run()");
+
+      if(FD_ISSET(m_server.GetSocket(), &readSet))
+      {
+         n = AcceptProducer();
+         if(n >= 0 && onConnect != NULL) onConnect(n, context);
+      }
+      for(n = 0; n < GATEWAY_MAX_PRODUCERS; n++)
+      {
+         PRODUCER *p = &m_producers[n];
+         if(p->client == NULL) continue;
+         if(p->outLength > 0 && FD_ISSET(p->client->GetSocket(), &writeSet)) WriteProducer(p);
+         if(!p->bDisconnected && FD_ISSET(p->client->GetSocket(), &readSet)) ReadProducer(p);
+      }
+
+      // handle one line from every producer that has one, in turn
+      for(k = 0; k < GATEWAY_MAX_PRODUCERS; k++)
+      {
+         n = (m_nNext + k) % GATEWAY_MAX_PRODUCERS;
+         PRODUCER *p = &m_producers[n];
+         if(p->client == NULL || IsBacklogged(p)) continue;
+
+         if(TakeLine(p, line))
+         {
+            p->lineNumber++;
+            message[0] = '\0';
+            status = handler(n, p->lineNumber, line, message, GATEWAY_LINE_SIZE, context);
+            SendStatus(p, status, message);
+            if(status == GATEWAY_STOP)
+            {
+               WriteProducer(p);  // best effort: the stopping producer gets its reply if its socket takes it
+               return;
+            }
+         }
+         if(p->bDisconnected && p->numLines == 0 && p->outLength == 0) CloseProducer(p);
+      }
+      m_nNext = (m_nNext + 1) % GATEWAY_MAX_PRODUCERS;
+   }
+}
+
+/**
+* Takes a waiting connection into a free slot and makes its socket non-blocking (replies are written as the
+* producer reads them).
+* @return slot of the producer, or -1 if the connection went away or no slot is free
+*/
+int CCommandGateway::AcceptProducer()
+{
+   CRobot *client;
+   unsigned long nonBlocking = 1;
+
+   try
+   {
+      client = m_server.Accept();
+   }
+   catch(CSocketException)
+   {
+      return -1;  // client gave up before it was accepted
+   }
+
+   for(int n = 0; n < GATEWAY_MAX_PRODUCERS; n++)
+   {
+      PRODUCER *p = &m_producers[n];
+      if(p->client != NULL) continue;
+
+      ioctlsocket(client->GetSocket(), FIONBIO, &nonBlocking);
+      p->client = client;
+      p->length = 0;
+      p->numLines = 0;
+      p->outLength = 0;
+      p->lineNumber = 0;
+      p->bDisconnected = false;
+      p->bDeaf = false;
+      p->bDiscarding = false;
+      return n;
+   }
+   delete client;  // no free slot (select only waits for connections when there is one)
+   return -1;
+}
+
+void CCommandGateway::ReadProducer(PRODUCER *p)
+{
+   int nret, n;
+
+   try
+   {
+      nret = p->client->Read(p->buffer + p->length, GATEWAY_BUFFER_SIZE - 1 - p->length);
+   }
+   catch(CSocketException e)
+   {
+      if(e.GetCode() == WSAEWOULDBLOCK) return;  // nothing after all
+      nret = 0;
+   }
+
+   if(nret <= 0)
+   {
+      p->bDisconnected = true;
+      if(p->length > 0 && p->buffer[p->length - 1] != '\n')  // last line without '\n'
+      {
+         p->buffer[p->length++] = '\n';
+         p->numLines++;
+      }
+      return;
+   }
+
+   for(n = p->length; n < p->length + nret; n++)
+   {
+      if(p->buffer[n] == '\n') p->numLines++;
+   }
+   p->length += nret;
+}
+
+/**
+* Removes the next complete line (with its '\n') from the producer buffer. Lines too long for
+* GATEWAY_LINE_SIZE are rejected with an error status.
+*/
+bool CCommandGateway::TakeLine(PRODUCER *p, char *line)
+{
+   char *end;
+   int len;
+
+   if(p->numLines == 0)
+   {
+      if(p->length == GATEWAY_BUFFER_SIZE - 1)  // buffer full without a complete line
+      {
+         p->length = 0;
+         if(!p->bDiscarding)
+         {
+            p->lineNumber++;
+            SendStatus(p, GATEWAY_ERROR, "line too long");
+         }
+         p->bDiscarding = true;
+      }
+      return false;
+   }
+
+   end = (char *)memchr(p->buffer, '\n', p->length);
+   len = (int)(end - p->buffer) + 1;
+
+   bool bTooLong = p->bDiscarding || len > GATEWAY_LINE_SIZE - 1;
+   if(!bTooLong)
+   {
+      memcpy(line, p->buffer, len);
+      line[len] = '\0';
+   }
+
+   memmove(p->buffer, p->buffer + len, p->length - len);
+   p->length -= len;
+   p->numLines--;
+
+   if(bTooLong && !p->bDiscarding)
+   {
+      p->lineNumber++;
+      SendStatus(p, GATEWAY_ERROR, "line too long");
+   }
+   p->bDiscarding = false;
+   return !bTooLong;
+}
+
+/**
+* Queues the status of the last line. Only called for a producer that is not backlogged, so a reply always fits.
+*/
+void CCommandGateway::SendStatus(PRODUCER *p, int status, const char *message)
+{
+   char *strStatus = p->output + p->outLength;
+   int size = GATEWAY_OUTPUT_SIZE - p->outLength;
+   int len;
+
+   if(p->bDeaf) return;
+   if(status == GATEWAY_ERROR)
+      len = snprintf(strStatus, size, "ERR %lu %s\n", p->lineNumber, message);
+   else
+      len = snprintf(strStatus, size, "OK %lu\n", p->lineNumber);
+   p->outLength += len < size ? len : size - 1;
+}
+
+/**
+* Sends as many queued replies as the producer socket takes without blocking.
+*/
+void CCommandGateway::WriteProducer(PRODUCER *p)
+{
+   int nret = send(p->client->GetSocket(), p->output, p->outLength, 0);
+
+   if(nret == SOCKET_ERROR)
+   {
+      if(WSAGetLastError() == WSAEWOULDBLOCK) return;
+      p->bDisconnected = true;  // producer stopped listening.  Its queued lines are still handled.
+      p->bDeaf = true;
+      p->outLength = 0;
+      return;
+   }
+   memmove(p->output, p->output + nret, p->outLength - nret);
+   p->outLength -= nret;
+}
+
+void CCommandGateway::CloseProducer(PRODUCER *p)
+{
+   if(p->client == NULL) return;
+   delete p->client;
+   p->client = NULL;
+}
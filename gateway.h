@@ -0,0 +1,69 @@
+#ifndef _GATEWAY_H_
+#define _GATEWAY_H_
+
+#include "robot.h"
+
+#define GATEWAY_PORT 1271            /// default gateway port (the simulator uses PORT)
+#define GATEWAY_MAX_PRODUCERS 16     /// maximum number of producers connected at once
+#define GATEWAY_BUFFER_SIZE 8192     /// receive buffer per producer
+#define GATEWAY_LINE_SIZE 1002       /// longest line (including '\n' and '\0')
+#define GATEWAY_REPLY_SIZE (GATEWAY_LINE_SIZE + 32) /// longest status reply
+#define GATEWAY_OUTPUT_SIZE 8192     /// replies waiting to be sent per producer
+
+namespace openutils
+{
+
+   enum GATEWAY_STATUS { GATEWAY_OK, GATEWAY_ERROR, GATEWAY_STOP }; /// result of handling one line
+
+   /// Called when a producer connection takes a slot, before any of its lines (per producer state starts here).
+   typedef void (*GatewayConnectHandler)(int producer, void *context);
+
+   /// Called for every line received. lineNumber restarts at 1 for every new producer connection.
+   /// Write a reason into message (messageSize bytes) when returning GATEWAY_ERROR.
+   typedef int (*GatewayLineHandler)(int producer, unsigned long lineNumber, char *line, char *message,
+                                     int messageSize, void *context);
+
+   /// Accepts command streams from several local producers over TCP and hands their lines to a handler as they
+   /// arrive, one line per producer in turn. A producer whose queued lines reach the limit is not read again
+   /// until they are handled, so TCP flow control holds back that producer only. After every line the producer
+   /// gets "OK <line>\n" or "ERR <line> <message>\n". Replies are queued per producer and written without blocking
+   /// when its socket takes them. A producer that does not read its replies is neither read nor served while its
+   /// queue is nearly full, so it cannot stall the others.
+   class CCommandGateway
+   {
+   private:
+      struct PRODUCER
+      {
+         CRobot *client; /// producer connection (NULL if slot free)
+         char buffer[GATEWAY_BUFFER_SIZE]; /// received data not handled yet
+         int length; /// bytes in buffer
+         int numLines; /// complete lines in buffer
+         char output[GATEWAY_OUTPUT_SIZE]; /// replies not sent yet
+         int outLength; /// bytes in output
+         unsigned long lineNumber; /// number of lines handled
+         bool bDisconnected; /// true if the producer closed its end
+         bool bDeaf; /// true if the producer stopped taking replies (they are dropped)
+         bool bDiscarding; /// true while skipping the rest of a line that was too long
+      };
+
+      CServerSocket m_server; /// listening socket
+      PRODUCER m_producers[GATEWAY_MAX_PRODUCERS]; /// connected producers
+      int m_nMaxQueuedLines; /// per producer backpressure limit
+      int m_nNext; /// next producer to serve (round robin)
+   public:
+      CCommandGateway(int port, int maxQueuedLines); /// constructor
+      ~CCommandGateway(); /// closes all connections
+      void Run(GatewayLineHandler handler, GatewayConnectHandler onConnect,
+               void *context); /// serves producers until handler returns GATEWAY_STOP
+   private:
+      int AcceptProducer(); /// takes a waiting connection.  Returns its slot or -1
+      void ReadProducer(PRODUCER *p); /// reads what a producer has sent
+      void WriteProducer(PRODUCER *p); /// sends as many queued replies as the socket takes
+      bool IsBacklogged(PRODUCER *p) { return p->outLength > GATEWAY_OUTPUT_SIZE - GATEWAY_REPLY_SIZE; } /// held back
+      bool TakeLine(PRODUCER *p, char *line); /// removes the next complete line from a producer buffer
+      void SendStatus(PRODUCER *p, int status, const char *message); /// queues the status of the last line
+      void CloseProducer(PRODUCER *p); /// closes a producer connection
+   };
+}
+
+#endif
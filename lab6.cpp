@@ -24,24 +24,31 @@ Date Created: April 19 2023
 #include <string.h>  // string functions
 #include <ctype.h>   // character functions
 #include <stdbool.h> // bool definitions
+#include <limits.h>  // INT_MAX
+#include <thread>    // loopback benchmark stand-in thread, validator thread pool
+#include <atomic>    // validator work queue
 #include "robot.h"   // robot functions
+#include "command.h" // robot command string writer
+#include "parser.h"  // command parameter parser
+#include "scara.h"   // SCARA arm models and kinematics
+#include "gateway.h" // network command gateway
+#include "replay.h"  // robot traffic trace replay
+#include "standin.h" // stand-in simulator
+#include "workload.h" // synthetic command file generator
+#include "executor.h" // coroutine executor
+#include "engine.h"   // controller sessions (the library interface)
+#include "preview.h"  // offline drawing preview
+#include "estimator.h" // job duration estimator
+#include "trajblock.h" // trajectory block protocol extension
 
 //---------------------------- Program Constants ----------------------------------------------------------------------
-const double PI = 3.14159265358979323846;    // the one and only
-const double L1 = 350.0;                     // length of the inner arm
-const double L2 = 250.0;                     // length of the outer arm
-const double ABS_THETA1_DEG_MAX = 150.0;     // maximum magnitude of shoulder angle in degrees
-const double ABS_THETA2_DEG_MAX = 170.0;     // maximum magnitude of elbow angle in degrees
-const double LMAX = L1 + L2;                 // max L -> maximum reach of robot
-const double LMIN = sqrt(L1 * L1 + L2 * L2 - 2.0 * L1 * L2 * cos(PI - ABS_THETA2_DEG_MAX * PI / 180.0)); // min L
+// NOTE: PI, ERROR_VALUE and the arm geometry (L1, L2, joint limits, LMIN, LMAX) are in scara.h
 
 const unsigned char HL = 196;                // for console (code page 437)
 const unsigned char FHL = 151;               // for file (code page 1252)
 const unsigned char PLUSMINUS_SYMBOL = 241;  // the plus/minus ascii symbol
 const unsigned char DEGREE_SYMBOL = 248;     // the degree symbol
 
-const double ERROR_VALUE = DBL_MAX;  // value for angles when robot can't reach
-
 const char *seps = "\t,\n ;:";       // for tokenizing the line string
 
 // number of points on path for every 500 units of arc length
@@ -49,6 +56,30 @@ const int LOW_RESOLUTION_POINTS_PER_500_UNITS = 11;
 const int MEDIUM_RESOLUTION_POINTS_PER_500_UNITS = 31;
 const int HIGH_RESOLUTION_POINTS_PER_500_UNITS = 51;
 
+// automatic motor speed planner (MOTOR_SPEED AUTO tolerance mediumError highError).  Its timing is the job duration
+// estimator model (estimator.txt, see -calibrate).  Its error model, the tool tip error per degree of joint step at a
+// right angle turn at MEDIUM and HIGH, depends on the robot and nothing here measures it, so every MOTOR_SPEED AUTO
+// gives it (measure the corner error of a zigzag drawn at each speed).  LOW is the fallback speed.
+
+const int EXECUTOR_MAX_QUEUED_SENDS = 64;  // robot commands file processing may get ahead of the simulator
+const int GATEWAY_MAX_QUEUED_LINES = 4;  // lines a gateway producer may have waiting before it is held back
+const int PATH_CACHE_SIZE = 64;  // number of expanded shape paths kept for reuse (least recently used are dropped)
+const int VALIDATE_MESSAGE_SIZE = 160;  // longest validator message
+const int MAX_TRANSFORM_DEPTH = 32;     // most PUSH_TRANSFORM levels
+const int MAX_PENDING_TRANSFORMS = 8;  // transforms queued before they are composed into the transform matrix
+const int MAX_ARGS = 7;                 // most parameters of any command (TRIANGLE and QUADRATIC_BEZIER)
+const int MAX_MACRO_DEPTH = 16;         // most REPEAT/CALL levels being expanded at once
+const int MAX_MACRO_NAME_SIZE = 64;     // size of array to store a DEFINE name
+const int CHECKPOINT_PENDING = 16;      // checkpoints waiting for the commands of their lines to be sent
+const int CHECKPOINT_SAVE_MS = 1000;    // shortest time between checkpoint file writes
+const int CHECKPOINT_SETTLE_MS = 1000;  // commands written this recently may still be in the socket buffer or waiting
+                                        // in the simulator, so a line is only taken as done this long after them
+const int CHECKPOINT_VERSION = 2;       // checkpoint file format
+const int RESUME_ATTEMPTS = 5;          // reconnections tried after the simulator connection is lost
+const int RESUME_RETRY_MS = 2000;       // wait before every reconnection
+const int MAX_HOST_SIZE = 256;          // size of array to store the simulator host name
+const int BENCHMARK_PORT = 1272;  // port of the stand-in simulator used by "-benchmark file -loopback"
+
 const int PRECISION = 2;      // for printing values to console
 const int FIELD_WIDTH = 8;    // for printing values to console
 
@@ -56,27 +87,52 @@ const int COMMAND_INDEX_NOT_FOUND = -1;   // used when command index not found
 const int BLANK_LINE = -2;                // used to signal a blank line in the input file
 
 
-#define COMMAND_STRING_ARRAY_SIZE 502  // size of array to store commands written by sprintf_s for robot. 
+#define COMMAND_STRING_ARRAY_SIZE 502  // size of array to store commands written by CCommandWriter for robot. 
                                        // NOTE: 2 elements must be reserved for trailing '\n' and '\0'
 
 #define MAX_LINE_SIZE 1002             // size of array to store a line from a file. 
                                        // NOTE: 2 elements must be reserved for trailing '\n' and '\0'
 
+#define CHECKPOINT_FILE "checkpoint.txt" // checkpoint file of the console program (-resume)
 
-enum ARM { LEFT, RIGHT };                                                  // left arm or right arm configuration
-enum MOTOR_SPEED{ MOTOR_SPEED_LOW, MOTOR_SPEED_MEDIUM, MOTOR_SPEED_HIGH }; // motor speed
+enum MOTOR_SPEED{ MOTOR_SPEED_LOW, MOTOR_SPEED_MEDIUM, MOTOR_SPEED_HIGH, MOTOR_SPEED_AUTO }; // motor speed
 enum RESOLUTION{ RESOLUTION_LOW, RESOLUTION_MEDIUM, RESOLUTION_HIGH };     // motor speed
+enum BEZIER_SPACING_MODE{ BEZIER_SPACING_PARAMETER, BEZIER_SPACING_LENGTH };  // QUADRATIC_BEZIER point spacing
 enum CURRENT_ANGLES { GET_CURRENT_ANGLES, UPDATE_CURRENT_ANGLES };         // used to get/update current SCARA angles
+enum CURRENT_STATE { GET_CURRENT_STATE, UPDATE_CURRENT_STATE };            // used to get/update other robot state
 
 enum COMMAND_INDEX  // list of all command indexes
 {
    ROTATE_JOINT, MOTOR_SPEED, PEN_UP, PEN_DOWN, CYCLE_PEN_COLORS, PEN_COLOR, CLEAR_TRACE,
    CLEAR_REMOTE_COMMAND_LOG, CLEAR_POSITION_LOG, SHUTDOWN_SIMULATION, END, HOME, LINE, ARC, MOVE_TO,
-   TRIANGLE, RECTANGLE, QUADRATIC_BEZIER, ROTATE, TRANSLATE, SCALE, RESET_TRANSFORM_MATRIX, NUM_COMMANDS
+   TRIANGLE, RECTANGLE, QUADRATIC_BEZIER, ROTATE, TRANSLATE, SCALE, RESET_TRANSFORM_MATRIX, ARM_MODEL,
+   PATH_TOLERANCE, PUSH_TRANSFORM, POP_TRANSFORM, REPEAT, END_REPEAT, DEFINE, END_DEFINE, CALL, BEZIER_SPACING,
+   NUM_COMMANDS
 };
 
 //---------------------------- Structure Definitions ------------------------------------------------------------------
 
+// transform matrix with PUSH_TRANSFORM/POP_TRANSFORM levels.  ROTATE, TRANSLATE and SCALE are only queued in ops;
+// they are composed into TM when geometry is drawn (composeTransform), so transforms that are popped before
+// anything is drawn cost nothing.
+typedef struct TRANSFORM_STACK
+{
+   double TM[3][3];                                // composed transform matrix (without the queued ops)
+   double ops[MAX_PENDING_TRANSFORMS][3][3];       // queued premultiplier matrices, oldest first
+   int numOps;                                     // number of queued ops
+   double saved[MAX_TRANSFORM_DEPTH][3][3];        // transform matrix of every pushed level
+   int depth;                                      // number of pushed levels
+}
+TRANSFORM_STACK;
+
+// gateway session.  The producers share one robot job, but every producer has its own transform stack.
+typedef struct GATEWAY_SESSION
+{
+   SESSION *S;                                // the job
+   TRANSFORM_STACK TS[GATEWAY_MAX_PRODUCERS]; // transform stack of every producer
+}
+GATEWAY_SESSION;
+
 // structure to map command keyword string to a command index
 typedef struct COMMAND
 {
@@ -92,50 +148,196 @@ typedef struct RGB
 }
 RGB;
 
-// SCARA tooltip coordinates
-typedef struct TOOL_POSITION
+// pen state
+typedef struct PEN_STATE
+{
+   RGB penColor;
+   int penPos;          // PEN_UP or PEN_DOWN
+   bool bCycleColors;   // CYCLE_PEN_COLORS ON
+}
+PEN_STATE;
+
+typedef struct PATH_CHECK
 {
-   double x, y;  
+   bool bCanDraw[2];    // true if robot can draw, false if not.  Left and right arm configurations
+   double dThetaDeg[2]; // total angle changes required to draw path
 }
-TOOL_POSITION;
+PATH_CHECK;
 
-// SCARA joint angles (degrees)
-typedef struct JOINT_ANGLES
+// path expanded into joint space for both arm configurations
+typedef struct JOINT_PATH
 {
-   double theta1Deg, theta2Deg;
+   TOOL_POSITION *tpts;    // transformed path points
+   JOINT_ANGLES *ja[2];    // joint angles for every point.  Left and right arm configurations
+   size_t NP;              // number of points
+   PATH_CHECK pathCheck;   // dThetaDeg is the joint rotation along the path (moving to its start not included)
 }
-JOINT_ANGLES;
+JOINT_PATH;
 
-// pen state
-typedef struct PEN_STATE
+// identifies an expanded shape path.  Memory must be zeroed before filling in (compared with memcmp).
+typedef struct PATH_KEY
 {
-   RGB penColor;
-   int penPos;
+   int commandIndex;                // shape command
+   int resolution;                  // path resolution
+   double params[6];                // shape parameters (unused ones are zero)
+   double TM[3][3];                 // transform matrix the path was expanded with
+   const SCARA_MODEL *model;        // arm model the path was expanded for
+   int bezierSpacing;               // BEZIER_SPACING the path was expanded with (QUADRATIC_BEZIER only)
 }
-PEN_STATE;
+PATH_KEY;
 
-// forward kinematics solution data 
-typedef struct FORWARD_SOLUTION
+// cache of expanded shape paths.  Repeated shapes only need to be sent.
+typedef struct PATH_CACHE
 {
-   TOOL_POSITION toolPos;  // tool tip coordinates
-   bool bCanReach;         // true if robot can reach, false if not
+   PATH_KEY keys[PATH_CACHE_SIZE];        // key of every entry
+   JOINT_PATH paths[PATH_CACHE_SIZE];     // expanded path of every entry
+   unsigned long lastUsed[PATH_CACHE_SIZE]; // use counter value when entry was last used (0 = empty entry)
+   unsigned long useCount;                // incremented on every lookup
+   unsigned long hits, misses, evictions; // statistics
 }
-FORWARD_SOLUTION;
+PATH_CACHE;
 
-// inverse kinematics solution data 
-typedef struct INVERSE_SOLUTION
+// motor speed state and automatic speed planner settings
+typedef struct MOTOR_SPEED_STATE
 {
-   JOINT_ANGLES jointAngles[2];  // joint angles (in degrees).  Left and Right arm solutions
-   bool bCanReach[2];            // true if robot can reach, false if not.  Left and right arm configurations
+   int currentSpeed;      // last speed sent to the robot (-1 if not known)
+   bool bAuto;            // true if motor speed is chosen per path segment (MOTOR_SPEED AUTO)
+   double tolerance;      // tool tip accuracy tolerance used by the planner
+   double errorPerDeg[3]; // planner error model:  tool tip error per degree of joint step at a right angle turn
 }
-INVERSE_SOLUTION;
+MOTOR_SPEED_STATE;
 
-typedef struct PATH_CHECK
+// a line checked by the dry-run validator (-validate).  Only lines with a primitive or a problem are kept.
+typedef struct VALIDATE_LINE
 {
-   bool bCanDraw[2];    // true if robot can draw, false if not.  Left and right arm configurations
-   double dThetaDeg[2]; // total angle changes required to draw path
+   unsigned long nLine;                      // file line number
+   int commandIndex;                         // command index
+   ARG_VALUE args[MAX_ARGS];                 // parsed parameters
+   int numSpecs;                             // number of parameters
+   double TM[3][3];                          // transform matrix in effect for the line
+   const SCARA_MODEL *model;                 // arm model in effect for the line
+   int bezierSpacing;                        // BEZIER_SPACING in effect for the line
+   bool bCheck;                              // true if the reach still has to be checked (by the thread pool)
+   bool bError, bWarning;                    // result
+   char strIssue[VALIDATE_MESSAGE_SIZE];     // error or warning message
 }
-PATH_CHECK;
+VALIDATE_LINE;
+
+// a line of a REPEAT or DEFINE body
+typedef struct MACRO_LINE
+{
+   char *strLine;                            // the line as read (dynamically allocated)
+   unsigned long nLine;                      // file line number
+   int commandIndex;                         // command index (REPEAT and CALL are expanded, not processed)
+   int count;                                // REPEAT:  number of times
+   size_t match;                             // REPEAT:  index of its END_REPEAT in the body
+}
+MACRO_LINE;
+
+// the lines of a DEFINE, or of the outermost REPEAT read from the file.  A REPEAT inside a body is not copied;
+// it is expanded from the lines between it and its END_REPEAT.
+typedef struct MACRO_BODY
+{
+   char name[MAX_MACRO_NAME_SIZE];           // DEFINE name ("" for a REPEAT)
+   MACRO_LINE *lines;                        // the lines (without the END_REPEAT/END_DEFINE of the body itself)
+   size_t numLines, capacity;                // number of lines, size of lines
+}
+MACRO_BODY;
+
+// a REPEAT or CALL being expanded
+typedef struct MACRO_FRAME
+{
+   const MACRO_BODY *body;                   // body the lines come from
+   size_t first, end;                        // lines repeated:  body->lines[first] to body->lines[end - 1]
+   size_t pos;                               // next line
+   int remaining;                            // times the lines are repeated after this time
+}
+MACRO_FRAME;
+
+// a commands file with its REPEAT and CALL lines expanded as it is read (getNextLine).  Only the bodies are kept,
+// never the unrolled lines, so a small file can draw a large pattern with no more memory than its source.
+typedef struct MACRO_STREAM
+{
+   FILE *fi;                                 // the commands file
+   unsigned long nLine;                      // file line number of the last line read from fi
+   MACRO_BODY *macros;                       // DEFINEd macros
+   int numMacros, capacity;                  // number of macros, size of macros
+   MACRO_BODY repeat;                        // outermost REPEAT read from the file
+   MACRO_FRAME frames[MAX_MACRO_DEPTH];      // REPEAT and CALL levels being expanded
+   int depth;                                // number of levels being expanded (0 = reading fi)
+}
+MACRO_STREAM;
+
+// execution state after a line of a commands file.  Everything needed to carry on from the next line without
+// processing (or drawing) any of the lines before it again.
+typedef struct CHECKPOINT
+{
+   unsigned long numLines;       // expanded lines done (REPEAT and CALL unrolled)
+   unsigned long nLine;          // file line number of the last line done (0 = none)
+   unsigned long numSends;       // robot commands sent when every command of the line has been written
+   unsigned long long tWrittenUs; // TraceClockUs time every command of the line had been written (0 = not yet)
+   TRANSFORM_STACK TS;           // transform matrix and its pushed levels
+   const SCARA_MODEL *armModel;  // arm model
+   double pathTolerance;         // PATH_TOLERANCE
+   int bezierSpacing;            // BEZIER_SPACING
+   MOTOR_SPEED_STATE motorSpeed; // motor speed state
+   JOINT_ANGLES angles;          // robot angles
+   PEN_STATE pen;                // pen position, color and color cycling
+}
+CHECKPOINT;
+
+// checkpoints of the commands file being processed.  A checkpoint is taken after every line but only becomes the
+// last one once every command of the line has been written and CHECKPOINT_SETTLE_MS have passed since.  Nothing
+// comes back from the simulator, so that is the closest the controller gets to knowing the line was carried out.
+typedef struct CHECKPOINT_LOG
+{
+   char strFileName[MAX_PATH];              // file the last checkpoint is saved to ("" = memory only)
+   char strCommandFile[MAX_PATH];           // commands file the checkpoints are for
+   CHECKPOINT pending[CHECKPOINT_PENDING];  // checkpoints waiting for their commands to settle (oldest first)
+   int first, numPending;                   // index of the oldest pending checkpoint, number pending
+   CHECKPOINT last;                         // last checkpoint whose commands have settled
+   unsigned long long tSavedUs;             // TraceClockUs time the last checkpoint was saved
+}
+CHECKPOINT_LOG;
+
+// one robot job: everything processing a commands file changes.  Sessions share nothing, so several jobs can run
+// at the same time on separate threads (see engine.h).  Allocate with createSession (PATH_CACHE is large).
+typedef struct SESSION
+{
+   CRobot robot;                 // the robot connection
+   FILE *flog;                   // log file (NULL = console only)
+   bool bQuiet;                  // true to turn dsprintf off (benchmarks)
+   bool bConsole;                // false to write dsprintf output to the log file only (concurrent jobs)
+   CTraceRecorder recorder;      // records robot traffic (-record)
+   const SCARA_MODEL *armModel;  // the arm model being controlled (ARM_MODEL command)
+   PATH_CACHE pathCache;         // expanded shape paths
+   double pathTolerance;         // tool tip error allowed when dropping path points (PATH_TOLERANCE command).  0 = off
+   int bezierSpacing;            // QUADRATIC_BEZIER point spacing (BEZIER_SPACING command)
+   unsigned long numPointsDrawn; // path points sent to the robot (benchmark statistics)
+   JOINT_ANGLES currentAngles;   // current robot angles.  NOTE:  robot must be in home position when a job starts!
+   MOTOR_SPEED_STATE motorSpeed; // motor speed state
+   ESTIMATE_MODEL timing;        // simulator timing the motor speed planner weighs (estimator.txt, see -calibrate)
+   CPreviewRenderer *preview;    // draws the robot commands (-render).  NULL = off
+   PEN_STATE pen;                // pen position, color and color cycling sent to the robot
+   char strHost[MAX_HOST_SIZE];  // simulator host (reconnections)
+   int port;                     // simulator port
+   CHECKPOINT_LOG checkpoints;   // execution state of the commands file being processed
+}
+SESSION;
+
+// a job of "-jobs": one commands file sent to the simulator on one port by its own session and thread
+typedef struct JOB
+{
+   int port;                     // simulator port
+   const char *strFileName;      // commands file
+   char strLogFile[MAX_PATH];    // log file of the job
+   bool bBlocks;                 // true to offer trajectory blocks
+   bool bOk;                     // true if the job connected and read its file
+   unsigned long numLines;       // lines processed
+   unsigned long numSends;       // robot commands sent
+   double elapsedSec;            // time taken
+}
+JOB;
 
 //----------------------------- Globals -------------------------------------------------------------------------------
 // global array of command keyword string to command index associations
@@ -151,560 +353,4189 @@ const COMMAND m_Commands[NUM_COMMANDS] = {{ROTATE_JOINT, "ROTATE_JOINT"}, {MOTOR
                                           {TRIANGLE, "TRIANGLE"},{RECTANGLE, "RECTANGLE"},
                                           {QUADRATIC_BEZIER, "QUADRATIC_BEZIER"},{ROTATE, "ROTATE"},
                                           {TRANSLATE, "TRANSLATE"},{SCALE, "SCALE"},
-                                          {RESET_TRANSFORM_MATRIX, "RESET_TRANSFORM_MATRIX"}};
+                                          {RESET_TRANSFORM_MATRIX, "RESET_TRANSFORM_MATRIX"},
+                                          {ARM_MODEL, "ARM_MODEL"}, {PATH_TOLERANCE, "PATH_TOLERANCE"},
+                                          {PUSH_TRANSFORM, "PUSH_TRANSFORM"}, {POP_TRANSFORM, "POP_TRANSFORM"},
+                                          {REPEAT, "REPEAT"}, {END_REPEAT, "END_REPEAT"}, {DEFINE, "DEFINE"},
+                                          {END_DEFINE, "END_DEFINE"}, {CALL, "CALL"},
+                                          {BEZIER_SPACING, "BEZIER_SPACING"}};
 
-CRobot robot;        // the global robot Class.  Can be used everywhere
-FILE *flog = NULL;   // the global log file
+const char *const strMotorSpeeds[] = {"LOW", "MEDIUM", "HIGH", "AUTO"}; // MOTOR_SPEED keywords (order of MOTOR_SPEED)
+const char *const strResolutions[] = {"LOW", "MEDIUM", "HIGH"};   // resolution keywords (same order as RESOLUTION)
+const char *const strArms[] = {"LEFT", "RIGHT"};                 // arm keywords (same order as ARM)
+const char *const strOnOff[] = {"ON", "OFF"};                    // CYCLE_PEN_COLORS keywords
+const char *const strSpacings[] = {"PARAMETER", "LENGTH"};       // BEZIER_SPACING keywords (same order as enum)
+
+// command parameter specifications (see parseArguments)
+#define NUM_ARGS(specs) ((int)(sizeof(specs) / sizeof(specs[0])))
+const ARG_SPEC CYCLE_PEN_COLORS_ARGS[] = {ARG_KEYWORDS("ON/OFF", strOnOff, false)};
+const ARG_SPEC PEN_COLOR_ARGS[] = {ARG_INT_RANGE("r", 0, 255), ARG_INT_RANGE("g", 0, 255), ARG_INT_RANGE("b", 0, 255)};
+const ARG_SPEC MOTOR_SPEED_ARGS[] = {ARG_KEYWORDS("speed", strMotorSpeeds, false),
+                                     {"tolerance", ARG_DOUBLE, ARG_POSITIVE, ARG_NO_LIMIT, NULL, 0, true},
+                                     {"mediumError", ARG_DOUBLE, 0.0, ARG_NO_LIMIT, NULL, 0, true},
+                                     {"highError", ARG_DOUBLE, 0.0, ARG_NO_LIMIT, NULL, 0, true}};
+const ARG_SPEC ROTATE_JOINT_ARGS[] = {ARG_NUMBER("theta1"), ARG_NUMBER("theta2")};  // limits depend on arm model
+const ARG_SPEC MOVE_TO_ARGS[] = {ARG_NUMBER("x"), ARG_NUMBER("y"), ARG_KEYWORDS("arm", strArms, true)};
+const ARG_SPEC LINE_ARGS[] = {ARG_NUMBER("x1"), ARG_NUMBER("y1"), ARG_NUMBER("x2"), ARG_NUMBER("y2"),
+                              ARG_KEYWORDS("resolution", strResolutions, true)};
+const ARG_SPEC ARC_ARGS[] = {ARG_NUMBER("xc"), ARG_NUMBER("yc"), ARG_RANGE("r", ARG_POSITIVE, ARG_NO_LIMIT),
+                             ARG_NUMBER("start angle"), ARG_NUMBER("end angle"),
+                             ARG_KEYWORDS("resolution", strResolutions, true)};
+const ARG_SPEC TRIANGLE_ARGS[] = {ARG_NUMBER("x1"), ARG_NUMBER("y1"), ARG_NUMBER("x2"), ARG_NUMBER("y2"),
+                                  ARG_NUMBER("x3"), ARG_NUMBER("y3"), ARG_KEYWORDS("resolution", strResolutions, true)};
+const ARG_SPEC RECTANGLE_ARGS[] = {ARG_NUMBER("x1"), ARG_NUMBER("y1"), ARG_NUMBER("x2"), ARG_NUMBER("y2"),
+                                   ARG_KEYWORDS("resolution", strResolutions, true)};
+const ARG_SPEC QUADRATIC_BEZIER_ARGS[] = {ARG_NUMBER("x0"), ARG_NUMBER("y0"), ARG_NUMBER("x1"), ARG_NUMBER("y1"),
+                                          ARG_NUMBER("x2"), ARG_NUMBER("y2"),
+                                          ARG_KEYWORDS("resolution", strResolutions, true)};
+const ARG_SPEC ROTATE_ARGS[] = {ARG_NUMBER("angle")};
+const ARG_SPEC TRANSLATE_ARGS[] = {ARG_NUMBER("dx"), ARG_NUMBER("dy")};
+const ARG_SPEC ARM_MODEL_ARGS[] = {{"model", ARG_KEYWORD, 0.0, 0.0, SCARA_MODEL_NAMES, NUM_SCARA_MODELS, false}};
+const ARG_SPEC PATH_TOLERANCE_ARGS[] = {ARG_RANGE("tolerance", 0.0, ARG_NO_LIMIT)};
+const ARG_SPEC BEZIER_SPACING_ARGS[] = {ARG_KEYWORDS("spacing", strSpacings, false)};
+const ARG_SPEC SCALE_ARGS[] = {ARG_NUMBER("sx"), {"sy", ARG_DOUBLE, -ARG_NO_LIMIT, ARG_NO_LIMIT, NULL, 0, true}};
+const ARG_SPEC REPEAT_ARGS[] = {ARG_INT_RANGE("count", 0, INT_MAX)};
 
 //----------------------------- Function Prototypes -------------------------------------------------------------------
+// (the session functions an embedding program calls are declared in engine.h)
 bool flushInputBuffer();               // flushes any characters left in the standard input buffer
 void waitForEnterKey();                // waits for the Enter key to be pressed
 int nint(double);                      // computes nearest integer to a double value
 double degToRad(double);               // returns angle in radians from input angle in degrees
 double radToDeg(double);               // returns angle in degrees from input angle in radians
 double mapAngle(double);               // make sure inverseKinematic angled are mapped in range robot understands
-void pauseRobotThenClear();            // pauses the robot for screen capture, then clears everything
-void printHLine(int N);                // prints a solid line to the console
-int dsprintf(char const *, ...);       // prints to log file and to console 
+void pauseRobotThenClear(SESSION *S);  // pauses the robot for screen capture, then clears everything
+void printHLine(SESSION *S, int N);    // prints a solid line to the console
+int dsprintf(SESSION *S, char const *, ...); // prints to the log file of a session and to console
 void makeStringUpperCase(char *);      // makes an input string all upper case
 size_t getNumPathPoints(double, int);  // gets the number of points on a path based on arc length and resolution value
-void robotAngles(JOINT_ANGLES *, int); // gets or updates the current SCARA angles
+void robotAngles(SESSION *S, JOINT_ANGLES *, int); // gets or updates the current SCARA angles
+void robotMotorSpeed(SESSION *S, MOTOR_SPEED_STATE *, int); // gets or updates the motor speed state
 
-void processFileCommands();            // gets commands out of a file and processes them for robot control
-bool setCyclePenColors(char *strLine); // Parses line string to send a CYCLE_PEN_COLORS command to robot
+void processFileCommands(SESSION *S);  // gets commands out of a file and processes them for robot control
+unsigned long processCommandFile(SESSION *S, FILE *fi); // processes every line of an open commands file
+void processCommandLine(SESSION *S, char *strLine, unsigned long nLine, const char *strError,
+                        TRANSFORM_STACK *TS);       // processes one line
+unsigned long runCommandFile(SESSION *S, FILE *fi,
+                             const CHECKPOINT *start); // processes a commands file while earlier commands are sent
+void initMacroStream(MACRO_STREAM *ms, FILE *fi);    // starts expanding a commands file
+void freeMacroStream(MACRO_STREAM *ms);              // frees the macros and bodies of a commands file
+bool getNextLine(MACRO_STREAM *ms, char *strLine, unsigned long *nLine, char *strError,
+                 size_t errorSize);                  // gets the next line of a commands file with macros expanded
+bool readMacroBody(MACRO_STREAM *ms, MACRO_BODY *body, int endIndex, char *strError,
+                   size_t errorSize);                // stores the lines of a REPEAT or DEFINE read from the file
+bool storeMacroLine(MACRO_BODY *body, const char *strLine, unsigned long nLine, int commandIndex); // adds a line
+void freeMacroBody(MACRO_BODY *body);                // frees the lines of a body
+bool pushMacroFrame(MACRO_STREAM *ms, const MACRO_BODY *body, size_t first, size_t end, int count); // starts a level
+bool getMacroName(const char *strLine, char *strName); // gets the name of DEFINE and CALL
+bool defineMacro(MACRO_STREAM *ms, MACRO_BODY *body); // stores a DEFINE (replaces one with the same name)
+const MACRO_BODY *findMacro(const MACRO_STREAM *ms, const char *strName); // finds a DEFINE by name
+CTask processCommandsTask(SESSION *S, CExecutor *executor, MACRO_STREAM *ms, TRANSFORM_STACK *TS,
+                          unsigned long *numLines, bool *bDone); // coroutine processing the lines of a commands file
+CTask sendCommandsTask(SESSION *S, CExecutor *executor, const bool *bDone); // coroutine sending the queued commands
+void takeCheckpoint(SESSION *S, const TRANSFORM_STACK *TS, unsigned long numLines,
+                    unsigned long nLine);         // records the execution state after a line
+void settleCheckpoints(SESSION *S);               // keeps the checkpoints whose commands have settled
+bool saveCheckpoint(SESSION *S);                  // writes the last checkpoint to the checkpoint file
+bool loadCheckpoint(const char *strFileName, CHECKPOINT *cp, char *strCommandFile); // reads a checkpoint file
+unsigned long restoreCheckpoint(SESSION *S, MACRO_STREAM *ms,
+                                TRANSFORM_STACK *TS); // restores the robot and skips the lines already done
+bool reconnectSession(SESSION *S);                // connects to the simulator again after the connection is lost
+void resumeCommandFile(SESSION *S, const char *strCheckpointFile); // carries on with a file from its checkpoint
+void runJobs(int argc, char *argv[], int n); // runs several commands files at once, each on its own simulator
+void runJob(JOB *job);                 // job thread
+void generateWorkload(const char *strFileName, unsigned long numLines, unsigned long long seed,
+                      const WORKLOAD_MIX *mix); // writes a synthetic commands file
+bool getWorkloadMix(int argc, char *argv[], WORKLOAD_MIX *mix); // gets the -mix, -depth and -unreachable options
+void runBenchmark(const char *strFileName, bool bLoopback, bool bTcp,
+                  bool bBlocks);  // times a commands file without the simulator
+void runBenchmarkStandIn(CStandInSimulator *standIn, STANDIN_STATS *stats); // loopback benchmark thread
+void renderCommandFile(const char *strFileName, const char *strImageFile, int width); // draws a file offline
+bool estimateFile(const char *strFileName, CJobEstimator *estimator,
+                  unsigned long *numLines);  // runs a commands file through an estimator without the robot
+void estimateCommandFile(const char *strFileName, const char *strModelFile); // predicts the run time of a file
+void calibrateEstimator(int argc, char *argv[], int n, const char *strModelFile); // fits the estimator to traces
+void validateCommandFile(const char *strFileName, int numThreads); // checks a commands file without the robot
+void validateWorker(VALIDATE_LINE *lines, size_t numLines, std::atomic<size_t> *next); // validator thread
+void validatePrimitive(VALIDATE_LINE *v);  // checks that the robot can reach a primitive
+void processGatewayCommands(SESSION *S, int port); // gets commands from producers connected over TCP and processes them
+void replayTrace(const char *strTraceFile, int port, bool bFast, bool bWaitReplies); // replays a recorded trace
+void runStandInSimulator(int port, bool bRealTime,
+                         const char *strTraceFile);  // accepts simulator commands in place of the simulator
+int findArg(int argc, char *argv[], const char *strName); // finds a command line argument
+int getPortArg(int argc, char *argv[], int n, int defaultPort); // gets an optional port after argument n
+int handleGatewayLine(int producer, unsigned long lineNumber, char *strLine, char *strMessage, int messageSize,
+                      void *context);  // processes one line received by the gateway
+void handleGatewayConnect(int producer, void *context);  // starts the state of a new gateway producer
+bool setCyclePenColors(SESSION *S, char *strLine); // Parses line string to send a CYCLE_PEN_COLORS command to robot
+void sendPenPosition(SESSION *S, int penPos);      // sends PEN_UP or PEN_DOWN and remembers the pen position
 
-void processCommand(int commandIndex, char *strLine, double TM[3][3]); // processes a command string from the file
+bool processCommand(SESSION *S, int commandIndex, char *strLine, TRANSFORM_STACK *TS); // processes a file command
 int getCommandIndex(const char *strLine);                              // gets the command keyword index from a string
-bool setPenColor(const char *strLine);
+bool setPenColor(SESSION *S, const char *strLine);
+bool setMotorSpeed(SESSION *S, char *strLine);                         // parses/sends MOTOR_SPEED (or enables AUTO)
+const char *checkMotorSpeedArgs(const ARG_VALUE *args);                 // checks the MOTOR_SPEED parameters given
+bool rotateJoint(SESSION *S, char *strLine);                           // parses/sends ROTATE_JOINT
+bool moveTo(SESSION *S, char *strLine, const double TM[][3]);          // parses MOVE_TO and moves the tool tip
+bool drawShape(SESSION *S, int commandIndex, char *strLine, const double TM[][3]); // parses and draws LINE, ARC, etc.
+bool setTransform(SESSION *S, int commandIndex, char *strLine, TRANSFORM_STACK *TS); // parses ROTATE, TRANSLATE, SCALE
+bool setArmModel(SESSION *S, const char *strLine);                     // parses ARM_MODEL and selects the arm model
+bool setPathTolerance(SESSION *S, const char *strLine);                // parses PATH_TOLERANCE
+bool setBezierSpacing(SESSION *S, const char *strLine);                // parses BEZIER_SPACING
+bool getArguments(SESSION *S, const char *strLine, int commandIndex, const ARG_SPEC *specs, int numSpecs,
+                  ARG_VALUE *args);                                    // parses parameters and reports errors
+const ARG_SPEC *getCommandSpecs(int commandIndex, int *numSpecs);     // gets the parameter specifications of a command
+bool buildShapePoints(int commandIndex, const ARG_VALUE *args, int numSpecs, int bezierSpacing, TOOL_POSITION **pPts,
+                      size_t *pNP);                                    // generates the path points of a shape
+
+INVERSE_SOLUTION inverseKinematics(SESSION *S, TOOL_POSITION tp); // left and right arm joint angles for a tool position
+FORWARD_SOLUTION forwardKinematics(SESSION *S, JOINT_ANGLES ja);    // tool position for a set of joint angles
+bool appendLinePoints(TOOL_POSITION **, size_t *, TOOL_POSITION P1, TOOL_POSITION P2, int resolution);
+bool appendArcPoints(TOOL_POSITION **, size_t *, TOOL_POSITION PC, double r, double ang0Deg, double ang1Deg, int res);
+bool appendQuadraticBezierPoints(TOOL_POSITION **, size_t *, TOOL_POSITION P0, TOOL_POSITION P1, TOOL_POSITION P2,
+                                 int resolution, int spacing);
+double getQuadraticBezierLengthAt(const double A[2], const double B[2], double t); // arc length from t = 0 to t
+bool expandJointPath(SESSION *S, const TOOL_POSITION *pts, size_t NP, const double TM[][3],
+                     JOINT_PATH *path);                      // path -> IK
+bool drawJointPath(SESSION *S, const JOINT_PATH *path);      // chooses an arm configuration and draws a joint path
+bool drawSplitJointPath(SESSION *S, const JOINT_PATH *path, JOINT_ANGLES current); // draws a path that needs both arms
+size_t planArmSegments(SESSION *S, const JOINT_PATH *path, JOINT_ANGLES current, size_t *segStart, int *segArm,
+                       double *dThetaDeg); // splits a path into the fewest single arm segments
+bool isJointReachable(SESSION *S, JOINT_ANGLES ja);          // true if joint angles are within the arm model limits
+size_t sendJointPathSegment(SESSION *S, const JOINT_PATH *path, int arm, size_t first,
+                            size_t NP);                      // decimates and sends
+void freeJointPath(JOINT_PATH *path);                        // frees the memory of a joint path
+const JOINT_PATH *pathCacheFind(SESSION *S, const PATH_KEY *key); // finds an expanded path in the cache
+const JOINT_PATH *pathCacheInsert(SESSION *S, const PATH_KEY *key,
+                                  JOINT_PATH *path);         // moves an expanded path into the cache
+void pathCacheClear(SESSION *S);                             // empties the cache and prints its statistics
+void sendJointPath(SESSION *S, const TOOL_POSITION *tpts, const JOINT_ANGLES *ja,
+                   size_t NP);                               // sends a pen down joint path
+void sendJointPathBlocks(SESSION *S, const JOINT_ANGLES *ja, size_t NP, bool bAuto,
+                         const int *speeds);                 // sends a pen down joint path as trajectory blocks
+size_t decimateJointPath(SESSION *S, const TOOL_POSITION *tpts, const JOINT_ANGLES *ja, size_t NP, double tolerance,
+                         size_t *keep);  // finds the joint path points needed to stay within a tool tip tolerance
+double getJointSegmentError(SESSION *S, const TOOL_POSITION *tpts, const JOINT_ANGLES *ja, size_t i, size_t j,
+                            size_t *kWorst);  // tool tip error of moving straight from ja[i] to ja[j] in joint space
+double pointToSegmentDistance(TOOL_POSITION p, TOOL_POSITION a, TOOL_POSITION b); // distance to a line segment
+void sendRotateJoint(SESSION *S, JOINT_ANGLES ja);     // sends ROTATE_JOINT and updates the current angles
+void sendMotorSpeed(SESSION *S, int speed);            // sends MOTOR_SPEED if different from the current speed
+double getJointStepDeg(JOINT_ANGLES ja0, JOINT_ANGLES ja1); // largest joint rotation between two joint positions
+void scheduleMotorSpeeds(const TOOL_POSITION *tpts, const JOINT_ANGLES *ja, size_t NP, const MOTOR_SPEED_STATE *mss,
+                         const ESTIMATE_MODEL *timing, int entrySpeed,
+                         int *speeds); // chooses a motor speed for every segment of a path
 
 double getQuadraticBezierArcLength(TOOL_POSITION P0, TOOL_POSITION P1, TOOL_POSITION P2); // calc Bezier curve length
 void resetTransformMatrix(double TM[][3]);                        // resets the transform matrix to the identity matrix
 void transformMatrixMultiply(double TM[][3], const double M[][3]);// premultiplies the transform matrix TM by matrix M
+void initTransformStack(TRANSFORM_STACK *TS);                     // identity transform, nothing pushed
+void queueTransform(TRANSFORM_STACK *TS, const double M[][3]);    // queues a premultiplier matrix
+void composeTransform(TRANSFORM_STACK *TS);                       // composes the queued matrices into TS->TM
+bool pushTransform(SESSION *S, TRANSFORM_STACK *TS);              // PUSH_TRANSFORM
+bool popTransform(SESSION *S, TRANSFORM_STACK *TS);               // POP_TRANSFORM
 TOOL_POSITION transform(const double TM[][3], TOOL_POSITION tp);  // tranform tool position coordinates
 
 //---------------------------------------------------------------------------------------------------------------------
 // DESCRIPTION:  Program to demonstrate basic control of the SCARA robot simulator
-// ARGUMENTS:    none
+// ARGUMENTS:    argc, argv:  command line.
+//                  -gateway [port]      takes commands over TCP instead of from a file
+//                  -record file         records all robot traffic to a trace file
+//                  -blocks              offers the simulator trajectory blocks (whole joint paths in one compact
+//                                       binary command, see trajblock.h).  Text commands if it does not take them.
+//                  -resume [file]       carries on with the commands file of a checkpoint file (checkpoint.txt,
+//                                       saved while a commands file is processed) after its last checkpoint
+//                  -replay file [port] [-fast] [-ack]
+//                                       sends the commands in a trace to the simulator (or whatever listens on
+//                                       port) with the recorded timing or as fast as possible (-fast).  -ack waits
+//                                       for a reply to every line (the gateway).  Reports latency percentiles.
+//                  -standin [port] [-realtime] [-record file]
+//                                       accepts the commands of one controller in place of the simulator (and
+//                                       records when it carries out every line to a trace file)
+//                  -generate file lines [seed] [-mix line,arc,bezier,polygon,move,transform,color]
+//                            [-depth n] [-unreachable percent]
+//                                       writes a reproducible synthetic commands file
+//                  -benchmark file [-loopback [-tcp] [-blocks]]
+//                                       processes a commands file with nothing sent (or sent to a stand-in
+//                                       simulator on BENCHMARK_PORT through shared memory, or TCP with -tcp, as
+//                                       trajectory blocks with -blocks) and reports lines/s, points/s and commands/s
+//                  -render file image [width]
+//                                       draws a commands file without the simulator (full parse, transform, IK and
+//                                       path planning, then forward kinematics of the joint angles sent) into an
+//                                       .svg, .ppm or .png image
+//                  -estimate file [-model file]
+//                                       predicts how long the simulator takes to carry out a commands file (full
+//                                       processing, nothing sent) with the timing in the model file (estimator.txt)
+//                  -calibrate trace [trace ...] [-model file]
+//                                       fits the timing of the model file to recorded traces (-standin -realtime
+//                                       traces for the simulator timing, controller traces for the pacing)
+//                  -validate file [-threads n]
+//                                       checks every line of a commands file without the robot and reports all
+//                                       problems with their line numbers
+//                  -jobs port file [port file ...] [-blocks]
+//                                       processes several commands files at once, each one sent to the simulator
+//                                       listening on its port by its own session and thread (log_port.txt)
 // RETURN VALUE: an int that tells the O/S how the program ended.  0 = EXIT_SUCCESS = normal termination
-int main()
-{
-   // open connection with robot
-   if(!robot.Initialize()) return 0;
-
-   processFileCommands();
-
-   dsprintf("\n\nPress ENTER to end the program...\n");
-   waitForEnterKey();
-   return EXIT_SUCCESS;
-}
-
-//---------------------------------------------------------------------------------------------------------------------
-// DESCRIPTION:  processes robot commands stored in a file and uses them to control the SCARA robot
-// ARGUMENTS:    none
-// RETURN VALUE: none
-void processFileCommands()
+#ifndef LAB6_LIBRARY
+int main(int argc, char *argv[])
 {
-   char strFileName[MAX_PATH];                  // stores input file name
-   char strLine[MAX_LINE_SIZE];                 // stores one line out of input file
-   FILE *fi = NULL;                             // input file handle
-   errno_t err;                                 // stores fopen_s error value
-   int numChars;                                // used to draw dividing line
-   int nLine;                                   // file line number
-   int commandIndex = COMMAND_INDEX_NOT_FOUND;  // command index
-   double TM[3][3] = {{1.0, 0.0, 0.0},{0.0, 1.0, 0.0},{0.0, 0.0, 1.0}};
+   int n;       // argument index
+   SESSION *S;  // the job of this program
 
-   // open the log file (mirrors console output to log.txt if dsprintf used instead of printf)
-   err = fopen_s(&flog, "log.txt", "w");
-   if(err != 0 || flog == NULL)
+   if((n = findArg(argc, argv, "-standin")) > 0)
    {
-      dsprintf("Cannot open log.txt for writing!  Press ENTER to end program...");
-      waitForEnterKey();
-      exit(0);
+      int r = findArg(argc, argv, "-record");
+      runStandInSimulator(getPortArg(argc, argv, n, PORT), findArg(argc, argv, "-realtime") > 0,
+                          r > 0 && r + 1 < argc ? argv[r + 1] : NULL);
+      return EXIT_SUCCESS;
    }
-
-   // get the input file
-   while(true)
+   if((n = findArg(argc, argv, "-generate")) > 0 && n + 2 < argc)
    {
-      dsprintf("Please enter the name of the commands file: ");
-      fgets(strFileName, MAX_PATH, stdin);
-      strFileName[strlen(strFileName) - 1] = '\0';  // remove newline character
+      WORKLOAD_MIX mix;
+      if(getWorkloadMix(argc, argv, &mix))
+         generateWorkload(argv[n + 1], strtoul(argv[n + 2], NULL, 10),
+                          n + 3 < argc && isdigit((unsigned char)argv[n + 3][0]) ? strtoull(argv[n + 3], NULL, 10) : 1,
+                          &mix);
+      return EXIT_SUCCESS;
+   }
+   if((n = findArg(argc, argv, "-validate")) > 0 && n + 1 < argc)
+   {
+      int numThreads = (int)std::thread::hardware_concurrency();
+      int t = findArg(argc, argv, "-threads");
+      if(t > 0 && t + 1 < argc) numThreads = atoi(argv[t + 1]);
+      validateCommandFile(argv[n + 1], numThreads < 1 ? 1 : numThreads);
+      return EXIT_SUCCESS;
+   }
+   if((n = findArg(argc, argv, "-benchmark")) > 0 && n + 1 < argc)
+   {
+      runBenchmark(argv[n + 1], findArg(argc, argv, "-loopback") > 0, findArg(argc, argv, "-tcp") > 0,
+                   findArg(argc, argv, "-blocks") > 0);
+      return EXIT_SUCCESS;
+   }
+   if((n = findArg(argc, argv, "-render")) > 0 && n + 2 < argc)
+   {
+      renderCommandFile(argv[n + 1], argv[n + 2], n + 3 < argc ? atoi(argv[n + 3]) : PREVIEW_DEFAULT_WIDTH);
+      return EXIT_SUCCESS;
+   }
+   if((n = findArg(argc, argv, "-estimate")) > 0 && n + 1 < argc)
+   {
+      int m = findArg(argc, argv, "-model");
+      estimateCommandFile(argv[n + 1], m > 0 && m + 1 < argc ? argv[m + 1] : ESTIMATE_MODEL_FILE);
+      return EXIT_SUCCESS;
+   }
+   if((n = findArg(argc, argv, "-calibrate")) > 0 && n + 1 < argc)
+   {
+      int m = findArg(argc, argv, "-model");
+      calibrateEstimator(argc, argv, n, m > 0 && m + 1 < argc ? argv[m + 1] : ESTIMATE_MODEL_FILE);
+      return EXIT_SUCCESS;
+   }
+   if((n = findArg(argc, argv, "-replay")) > 0 && n + 1 < argc)
+   {
+      replayTrace(argv[n + 1], getPortArg(argc, argv, n + 1, PORT), findArg(argc, argv, "-fast") > 0,
+                  findArg(argc, argv, "-ack") > 0);
+      return EXIT_SUCCESS;
+   }
+   if((n = findArg(argc, argv, "-jobs")) > 0)
+   {
+      runJobs(argc, argv, n);
+      return EXIT_SUCCESS;
+   }
 
-      err = fopen_s(&fi, strFileName, "r");
-      if(err == 0 && fi != NULL) break;
+   // open connection with robot
+   S = createSession();
+   setSessionBlocks(S, findArg(argc, argv, "-blocks") > 0);
+   if(!S->robot.Initialize())
+   {
+      destroySession(S);
+      return 0;
+   }
 
-      dsprintf("Failed to open %s!\nError code = %d", strFileName, err);
-      if(err == ENOENT)
-         dsprintf(" (File not found!  Check name/path)\n");
-      else if(err == EACCES)
-         dsprintf(" (Permission Denied! Is the file opened in another program?)\n");
+   if((n = findArg(argc, argv, "-record")) > 0 && n + 1 < argc)
+   {
+      if(S->recorder.Open(argv[n + 1]))
+         S->robot.SetRecorder(&S->recorder);
       else
-         dsprintf("\n");
+         printf("Cannot open trace file %s\n", argv[n + 1]);
    }
-   numChars = dsprintf("Processing %s\n", strFileName);
-   printHLine(numChars - 1);
 
-   // get each line from the input file and process the command
-   nLine = 0;
-   while(fgets(strLine, MAX_LINE_SIZE, fi) != NULL)
-   {
-      if(strstr(strLine, "\n") == NULL) strcat_s(strLine, MAX_LINE_SIZE, "\n"); // needed for last line
+   if((n = findArg(argc, argv, "-gateway")) > 0)
+      processGatewayCommands(S, getPortArg(argc, argv, n, GATEWAY_PORT));
+   else if((n = findArg(argc, argv, "-resume")) > 0)
+      resumeCommandFile(S, n + 1 < argc && argv[n + 1][0] != '-' ? argv[n + 1] : CHECKPOINT_FILE);
+   else
+      processFileCommands(S);
 
-      nLine++;
-      dsprintf("Line %02d: %s", nLine, strLine);  // echo the line
+   if(S->recorder.GetNumRecords() > 0) printf("\n%lu trace records written\n", S->recorder.GetNumRecords());
+   S->robot.SetRecorder(NULL);
+   S->recorder.Close();
 
-      //--- get the command index and process it 
-      makeStringUpperCase(strLine);  // make line string all upper case (makes commands case-insensitive)
+   dsprintf(S, "\n\nPress ENTER to end the program...\n");
+   waitForEnterKey();
+   destroySession(S);
+   return EXIT_SUCCESS;
+}
+#endif
 
-      //**** YOUR CODE FOR getCommandIndex and processCommand GOES HERE ****
-      commandIndex = getCommandIndex(strLine);
-      if(commandIndex != COMMAND_INDEX_NOT_FOUND)
-      {
-         processCommand(commandIndex, strLine, TM);
-      }
-      else
-      {
-         printf("Command not found\n");
-      }
-     
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  creates a robot job.  The robot must be in its home position and the first arm model is selected.
+// ARGUMENTS:    none
+// RETURN VALUE: the session.  Free with destroySession.
+SESSION *createSession()
+{
+   SESSION *S = new SESSION;   // the robot connection and trace recorder are constructed
+   CJobEstimator estimator;    // default simulator timing, replaced by the model file if there is one
 
-   }
-   fclose(fi);
-   fclose(flog);
+   S->flog = NULL;
+   S->bQuiet = false;
+   S->bConsole = true;
+   S->armModel = &SCARA_MODELS[0];
+   memset(&S->pathCache, 0, sizeof(S->pathCache));
+   S->pathTolerance = 0.0;
+   S->bezierSpacing = BEZIER_SPACING_PARAMETER;
+   S->numPointsDrawn = 0;
+   S->currentAngles.theta1Deg = 0.0;
+   S->currentAngles.theta2Deg = 0.0;
+   S->motorSpeed.currentSpeed = -1;
+   S->motorSpeed.bAuto = false;
+   S->motorSpeed.tolerance = 0.0;  // set by MOTOR_SPEED AUTO
+   memset(S->motorSpeed.errorPerDeg, 0, sizeof(S->motorSpeed.errorPerDeg));
+   estimator.LoadModel(ESTIMATE_MODEL_FILE);
+   S->timing = *estimator.GetModel();
+   S->preview = NULL;
+   S->pen.penColor.r = S->pen.penColor.g = 0;  // the simulator starts with a blue pen down
+   S->pen.penColor.b = 255;
+   S->pen.penPos = PEN_DOWN;
+   S->pen.bCycleColors = false;
+   strcpy_s(S->strHost, MAX_HOST_SIZE, IPV4_STRING);
+   S->port = PORT;
+   S->checkpoints.strFileName[0] = '\0';
+   S->checkpoints.strCommandFile[0] = '\0';
+   S->checkpoints.first = S->checkpoints.numPending = 0;
+   S->checkpoints.tSavedUs = 0;
+   return S;
 }
 
 //---------------------------------------------------------------------------------------------------------------------
-// DESCRIPTION:  processes a command referenced by the commandIndex.  Parses the command string from the file and 
-//               packages up the command to be sent to the robot if no errors found.  
-// ARGUMENTS:    commandIndex:  index of the command keyword string
-//               strCommandLine: command line from the file in the form of a string
-//               TM the one and only transformation matrix
+// DESCRIPTION:  frees a robot job.  Closes its robot connection, trace and log file.
+// ARGUMENTS:    S:  the session (may be NULL)
 // RETURN VALUE: none
-void processCommand(int commandIndex, char *strCommandLine, double TM[3][3])
+void destroySession(SESSION *S)
 {
-   bool bSuccess = true;
-   JOINT_ANGLES homeAngles = {0.0, 0.0};
-
-   switch(commandIndex)
-   {
-      case PEN_UP:
-         robot.Send("PEN_UP\n");
-         break;
-      case PEN_DOWN:
-         robot.Send("PEN_DOWN\n");
-         break;
-      case CLEAR_TRACE:
-         robot.Send("CLEAR_TRACE\n");
-         break;
-      case CLEAR_REMOTE_COMMAND_LOG:
-         robot.Send("CLEAR_REMOTE_COMMAND_LOG\n");
-         break;
-      case CLEAR_POSITION_LOG:
-         robot.Send("CLEAR_POSITION_LOG\n");
-         break;
-      case SHUTDOWN_SIMULATION:
-         robot.Send("SHUTDOWN_SIMULATION\n");
-         break;
-      case END:
-         robot.Send("END\n");
-         break;
-      case HOME:
-         robot.Send("HOME\n");
-         robotAngles(&homeAngles, UPDATE_CURRENT_ANGLES);
-         break;
-      case PEN_COLOR:
-         bSuccess = setPenColor(strCommandLine);
-         break;
-      case CYCLE_PEN_COLORS:
-         bSuccess = setCyclePenColors(strCommandLine);
-         break;
-      case ROTATE_JOINT:
-         //*** ADD CODE ***
-         break;
-      case MOVE_TO:
-         //*** ADD CODE ***
-         break;
-      case MOTOR_SPEED:
-         //*** ADD CODE ***
-         break;
-      case LINE:
-         //*** ADD CODE ***
-         break;
-      case ARC:
-         //*** ADD CODE ***
-         break;
-      case TRIANGLE:
-         //*** ADD CODE ***
-         break;
-      case RECTANGLE:
-         //*** ADD CODE ***
-         break;
-      case QUADRATIC_BEZIER:
-         //*** ADD CODE ***
-         break;
-      case ROTATE:
-         //*** ADD CODE ***
-         break;
-      case TRANSLATE:
-         //*** ADD CODE ***
-         break;
-      case SCALE:
-         //*** ADD CODE ***
-         break;
-      case RESET_TRANSFORM_MATRIX:
-         resetTransformMatrix(TM);  // all done :)
-         break;
-      default:
-         dsprintf("unknown command!\n");
-   }
+   if(S == NULL) return;
 
-   if(bSuccess) dsprintf("Command sent to robot!\n\n");
+   S->bQuiet = true;   // the path cache statistics were reported when the job's file was done
+   pathCacheClear(S);
+   S->robot.SetRecorder(NULL);
+   S->recorder.Close();
+   S->robot.Close();
+   if(S->flog != NULL) fclose(S->flog);
+   delete S;
 }
 
 //---------------------------------------------------------------------------------------------------------------------
-// DESCRIPTION:  Calculates the length of a quadratic Bezier Curve
-// ARGUMENTS:    P0: coordinates of start of curve.
-//               P2: coordinates of end of curve
-//               P1: control point coordinates
-// RETURN VALUE: length of the quadratic Bezier Curve
-double getQuadraticBezierArcLength(TOOL_POSITION P0, TOOL_POSITION P1, TOOL_POSITION P2)
+// DESCRIPTION:  chooses where the output of a job goes
+// ARGUMENTS:    S:  the session
+//               bConsole:  true to print to the console, false to only write the log file (concurrent jobs)
+//               bQuiet:  true to turn all output off
+// RETURN VALUE: none
+void setSessionOutput(SESSION *S, bool bConsole, bool bQuiet)
 {
-   double xn, yn, xnm1, ynm1;  // points along the curve
-   double t, len = 0;          // t = bezier parameter, len = length of bezier curve
-   size_t n;                   // point index
-   const size_t NP = 1000;     // number of points.
+   S->bConsole = bConsole;
+   S->bQuiet = bQuiet;
+}
 
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  chooses whether a job offers the simulator trajectory blocks when it connects (see trajblock.h)
+// ARGUMENTS:    S:  the session
+//               bOffer:  true to send joint paths as trajectory blocks if the simulator takes them
+// RETURN VALUE: none
+void setSessionBlocks(SESSION *S, bool bOffer)
+{
+   S->robot.SetTrajectoryBlocks(bOffer);
+}
 
-   // subdivide the curve into a number of point-to-point straight line segments.
-   // compute the length of each segment and add them up
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  connects a job to a simulator (through shared memory if it runs on this host)
+// ARGUMENTS:    S:  the session
+//               host:  simulator host name or address
+//               port:  simulator port
+// RETURN VALUE: true if connected
+bool connectSession(SESSION *S, const char *host, int port)
+{
+   strcpy_s(S->strHost, MAX_HOST_SIZE, host);
+   S->port = port;
+   return S->robot.Open(host, port) != 0;
+}
 
-   // starting point
-   xnm1 = P0.x;
-   ynm1 = P0.y;
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  processes a commands file for a connected job (see runCommandFile)
+// ARGUMENTS:    S:  the session
+//               strFileName:  commands file
+// RETURN VALUE: number of lines processed, 0 if the file cannot be opened
+unsigned long runSessionFile(SESSION *S, const char *strFileName)
+{
+   FILE *fi = NULL;                             // input file handle
+   unsigned long numLines;                      // lines processed
+   int numChars;                                // used to draw dividing line
 
-   for(n = 1; n < NP; n++)
+   if(fopen_s(&fi, strFileName, "r") != 0 || fi == NULL)
    {
-      t = (double)n / (double)(NP - 1);
-      xn = (1.0 - t) * (1.0 - t) * P0.x + 2.0 * (1.0 - t) * t * P1.x + t * t * P2.x;
-      yn = (1.0 - t) * (1.0 - t) * P0.y + 2.0 * (1.0 - t) * t * P1.y + t * t * P2.y;
-      len += sqrt(pow(xn - xnm1, 2) + pow(yn - ynm1, 2));
-      xnm1 = xn;
-      ynm1 = yn;
+      dsprintf(S, "Failed to open %s!\n", strFileName);
+      return 0;
    }
+   numChars = dsprintf(S, "Processing %s\n", strFileName);
+   printHLine(S, numChars - 1);
+
+   strcpy_s(S->checkpoints.strCommandFile, MAX_PATH, strFileName);
+   numLines = runCommandFile(S, fi, NULL);
 
-   return len;
+   pathCacheClear(S);
+   fclose(fi);
+   return numLines;
 }
 
 //---------------------------------------------------------------------------------------------------------------------
-// Tranforms the tool position coordinates based on the current tranformation matrix.
-// INPUTS:  TM: the 3x3 transform matrix
-// RETURN:  tranformed tool position
-TOOL_POSITION transform(const double TM[][3], TOOL_POSITION tp)
+// DESCRIPTION:  gets the number of commands a job has sent to its robot
+// ARGUMENTS:    S:  the session
+// RETURN VALUE: number of commands
+unsigned long getSessionSends(SESSION *S)
 {
-   TOOL_POSITION tpt;  // transformed tool position
+   return S->robot.GetNumSends();
+}
 
-   // matrix multiply transformation
-   tpt.x = tp.x * TM[0][0] + tp.y * TM[0][1] + TM[0][2];
-   tpt.y = tp.x * TM[1][0] + tp.y * TM[1][1] + TM[1][2];
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  predicts how long the simulator will take to carry out a commands file, for scheduling jobs across
+//               arms.  The file is processed as it would be for the robot, with nothing sent (see estimator.h).
+// ARGUMENTS:    strFileName:  commands file
+//               strModelFile:  estimator model file (see calibrateEstimator).  NULL or missing:  the default model
+// RETURN VALUE: predicted time in seconds, -1 if the commands file cannot be opened
+double estimateJobSeconds(const char *strFileName, const char *strModelFile)
+{
+   CJobEstimator estimator;                     // the prediction
+   unsigned long numLines;                      // lines processed
 
-   return tpt;
+   if(strModelFile != NULL) estimator.LoadModel(strModelFile);
+   if(!estimateFile(strFileName, &estimator, &numLines)) return -1.0;
+   return estimator.GetTotalSec();
 }
 
 //---------------------------------------------------------------------------------------------------------------------
-// Resets the tranform matrix to the unit matrix.  x, y points will no longer be transformed in inverseKinematics
-// INPUTS:  the 3x3 transform matrix
-// RETURN:  nothing
-void resetTransformMatrix(double TM[][3])  // resets to unit matrix
+// DESCRIPTION:  processes several commands files at the same time, each one by its own session on its own thread
+//               and sent to the simulator listening on its port.  The output of every job goes to log_port.txt.
+// ARGUMENTS:    argc, argv:  command line
+//               n:  index of -jobs (port file pairs follow)
+// RETURN VALUE: none
+void runJobs(int argc, char *argv[], int n)
 {
-   int r, c;  // matrix row, column indexes
+   JOB *jobs;                                   // the jobs
+   std::thread *threads;                        // one thread per job
+   int numJobs = 0, j;                          // number of jobs, job index
+   unsigned long long tStartUs;                 // start time
 
-   for(r = 0; r < 3; r++)
+   jobs = new JOB[argc / 2 + 1];
+   for(n++; n + 1 < argc && isdigit((unsigned char)argv[n][0]); n += 2)
    {
-      for(c = 0; c < 3; c++)
-      {
-         TM[r][c] = (r == c ? 1.0 : 0.0);
-      }
+      jobs[numJobs].port = atoi(argv[n]);
+      jobs[numJobs].strFileName = argv[n + 1];
+      sprintf_s(jobs[numJobs].strLogFile, MAX_PATH, "log_%d.txt", jobs[numJobs].port);
+      jobs[numJobs].bBlocks = findArg(argc, argv, "-blocks") > 0;
+      numJobs++;
+   }
+   if(numJobs == 0)
+   {
+      printf("-jobs needs a port and a commands file for every job\n");
+      delete[] jobs;
+      return;
+   }
+
+   printf("Running %d jobs\n", numJobs);
+   tStartUs = TraceClockUs();
+   threads = new std::thread[numJobs];
+   for(j = 0; j < numJobs; j++) threads[j] = std::thread(runJob, &jobs[j]);
+   for(j = 0; j < numJobs; j++) threads[j].join();
+   delete[] threads;
+
+   for(j = 0; j < numJobs; j++)
+   {
+      if(jobs[j].bOk)
+         printf("Job %d (port %d, %s): %lu lines, %lu commands in %.3f s\n", j + 1, jobs[j].port,
+                jobs[j].strFileName, jobs[j].numLines, jobs[j].numSends, jobs[j].elapsedSec);
+      else
+         printf("Job %d (port %d, %s): failed (see %s)\n", j + 1, jobs[j].port, jobs[j].strFileName,
+                jobs[j].strLogFile);
    }
+   printf("%d jobs in %.3f s\n", numJobs, (TraceClockUs() - tStartUs) / 1.0e6);
+   delete[] jobs;
 }
 
 //---------------------------------------------------------------------------------------------------------------------
-// Premultiplies the transform matrix by matrix M.  M is the rotation matrix, translation matrix, or the scaling matrix
-// INPUTS:  TM: the 3x3 transform matrix, M the premultiplier matrix
-// RETURN:  nothing
-void transformMatrixMultiply(double TM[][3], const double M[][3])
+// DESCRIPTION:  runs one job of runJobs (thread function)
+// ARGUMENTS:    job:  the job (results written back)
+// RETURN VALUE: none
+void runJob(JOB *job)
 {
-   int r, c, cc;     // row, column indexes
-   double TMM[3][3]; // temp matrix
+   SESSION *S = createSession();                // the job's own robot, transform, arm and log
+   unsigned long long tStartUs = TraceClockUs();// start time
 
-   for(r = 0; r < 3; r++)
+   job->bOk = false;
+   job->numLines = job->numSends = 0;
+   setSessionOutput(S, false, false);
+   setSessionBlocks(S, job->bBlocks);
+   if(openLogFile(S, job->strLogFile))
    {
-      for(c = 0; c < 3; c++)
+      if(connectSession(S, IPV4_STRING, job->port))
       {
-         TMM[r][c] = 0.0;  // set element to zero
-
-         for(cc = 0; cc < 3; cc++) // accumulate the multiples
-         {
-            TMM[r][c] += M[r][cc] * TM[cc][c];
-         }
+         job->numLines = runSessionFile(S, job->strFileName);
+         job->numSends = getSessionSends(S);
+         job->bOk = job->numLines > 0;
       }
-   }
-
-   for(r = 0; r < 3; r++)  // copy temp matrix to TM
-   {
-      for(c = 0; c < 3; c++)
+      else
       {
-         TM[r][c] = TMM[r][c];
+         dsprintf(S, "Nothing is listening on port %d\n", job->port);
       }
    }
+   job->elapsedSec = (TraceClockUs() - tStartUs) / 1.0e6;
+   destroySession(S);
 }
 
 //---------------------------------------------------------------------------------------------------------------------
-// DESCRIPTION:  parses a command string that contains CYCLE_PEN_COLORS and sends command to robot if data ok.
-// ARGUMENTS:    strLine:  A file line string.
-// RETURN VALUE: true if command sent to robot, false if not.
-bool setCyclePenColors(char *strLine)
+// DESCRIPTION:  finds a command line argument (not case sensitive)
+// ARGUMENTS:    argc, argv:  command line
+//               strName:  argument to find
+// RETURN VALUE: index of the argument in argv or 0 if not found
+int findArg(int argc, char *argv[], const char *strName)
 {
-   char *tok = NULL, *nextTok = NULL;              // for tokenizing the line string
-   char cmd[COMMAND_STRING_ARRAY_SIZE];            // command string for sprintf_s
-
-   tok = strtok_s(strLine, seps, &nextTok); // CYCLE_PEN_COLORS keyword (discarded)
-
-   tok = strtok_s(NULL, seps, &nextTok);  // parameter should be "ON" or "OFF"
-   if(tok == NULL)
+   for(int n = 1; n < argc; n++)
    {
-      dsprintf("Missing CYCLE_PEN_COLORS parameter!\n\n");
-      return false;
+      if(_stricmp(argv[n], strName) == 0) return n;
    }
+   return 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  gets the optional port number that may follow a command line argument
+// ARGUMENTS:    argc, argv:  command line
+//               n:  index of the argument the port may follow
+//               defaultPort:  port to use if no port follows
+// RETURN VALUE: the port
+int getPortArg(int argc, char *argv[], int n, int defaultPort)
+{
+   if(n + 1 < argc && isdigit((unsigned char)argv[n + 1][0])) return atoi(argv[n + 1]);
+   return defaultPort;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  processes robot commands stored in a file and uses them to control the SCARA robot
+// ARGUMENTS:    S:  the session
+// RETURN VALUE: none
+void processFileCommands(SESSION *S)
+{
+   char strFileName[MAX_PATH];                  // stores input file name
+   FILE *fi = NULL;                             // input file handle
+   errno_t err;                                 // stores fopen_s error value
+   int numChars;                                // used to draw dividing line
+
+   if(!openLogFile(S, "log.txt"))
+   {
+      dsprintf(S, "Press ENTER to end program...");
+      waitForEnterKey();
+      exit(0);
+   }
+
+   // get the input file
+   while(true)
+   {
+      dsprintf(S, "Please enter the name of the commands file: ");
+      fgets(strFileName, MAX_PATH, stdin);
+      strFileName[strlen(strFileName) - 1] = '\0';  // remove newline character
+
+      err = fopen_s(&fi, strFileName, "r");
+      if(err == 0 && fi != NULL) break;
+
+      dsprintf(S, "Failed to open %s!\nError code = %d", strFileName, err);
+      if(err == ENOENT)
+         dsprintf(S, " (File not found!  Check name/path)\n");
+      else if(err == EACCES)
+         dsprintf(S, " (Permission Denied! Is the file opened in another program?)\n");
+      else
+         dsprintf(S, "\n");
+   }
+   numChars = dsprintf(S, "Processing %s\n", strFileName);
+   printHLine(S, numChars - 1);
+
+   strcpy_s(S->checkpoints.strFileName, MAX_PATH, CHECKPOINT_FILE);
+   strcpy_s(S->checkpoints.strCommandFile, MAX_PATH, strFileName);
+   runCommandFile(S, fi, NULL);
+
+   pathCacheClear(S);
+   fclose(fi);
+   fclose(S->flog);
+   S->flog = NULL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  processes every line of an open commands file (REPEAT and CALL expanded)
+// ARGUMENTS:    S:  the session
+//               fi:  the commands file
+// RETURN VALUE: number of lines processed
+unsigned long processCommandFile(SESSION *S, FILE *fi)
+{
+   char strLine[MAX_LINE_SIZE];                 // stores one line of the expanded file
+   char strError[MAX_LINE_SIZE];                // REPEAT, DEFINE or CALL problem with the line
+   unsigned long nLine;                         // file line number
+   unsigned long numLines = 0;                  // lines processed
+   TRANSFORM_STACK TS;                          // transform matrix and its pushed levels
+   MACRO_STREAM ms;                             // the file with its macros expanded
+
+   initTransformStack(&TS);
+   initMacroStream(&ms, fi);
+
+   // get each line from the input file and process the command
+   while(getNextLine(&ms, strLine, &nLine, strError, MAX_LINE_SIZE))
+   {
+      processCommandLine(S, strLine, nLine, strError, &TS);
+      numLines++;
+   }
+   freeMacroStream(&ms);
+   return numLines;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  echoes and processes one line of a commands file
+// ARGUMENTS:    S:  the session
+//               strLine:  the line (MAX_LINE_SIZE array, changed)
+//               nLine:  file line number
+//               strError:  REPEAT, DEFINE or CALL problem with the line (see getNextLine).  "" if none
+//               TS:  the transform stack of the file
+// RETURN VALUE: none
+void processCommandLine(SESSION *S, char *strLine, unsigned long nLine, const char *strError, TRANSFORM_STACK *TS)
+{
+   int commandIndex = COMMAND_INDEX_NOT_FOUND;  // command index
+
+   if(strstr(strLine, "\n") == NULL) strcat_s(strLine, MAX_LINE_SIZE, "\n"); // needed for last line
+
+   dsprintf(S, "Line %02lu: %s", nLine, strLine);    // echo the line
+   if(strError[0] != '\0')
+   {
+      dsprintf(S, "%s\n\n", strError);
+      return;
+   }
+
+   //--- get the command index and process it 
+   makeStringUpperCase(strLine);  // make line string all upper case (makes commands case-insensitive)
+
+   //**** YOUR CODE FOR getCommandIndex and processCommand GOES HERE ****
+   commandIndex = getCommandIndex(strLine);
+   if(commandIndex != COMMAND_INDEX_NOT_FOUND)
+   {
+      processCommand(S, commandIndex, strLine, TS);
+   }
+   else
+   {
+      dsprintf(S, "Command not found\n");
+   }
+}
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  starts expanding the REPEAT, DEFINE and CALL lines of a commands file (see getNextLine)
+// ARGUMENTS:    ms:  the macro stream
+//               fi:  the commands file
+// RETURN VALUE: none
+void initMacroStream(MACRO_STREAM *ms, FILE *fi)
+{
+   memset(ms, 0, sizeof(MACRO_STREAM));
+   ms->fi = fi;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  frees the macros and REPEAT body of a macro stream.  The file is not closed.
+// ARGUMENTS:    ms:  the macro stream
+// RETURN VALUE: none
+void freeMacroStream(MACRO_STREAM *ms)
+{
+   int n;  // macro index
+
+   for(n = 0; n < ms->numMacros; n++) freeMacroBody(&ms->macros[n]);
+   free(ms->macros);
+   freeMacroBody(&ms->repeat);
+   ms->macros = NULL;
+   ms->numMacros = ms->capacity = ms->depth = 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  gets the next line to process from a commands file.  REPEAT n ... END_REPEAT and DEFINE name ...
+//               END_DEFINE are read into bodies the first time; REPEAT and CALL name then hand out the lines of the
+//               body one at a time, so nothing is unrolled.  REPEATs nest and macros may CALL other macros (not
+//               themselves) up to MAX_MACRO_DEPTH levels.  A DEFINE cannot be inside a REPEAT or DEFINE.
+// ARGUMENTS:    ms:  the macro stream
+//               strLine:  receives the line (MAX_LINE_SIZE array)
+//               nLine:  receives the file line number of the line
+//               strError:  receives a problem with a REPEAT, DEFINE or CALL line, "" if none.  Such a line is
+//                          handed out with the problem instead of being expanded, and is not to be processed.
+//               errorSize:  size of strError
+// RETURN VALUE: true if a line was read, false at the end of the file
+bool getNextLine(MACRO_STREAM *ms, char *strLine, unsigned long *nLine, char *strError, size_t errorSize)
+{
+   char strUpper[MAX_LINE_SIZE];                // upper case copy of the line (to find the command)
+   char strName[MAX_MACRO_NAME_SIZE];           // DEFINE or CALL name
+   MACRO_FRAME *f;                              // level being expanded
+   const MACRO_LINE *ml;                        // line of a body
+   const MACRO_BODY *macro;                     // macro CALLed
+   MACRO_BODY body;                             // body of a DEFINE
+   ARG_VALUE args[NUM_ARGS(REPEAT_ARGS)];       // REPEAT count
+   ARG_ERROR err;                               // parser error
+   int commandIndex;                            // command index
+   bool bOk;                                    // true if the count or name is ok
+
+   strError[0] = '\0';
+   while(true)
+   {
+      if(ms->depth > 0)
+      {
+         // hand out the next line of the level being expanded
+         f = &ms->frames[ms->depth - 1];
+         if(f->pos == f->end)
+         {
+            if(f->remaining > 0)
+            {
+               f->remaining--;
+               f->pos = f->first;
+            }
+            else
+            {
+               ms->depth--;
+            }
+            continue;
+         }
+         ml = &f->body->lines[f->pos++];
+         strcpy_s(strLine, MAX_LINE_SIZE, ml->strLine);
+         *nLine = ml->nLine;
+         commandIndex = ml->commandIndex;
+         if(commandIndex == REPEAT)
+         {
+            f->pos = ml->match + 1;  // the nested level repeats the lines up to the matching END_REPEAT
+            if(pushMacroFrame(ms, f->body, (size_t)(ml - f->body->lines) + 1, ml->match, ml->count)) continue;
+            sprintf_s(strError, errorSize, "REPEAT nested more than %d levels deep", MAX_MACRO_DEPTH);
+            return true;
+         }
+         if(commandIndex != CALL) return true;
+      }
+      else
+      {
+         // read the file
+         if(fgets(strLine, MAX_LINE_SIZE, ms->fi) == NULL) return false;
+         *nLine = ++ms->nLine;
+         strcpy_s(strUpper, MAX_LINE_SIZE, strLine);
+         makeStringUpperCase(strUpper);
+         commandIndex = getCommandIndex(strUpper);
+
+         if(commandIndex == REPEAT)
+         {
+            bOk = parseArguments(strUpper, seps, REPEAT_ARGS, NUM_ARGS(REPEAT_ARGS), args, &err);
+            freeMacroBody(&ms->repeat);
+            if(!readMacroBody(ms, &ms->repeat, END_REPEAT, strError, errorSize)) return true;
+            if(!bOk)
+            {
+               formatArgError(strError, errorSize, "REPEAT", REPEAT_ARGS, NUM_ARGS(REPEAT_ARGS), &err);
+               return true;
+            }
+            pushMacroFrame(ms, &ms->repeat, 0, ms->repeat.numLines, args[0].i);
+            continue;
+         }
+         if(commandIndex == DEFINE)
+         {
+            memset(&body, 0, sizeof(MACRO_BODY));
+            bOk = getMacroName(strUpper, body.name);
+            if(readMacroBody(ms, &body, END_DEFINE, strError, errorSize))
+            {
+               if(!bOk)
+                  sprintf_s(strError, errorSize, "DEFINE needs one name of at most %d characters",
+                            MAX_MACRO_NAME_SIZE - 1);
+               else if(!defineMacro(ms, &body))
+                  sprintf_s(strError, errorSize, "Out of memory!");
+            }
+            if(strError[0] == '\0') continue;
+            freeMacroBody(&body);
+            return true;
+         }
+         if(commandIndex == END_REPEAT || commandIndex == END_DEFINE)
+         {
+            sprintf_s(strError, errorSize, "%s without %s", m_Commands[commandIndex].strCommand,
+                      commandIndex == END_REPEAT ? "REPEAT" : "DEFINE");
+            return true;
+         }
+         if(commandIndex != CALL) return true;
+      }
+
+      // CALL name:  expand the macro
+      strcpy_s(strUpper, MAX_LINE_SIZE, strLine);
+      makeStringUpperCase(strUpper);
+      if(!getMacroName(strUpper, strName))
+      {
+         sprintf_s(strError, errorSize, "CALL needs one macro name");
+         return true;
+      }
+      if((macro = findMacro(ms, strName)) == NULL)
+      {
+         sprintf_s(strError, errorSize, "CALL of unknown macro %s", strName);
+         return true;
+      }
+      if(!pushMacroFrame(ms, macro, 0, macro->numLines, 1))
+      {
+         sprintf_s(strError, errorSize, "CALL nested more than %d levels deep (does %s CALL itself?)",
+                   MAX_MACRO_DEPTH, strName);
+         return true;
+      }
+   }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  reads the lines of a REPEAT or DEFINE from the file up to its END_REPEAT or END_DEFINE and stores
+//               them in a body.  The END_REPEAT of every REPEAT inside the body is found so it can be expanded later
+//               without reading the lines again.
+// ARGUMENTS:    ms:  the macro stream (the REPEAT or DEFINE line was just read)
+//               body:  receives the lines (empty)
+//               endIndex:  END_REPEAT or END_DEFINE
+//               strError:  receives the first problem found in the body
+//               errorSize:  size of strError
+// RETURN VALUE: true if ok, false if there was a problem (the rest of the body is still read)
+bool readMacroBody(MACRO_STREAM *ms, MACRO_BODY *body, int endIndex, char *strError, size_t errorSize)
+{
+   char strLine[MAX_LINE_SIZE];                 // stores one line out of input file
+   char strUpper[MAX_LINE_SIZE];                // upper case copy of the line (to find the command)
+   size_t open[MAX_MACRO_DEPTH];                // body index of every REPEAT without its END_REPEAT yet
+   int numOpen = 0;                             // number of open REPEATs
+   unsigned long nStart = ms->nLine;            // line of the REPEAT or DEFINE
+   ARG_VALUE args[NUM_ARGS(REPEAT_ARGS)];       // REPEAT count
+   ARG_ERROR err;                               // parser error
+   int commandIndex;                            // command index
+   char strArgError[MAX_LINE_SIZE];             // REPEAT count error message
+
+   strError[0] = '\0';
+   while(fgets(strLine, MAX_LINE_SIZE, ms->fi) != NULL)
+   {
+      ms->nLine++;
+      strcpy_s(strUpper, MAX_LINE_SIZE, strLine);
+      makeStringUpperCase(strUpper);
+      if(strUpper[strspn(strUpper, seps)] == '\0') continue;  // blank lines are not kept
+      commandIndex = getCommandIndex(strUpper);
+
+      if(commandIndex == endIndex && (endIndex == END_DEFINE || numOpen == 0))
+      {
+         if(numOpen > 0 && strError[0] == '\0')
+            sprintf_s(strError, errorSize, "REPEAT at line %lu without END_REPEAT", body->lines[open[0]].nLine);
+         return strError[0] == '\0';
+      }
+
+      if(!storeMacroLine(body, strLine, ms->nLine, commandIndex))
+      {
+         if(strError[0] == '\0') sprintf_s(strError, errorSize, "Out of memory at line %lu!", ms->nLine);
+         continue;
+      }
+      switch(commandIndex)
+      {
+         case REPEAT:
+            if(!parseArguments(strUpper, seps, REPEAT_ARGS, NUM_ARGS(REPEAT_ARGS), args, &err))
+            {
+               formatArgError(strArgError, MAX_LINE_SIZE, "REPEAT", REPEAT_ARGS, NUM_ARGS(REPEAT_ARGS), &err);
+               if(strError[0] == '\0') sprintf_s(strError, errorSize, "line %lu: %s", ms->nLine, strArgError);
+            }
+            else
+            {
+               body->lines[body->numLines - 1].count = args[0].i;
+            }
+            if(numOpen < MAX_MACRO_DEPTH)
+               open[numOpen++] = body->numLines - 1;
+            else if(strError[0] == '\0')
+               sprintf_s(strError, errorSize, "line %lu: REPEAT nested more than %d levels deep", ms->nLine,
+                         MAX_MACRO_DEPTH);
+            break;
+         case END_REPEAT:
+            if(numOpen > 0)
+               body->lines[open[--numOpen]].match = body->numLines - 1;
+            else if(strError[0] == '\0')
+               sprintf_s(strError, errorSize, "line %lu: END_REPEAT without REPEAT", ms->nLine);
+            break;
+         case DEFINE:
+         case END_DEFINE:
+            if(strError[0] == '\0')
+               sprintf_s(strError, errorSize, "line %lu: %s inside %s", ms->nLine, m_Commands[commandIndex].strCommand,
+                         endIndex == END_REPEAT ? "REPEAT" : "DEFINE");
+            break;
+      }
+   }
+
+   if(strError[0] == '\0')
+      sprintf_s(strError, errorSize, "%s at line %lu without %s", endIndex == END_REPEAT ? "REPEAT" : "DEFINE", nStart,
+                m_Commands[endIndex].strCommand);
+   return false;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  adds a copy of a line to a body
+// ARGUMENTS:    body:  the body
+//               strLine:  the line as read
+//               nLine:  file line number
+//               commandIndex:  command index of the line
+// RETURN VALUE: true if ok, false if out of memory
+bool storeMacroLine(MACRO_BODY *body, const char *strLine, unsigned long nLine, int commandIndex)
+{
+   MACRO_LINE *lines;      // bigger array of lines
+   MACRO_LINE *ml;         // the new line
+
+   if(body->numLines == body->capacity)
+   {
+      lines = (MACRO_LINE *)realloc(body->lines, (body->capacity == 0 ? 16 : 2 * body->capacity) * sizeof(MACRO_LINE));
+      if(lines == NULL) return false;
+      body->lines = lines;
+      body->capacity = body->capacity == 0 ? 16 : 2 * body->capacity;
+   }
+   ml = &body->lines[body->numLines];
+   ml->strLine = _strdup(strLine);
+   if(ml->strLine == NULL) return false;
+   ml->nLine = nLine;
+   ml->commandIndex = commandIndex;
+   ml->count = 0;
+   ml->match = body->numLines;
+   body->numLines++;
+   return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  frees the lines of a body.  The body is left empty.
+// ARGUMENTS:    body:  the body
+// RETURN VALUE: none
+void freeMacroBody(MACRO_BODY *body)
+{
+   size_t n;  // line index
+
+   for(n = 0; n < body->numLines; n++) free(body->lines[n].strLine);
+   free(body->lines);
+   body->lines = NULL;
+   body->numLines = body->capacity = 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  starts expanding lines of a body count times
+// ARGUMENTS:    ms:  the macro stream
+//               body:  the body
+//               first, end:  lines repeated (body->lines[first] to body->lines[end - 1])
+//               count:  number of times
+// RETURN VALUE: true if ok (or nothing to expand), false if MAX_MACRO_DEPTH levels are already being expanded
+bool pushMacroFrame(MACRO_STREAM *ms, const MACRO_BODY *body, size_t first, size_t end, int count)
+{
+   MACRO_FRAME *f;   // the new level
+
+   if(count <= 0 || first == end) return true;
+   if(ms->depth == MAX_MACRO_DEPTH) return false;
+
+   f = &ms->frames[ms->depth++];
+   f->body = body;
+   f->first = f->pos = first;
+   f->end = end;
+   f->remaining = count - 1;
+   return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  gets the name that follows DEFINE or CALL
+// ARGUMENTS:    strLine:  the line (upper case)
+//               strName:  receives the name (MAX_MACRO_NAME_SIZE array)
+// RETURN VALUE: true if there is exactly one name and it is not too long
+bool getMacroName(const char *strLine, char *strName)
+{
+   char strLineCopy[MAX_LINE_SIZE];             // tokenized copy of the line
+   char *tok = NULL, *nextTok = NULL;           // name token, rest of the line
+
+   strcpy_s(strLineCopy, MAX_LINE_SIZE, strLine);
+   strtok_s(strLineCopy, seps, &nextTok);       // DEFINE or CALL
+   tok = strtok_s(NULL, seps, &nextTok);
+   if(tok == NULL || strlen(tok) >= (size_t)MAX_MACRO_NAME_SIZE || strtok_s(NULL, seps, &nextTok) != NULL)
+      return false;
+   strcpy_s(strName, MAX_MACRO_NAME_SIZE, tok);
+   return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  stores a DEFINE in a macro stream.  A macro with the same name is replaced.
+// ARGUMENTS:    ms:  the macro stream (nothing being expanded)
+//               body:  the macro (moved into the stream)
+// RETURN VALUE: true if ok, false if out of memory
+bool defineMacro(MACRO_STREAM *ms, MACRO_BODY *body)
+{
+   MACRO_BODY *macros;     // bigger array of macros
+   int n;                  // macro index
+
+   for(n = 0; n < ms->numMacros; n++)
+   {
+      if(strcmp(ms->macros[n].name, body->name) == 0)
+      {
+         freeMacroBody(&ms->macros[n]);
+         ms->macros[n] = *body;
+         return true;
+      }
+   }
+
+   if(ms->numMacros == ms->capacity)
+   {
+      macros = (MACRO_BODY *)realloc(ms->macros, (ms->capacity == 0 ? 8 : 2 * ms->capacity) * sizeof(MACRO_BODY));
+      if(macros == NULL) return false;
+      ms->macros = macros;
+      ms->capacity = ms->capacity == 0 ? 8 : 2 * ms->capacity;
+   }
+   ms->macros[ms->numMacros++] = *body;
+   return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  finds a DEFINE by name
+// ARGUMENTS:    ms:  the macro stream
+//               strName:  macro name (upper case)
+// RETURN VALUE: the macro, NULL if there is none with that name
+const MACRO_BODY *findMacro(const MACRO_STREAM *ms, const char *strName)
+{
+   int n;  // macro index
+
+   for(n = 0; n < ms->numMacros; n++)
+   {
+      if(strcmp(ms->macros[n].name, strName) == 0) return &ms->macros[n];
+   }
+   return NULL;
+}
+
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  processes a commands file with the parsing, path expansion and inverse kinematics of the next lines
+//               done while the simulator is still busy with the commands already sent.  Two coroutines share this
+//               thread: processCommandsTask queues robot commands (CRobot::SetQueued) and sendCommandsTask writes
+//               them as soon as the simulator is ready for the next one (CRobot::GetReadyTimeUs).
+//               A checkpoint is taken after every line.  If the simulator connection is lost the file is not started
+//               over: the session reconnects, restores the robot from the last checkpoint whose commands had
+//               settled (see CHECKPOINT_SETTLE_MS) and carries on with the next line.  Lines after it are sent again,
+//               so a stroke may be drawn twice but none is left out.
+// ARGUMENTS:    S:  the session
+//               fi:  the commands file
+//               start:  checkpoint to carry on from (-resume).  NULL = start at the first line
+// RETURN VALUE: number of lines processed
+unsigned long runCommandFile(SESSION *S, FILE *fi, const CHECKPOINT *start)
+{
+   unsigned long numLines = 0;   // number of lines processed
+   bool bDone;                   // true when every line is processed
+   bool bFinished = false;       // true when every command is sent
+   TRANSFORM_STACK TS;           // transform matrix and its pushed levels
+   MACRO_STREAM ms;              // the file with its macros expanded
+
+   initTransformStack(&TS);
+   initMacroStream(&ms, fi);
+   S->checkpoints.first = S->checkpoints.numPending = 0;
+   if(start == NULL)
+   {
+      takeCheckpoint(S, &TS, 0, 0);
+      S->checkpoints.last = S->checkpoints.pending[S->checkpoints.first];  // nothing sent yet:  nothing to wait for
+      S->checkpoints.numPending = 0;
+   }
+   else
+   {
+      S->checkpoints.last = *start;
+   }
+
+   S->robot.SetQueued(true);
+   while(!bFinished)
+   {
+      CExecutor executor;        // runs the two coroutines
+
+      try
+      {
+         if(start != NULL) numLines = restoreCheckpoint(S, &ms, &TS);
+         bDone = false;
+         executor.Spawn(processCommandsTask(S, &executor, &ms, &TS, &numLines, &bDone));
+         executor.Spawn(sendCommandsTask(S, &executor, &bDone));
+         executor.Run();
+         bFinished = true;
+      }
+      catch(CSocketException e)
+      {
+         dsprintf(S, "\nSimulator connection lost: %s (error %d).  Carrying on after line %lu.\n",
+                  e.GetMessage(), e.GetCode(), S->checkpoints.last.nLine);
+         if(S->checkpoints.strFileName[0] != '\0') saveCheckpoint(S);
+         if(!reconnectSession(S))
+         {
+            dsprintf(S, "Cannot reconnect to the simulator!\n");
+            if(S->checkpoints.strFileName[0] != '\0')
+               dsprintf(S, "Start the simulator and run with -resume to carry on after line %lu\n",
+                        S->checkpoints.last.nLine);
+            break;
+         }
+         start = &S->checkpoints.last;
+      }
+   }
+   S->robot.SetQueued(false);
+   S->robot.ClearQueue();
+   if(bFinished && S->checkpoints.strFileName[0] != '\0') remove(S->checkpoints.strFileName);
+   freeMacroStream(&ms);
+   return numLines;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  coroutine processing the lines of a commands file.  Gives the thread to the sender after every line
+//               and waits for the simulator when EXECUTOR_MAX_QUEUED_SENDS commands are waiting to be sent.
+// ARGUMENTS:    S:  the session
+//               executor:  the executor running the coroutine
+//               ms:  the commands file with its macros expanded
+//               TS:  the transform matrix and its pushed levels
+//               numLines:  counts the lines processed
+//               bDone:  set to true when every line is processed
+// RETURN VALUE: the coroutine
+CTask processCommandsTask(SESSION *S, CExecutor *executor, MACRO_STREAM *ms, TRANSFORM_STACK *TS,
+                          unsigned long *numLines, bool *bDone)
+{
+   char strLine[MAX_LINE_SIZE];                 // stores one line of the expanded file
+   char strError[MAX_LINE_SIZE];                // REPEAT, DEFINE or CALL problem with the line
+   unsigned long nLine;                         // file line number
+
+   while(getNextLine(ms, strLine, &nLine, strError, MAX_LINE_SIZE))
+   {
+      processCommandLine(S, strLine, nLine, strError, TS);
+      (*numLines)++;
+      takeCheckpoint(S, TS, *numLines, nLine);
+
+      co_await executor->Yield();
+      while(S->robot.GetNumQueued() >= (size_t)EXECUTOR_MAX_QUEUED_SENDS)
+      {
+         co_await executor->WaitUntil(S->robot.GetReadyTimeUs());
+      }
+   }
+   *bDone = true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  coroutine writing the queued robot commands, each one as soon as the simulator is ready for it
+// ARGUMENTS:    S:  the session
+//               executor:  the executor running the coroutine
+//               bDone:  true when no more commands will be queued
+// RETURN VALUE: the coroutine
+CTask sendCommandsTask(SESSION *S, CExecutor *executor, const bool *bDone)
+{
+   while(!*bDone || S->robot.GetNumQueued() > 0)
+   {
+      if(S->robot.GetNumQueued() == 0)
+      {
+         co_await executor->Yield();  // nothing to send until the next line is processed
+      }
+      else
+      {
+         co_await executor->WaitUntil(S->robot.GetReadyTimeUs());
+         S->robot.SendQueued();
+         settleCheckpoints(S);
+      }
+   }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  records the execution state after a line.  The checkpoint waits until the robot commands of the line
+//               (which may still be queued) have been written and have settled.  When CHECKPOINT_PENDING are waiting
+//               the newest one is replaced, since a later checkpoint is as good as an earlier one once it settles.
+// ARGUMENTS:    S:  the session
+//               TS:  the transform matrix and its pushed levels after the line
+//               numLines:  expanded lines done
+//               nLine:  file line number of the line
+// RETURN VALUE: none
+void takeCheckpoint(SESSION *S, const TRANSFORM_STACK *TS, unsigned long numLines, unsigned long nLine)
+{
+   CHECKPOINT_LOG *log = &S->checkpoints; // the checkpoints
+   CHECKPOINT *cp;                         // the new checkpoint
+
+   if(log->numPending == CHECKPOINT_PENDING)
+      cp = &log->pending[(log->first + log->numPending - 1) % CHECKPOINT_PENDING];
+   else
+      cp = &log->pending[(log->first + log->numPending++) % CHECKPOINT_PENDING];
+
+   cp->numLines = numLines;
+   cp->nLine = nLine;
+   cp->numSends = S->robot.GetNumSends() + (unsigned long)S->robot.GetNumQueued();
+   cp->tWrittenUs = 0;
+   cp->TS = *TS;
+   cp->armModel = S->armModel;
+   cp->pathTolerance = S->pathTolerance;
+   cp->bezierSpacing = S->bezierSpacing;
+   robotMotorSpeed(S, &cp->motorSpeed, GET_CURRENT_STATE);
+   robotAngles(S, &cp->angles, GET_CURRENT_ANGLES);
+   cp->pen = S->pen;
+
+   settleCheckpoints(S);  // a line without robot commands has its commands written already
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  notes when the robot commands of every pending checkpoint have all been written, makes the newest one
+//               whose commands were written at least CHECKPOINT_SETTLE_MS ago the last checkpoint, and saves it to
+//               the checkpoint file if CHECKPOINT_SAVE_MS have passed since the last save
+// ARGUMENTS:    S:  the session
+// RETURN VALUE: none
+void settleCheckpoints(SESSION *S)
+{
+   CHECKPOINT_LOG *log = &S->checkpoints; // the checkpoints
+   CHECKPOINT *cp;                         // a pending checkpoint
+   unsigned long long tNowUs = TraceClockUs(); // current time
+   bool bNew = false;                      // true if the last checkpoint changed
+   int n;                                  // pending checkpoint index
+
+   for(n = 0; n < log->numPending; n++)
+   {
+      cp = &log->pending[(log->first + n) % CHECKPOINT_PENDING];
+      if(cp->numSends > S->robot.GetNumSends()) break;  // the later ones are not written either
+      if(cp->tWrittenUs == 0) cp->tWrittenUs = tNowUs;
+   }
+
+   while(log->numPending > 0 && log->pending[log->first].tWrittenUs != 0
+         && tNowUs - log->pending[log->first].tWrittenUs >= CHECKPOINT_SETTLE_MS * 1000ULL)
+   {
+      log->last = log->pending[log->first];
+      log->first = (log->first + 1) % CHECKPOINT_PENDING;
+      log->numPending--;
+      bNew = true;
+   }
+   if(bNew && log->strFileName[0] != '\0' && tNowUs - log->tSavedUs >= CHECKPOINT_SAVE_MS * 1000ULL)
+      saveCheckpoint(S);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  writes the last checkpoint to the checkpoint file.  The file is written under a temporary name and
+//               then renamed, so a crash while saving leaves the previous checkpoint intact.
+//               Format (one item per line):  CHECKPOINT version, FILE commands file, LINES expanded lines and file
+//               line, ARM_MODEL name, PATH_TOLERANCE, BEZIER_SPACING, MOTOR_SPEED speed auto tolerance and the
+//               MEDIUM and HIGH errors, ANGLES,
+//               PEN down r g b cycle, then a TM line (9 values) for every pushed level and the transform matrix.
+// ARGUMENTS:    S:  the session
+// RETURN VALUE: true if saved, false if not
+bool saveCheckpoint(SESSION *S)
+{
+   const CHECKPOINT *cp = &S->checkpoints.last;  // the checkpoint
+   char strTempFile[MAX_PATH + 4];                // file written before the rename
+   TRANSFORM_STACK TS = cp->TS;                   // transform stack with the queued transforms composed
+   FILE *fo = NULL;                               // the temporary file
+   const double (*M)[3];                          // matrix of a level
+   int level, i;                                  // level and element indexes
+
+   composeTransform(&TS);
+   sprintf_s(strTempFile, sizeof(strTempFile), "%s.tmp", S->checkpoints.strFileName);
+   if(fopen_s(&fo, strTempFile, "w") != 0 || fo == NULL) return false;
+
+   fprintf(fo, "CHECKPOINT %d\n", CHECKPOINT_VERSION);
+   fprintf(fo, "FILE %s\n", S->checkpoints.strCommandFile);
+   fprintf(fo, "LINES %lu %lu\n", cp->numLines, cp->nLine);
+   fprintf(fo, "ARM_MODEL %s\n", cp->armModel->name);
+   fprintf(fo, "PATH_TOLERANCE %.17g\n", cp->pathTolerance);
+   fprintf(fo, "BEZIER_SPACING %d\n", cp->bezierSpacing);
+   fprintf(fo, "MOTOR_SPEED %d %d %.17g %.17g %.17g\n", cp->motorSpeed.currentSpeed, cp->motorSpeed.bAuto ? 1 : 0,
+           cp->motorSpeed.tolerance, cp->motorSpeed.errorPerDeg[MOTOR_SPEED_MEDIUM],
+           cp->motorSpeed.errorPerDeg[MOTOR_SPEED_HIGH]);
+   fprintf(fo, "ANGLES %.17g %.17g\n", cp->angles.theta1Deg, cp->angles.theta2Deg);
+   fprintf(fo, "PEN %d %d %d %d %d\n", cp->pen.penPos == PEN_DOWN ? 1 : 0, cp->pen.penColor.r, cp->pen.penColor.g,
+           cp->pen.penColor.b, cp->pen.bCycleColors ? 1 : 0);
+   for(level = 0; level <= TS.depth; level++)
+   {
+      M = level < TS.depth ? TS.saved[level] : TS.TM;
+      fprintf(fo, "TM");
+      for(i = 0; i < 9; i++) fprintf(fo, " %.17g", M[i / 3][i % 3]);
+      fprintf(fo, "\n");
+   }
+   if(fclose(fo) != 0) return false;
+
+   S->checkpoints.tSavedUs = TraceClockUs();
+   return MoveFileExA(strTempFile, S->checkpoints.strFileName, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  reads a checkpoint file written by saveCheckpoint
+// ARGUMENTS:    strFileName:  checkpoint file
+//               cp:  receives the checkpoint
+//               strCommandFile:  receives the commands file name (MAX_PATH characters)
+// RETURN VALUE: true if read, false if the file cannot be opened or is not a checkpoint (reported)
+bool loadCheckpoint(const char *strFileName, CHECKPOINT *cp, char *strCommandFile)
+{
+   char strLine[MAX_LINE_SIZE];     // one line of the file
+   char strName[MAX_LINE_SIZE];     // arm model name
+   FILE *fi = NULL;                 // the checkpoint file
+   int version = 0;                 // CHECKPOINT_VERSION of the file
+   int numItems = 0;                // LINES, ARM_MODEL, PATH_TOLERANCE, BEZIER_SPACING, MOTOR_SPEED, ANGLES, PEN read
+   int numTM = 0;                   // TM lines read
+   int bAuto, bDown, bCycle;        // flags
+   double *m;                       // matrix being read
+   size_t len;                      // line length
+
+   if(fopen_s(&fi, strFileName, "r") != 0 || fi == NULL)
+   {
+      printf("Cannot open checkpoint file %s!\n", strFileName);
+      return false;
+   }
+
+   memset(cp, 0, sizeof(CHECKPOINT));
+   initTransformStack(&cp->TS);
+   strCommandFile[0] = '\0';
+   while(fgets(strLine, MAX_LINE_SIZE, fi) != NULL)
+   {
+      len = strlen(strLine);
+      while(len > 0 && (strLine[len - 1] == '\n' || strLine[len - 1] == '\r')) strLine[--len] = '\0';
+
+      if(sscanf_s(strLine, "CHECKPOINT %d", &version) == 1) continue;
+      if(strncmp(strLine, "FILE ", 5) == 0)
+         strcpy_s(strCommandFile, MAX_PATH, strLine + 5);
+      else if(sscanf_s(strLine, "LINES %lu %lu", &cp->numLines, &cp->nLine) == 2)
+         numItems++;
+      else if(sscanf_s(strLine, "ARM_MODEL %s", strName, (unsigned)MAX_LINE_SIZE) == 1)
+         numItems += (cp->armModel = findScaraModel(strName)) != NULL;
+      else if(sscanf_s(strLine, "PATH_TOLERANCE %lf", &cp->pathTolerance) == 1)
+         numItems++;
+      else if(sscanf_s(strLine, "BEZIER_SPACING %d", &cp->bezierSpacing) == 1)
+         numItems++;
+      else if(sscanf_s(strLine, "MOTOR_SPEED %d %d %lf %lf %lf", &cp->motorSpeed.currentSpeed, &bAuto,
+                       &cp->motorSpeed.tolerance, &cp->motorSpeed.errorPerDeg[MOTOR_SPEED_MEDIUM],
+                       &cp->motorSpeed.errorPerDeg[MOTOR_SPEED_HIGH]) == 5)
+      {
+         cp->motorSpeed.bAuto = bAuto != 0;
+         cp->motorSpeed.errorPerDeg[MOTOR_SPEED_LOW] = 0.0;
+         numItems++;
+      }
+      else if(sscanf_s(strLine, "ANGLES %lf %lf", &cp->angles.theta1Deg, &cp->angles.theta2Deg) == 2)
+         numItems++;
+      else if(sscanf_s(strLine, "PEN %d %d %d %d %d", &bDown, &cp->pen.penColor.r, &cp->pen.penColor.g,
+                       &cp->pen.penColor.b, &bCycle) == 5)
+      {
+         cp->pen.penPos = bDown ? PEN_DOWN : PEN_UP;
+         cp->pen.bCycleColors = bCycle != 0;
+         numItems++;
+      }
+      else if(strncmp(strLine, "TM ", 3) == 0 && numTM <= MAX_TRANSFORM_DEPTH)
+      {
+         if(numTM > 0) memcpy(cp->TS.saved[numTM - 1], cp->TS.TM, sizeof(cp->TS.TM));
+         m = &cp->TS.TM[0][0];
+         if(sscanf_s(strLine, "TM %lf %lf %lf %lf %lf %lf %lf %lf %lf", &m[0], &m[1], &m[2], &m[3], &m[4], &m[5],
+                     &m[6], &m[7], &m[8]) == 9)
+            numTM++;
+      }
+   }
+   fclose(fi);
+
+   if(version != CHECKPOINT_VERSION || numItems != 7 || numTM == 0 || strCommandFile[0] == '\0')
+   {
+      printf("%s is not a checkpoint file (or is damaged)!\n", strFileName);
+      return false;
+   }
+   cp->TS.depth = numTM - 1;
+   return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  carries on from the last checkpoint after the simulator connection was lost (or the program ended).
+//               The controller state is restored, then the robot gets the fewest commands that put it back where it
+//               was:  pen up so the move draws nothing, motor speed, joint angles, pen color cycling, pen color and
+//               pen down if it was down.  The lines already done are read again (DEFINEs are kept) but not
+//               processed, so nothing is drawn twice.  Commands still queued from later lines are dropped; their
+//               lines are processed again.
+// ARGUMENTS:    S:  the session
+//               ms:  the commands file with its macros expanded
+//               TS:  receives the transform matrix and its pushed levels
+// RETURN VALUE: number of lines done
+unsigned long restoreCheckpoint(SESSION *S, MACRO_STREAM *ms, TRANSFORM_STACK *TS)
+{
+   const CHECKPOINT *cp = &S->checkpoints.last;   // the checkpoint
+   char cmd[COMMAND_STRING_ARRAY_SIZE];           // command string
+   CCommandWriter writer(cmd, COMMAND_STRING_ARRAY_SIZE);
+   char strLine[MAX_LINE_SIZE];                   // line skipped
+   char strError[MAX_LINE_SIZE];                  // REPEAT, DEFINE or CALL problem with the line skipped
+   unsigned long nLine;                           // file line number of the line skipped
+   unsigned long n;                               // lines skipped
+   unsigned long numSends;                        // robot commands sent before the restore
+   FILE *fi = ms->fi;                             // the commands file
+   CHECKPOINT restored = *cp;                     // copy (the checkpoints are taken again from here)
+   RGB color = restored.pen.penColor;             // the pen color
+
+   S->robot.ClearQueue();
+   S->checkpoints.first = S->checkpoints.numPending = 0;
+   numSends = S->robot.GetNumSends();
+
+   // controller state
+   *TS = restored.TS;
+   S->armModel = restored.armModel;
+   if(S->preview != NULL) S->preview->SetArmModel(S->armModel);
+   S->pathTolerance = restored.pathTolerance;
+   S->bezierSpacing = restored.bezierSpacing;
+   S->motorSpeed = restored.motorSpeed;
+   S->motorSpeed.currentSpeed = -1;  // what the simulator has is not known
+
+   // robot state
+   sendPenPosition(S, PEN_UP);
+   if(restored.motorSpeed.currentSpeed >= 0) sendMotorSpeed(S, restored.motorSpeed.currentSpeed);
+   sendRotateJoint(S, restored.angles);
+   writer.Begin("CYCLE_PEN_COLORS").Word(strOnOff[restored.pen.bCycleColors ? 0 : 1]).End();
+   S->robot.Send(cmd, writer.GetLength());
+   writer.Begin("PEN_COLOR").Int(color.r).Int(color.g).Int(color.b).End();
+   S->robot.Send(cmd, writer.GetLength());
+   if(restored.pen.penPos == PEN_DOWN) sendPenPosition(S, PEN_DOWN);
+   S->pen = restored.pen;
+
+   // the lines already done
+   freeMacroStream(ms);
+   rewind(fi);
+   initMacroStream(ms, fi);
+   for(n = 0; n < restored.numLines; n++)
+   {
+      if(!getNextLine(ms, strLine, &nLine, strError, MAX_LINE_SIZE)) break;
+   }
+
+   dsprintf(S, "Resuming after line %lu (%lu lines done, robot restored with %lu commands)\n", restored.nLine, n,
+            S->robot.GetNumSends() + (unsigned long)S->robot.GetNumQueued() - numSends);
+   takeCheckpoint(S, TS, n, restored.nLine);
+   return n;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  connects to the simulator again after the connection was lost.  Tries RESUME_ATTEMPTS times,
+//               RESUME_RETRY_MS apart.
+// ARGUMENTS:    S:  the session
+// RETURN VALUE: true if connected, false if not
+bool reconnectSession(SESSION *S)
+{
+   int attempt;  // reconnection number
+
+   for(attempt = 1; attempt <= RESUME_ATTEMPTS; attempt++)
+   {
+      Sleep(RESUME_RETRY_MS);
+      dsprintf(S, "Reconnecting to %s port %d (attempt %d of %d)... ", S->strHost, S->port, attempt,
+               RESUME_ATTEMPTS);
+      S->robot.Close();
+      if(S->robot.Open(S->strHost, S->port) != 0)
+      {
+         dsprintf(S, "connected\n");
+         return true;
+      }
+      dsprintf(S, "\n");  // after the reason printed by CRobot::Connect
+   }
+   return false;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  carries on with the commands file of a checkpoint file (-resume) from its last checkpoint.  The
+//               commands file must not have changed since the checkpoint was saved.
+// ARGUMENTS:    S:  the session (connected)
+//               strCheckpointFile:  checkpoint file
+// RETURN VALUE: none
+void resumeCommandFile(SESSION *S, const char *strCheckpointFile)
+{
+   CHECKPOINT cp;                       // the checkpoint
+   char strCommandFile[MAX_PATH];       // the commands file
+   FILE *fi = NULL;                     // the commands file
+   int numChars;                        // used to draw dividing line
+
+   if(!loadCheckpoint(strCheckpointFile, &cp, strCommandFile)) return;
+   if(!openLogFile(S, "log.txt")) return;
+   if(fopen_s(&fi, strCommandFile, "r") != 0 || fi == NULL)
+   {
+      dsprintf(S, "Failed to open %s!\n", strCommandFile);
+      fclose(S->flog);
+      S->flog = NULL;
+      return;
+   }
+   numChars = dsprintf(S, "Resuming %s after line %lu\n", strCommandFile, cp.nLine);
+   printHLine(S, numChars - 1);
+
+   strcpy_s(S->checkpoints.strFileName, MAX_PATH, strCheckpointFile);
+   strcpy_s(S->checkpoints.strCommandFile, MAX_PATH, strCommandFile);
+   runCommandFile(S, fi, &cp);
+
+   pathCacheClear(S);
+   fclose(fi);
+   fclose(S->flog);
+   S->flog = NULL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  opens the log file of a session (mirrors console output to it if dsprintf used instead of printf)
+// ARGUMENTS:    S:  the session
+//               strFileName:  log file name (log.txt for the console program)
+// RETURN VALUE: true if opened, false if not (reported)
+bool openLogFile(SESSION *S, const char *strFileName)
+{
+   errno_t err;                                 // stores fopen_s error value
+
+   if(S->flog != NULL) fclose(S->flog);
+   err = fopen_s(&S->flog, strFileName, "w");
+   if(err != 0 || S->flog == NULL)
+   {
+      S->flog = NULL;
+      dsprintf(S, "Cannot open %s for writing!  ", strFileName);
+      return false;
+   }
+   return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  processes robot commands streamed by producer programs over TCP (see CCommandGateway).  Lines are
+//               processed as they arrive and every producer gets an OK/ERR status back for each line.
+//               SHUTDOWN_SIMULATION ends the gateway.
+// ARGUMENTS:    S:  the session
+//               port:  TCP port the gateway listens on (this machine only)
+// RETURN VALUE: none
+void processGatewayCommands(SESSION *S, int port)
+{
+   GATEWAY_SESSION session = {0};               // per producer state (set up as producers connect)
+   int numChars;                                // used to draw dividing line
+
+   session.S = S;
+   if(!openLogFile(S, "log.txt"))
+   {
+      dsprintf(S, "Press ENTER to end program...");
+      waitForEnterKey();
+      exit(0);
+   }
+
+   numChars = dsprintf(S, "Gateway listening on port %d\n", port);
+   printHLine(S, numChars - 1);
+
+   try
+   {
+      CCommandGateway gateway(port, GATEWAY_MAX_QUEUED_LINES);
+      gateway.Run(handleGatewayLine, handleGatewayConnect, &session);
+   }
+   catch(CSocketException e)
+   {
+      dsprintf(S, "Gateway failed: %s (error %d)\n", e.GetMessage(), e.GetCode());
+   }
+
+   pathCacheClear(S);
+   fclose(S->flog);
+   S->flog = NULL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  sends the commands recorded in a trace (-record) to a local server and reports the throughput and
+//               send latency.  Used for performance regression runs against the simulator or the stand-in.
+// ARGUMENTS:    strTraceFile:  trace file name
+//               port:  local port to send to (PORT for the simulator, GATEWAY_PORT for the gateway)
+//               bFast:  true to send as fast as possible, false to keep the recorded timing
+//               bWaitReplies:  true if the server replies to every line
+// RETURN VALUE: none
+void replayTrace(const char *strTraceFile, int port, bool bFast, bool bWaitReplies)
+{
+   CTraceReplayer replayer;   // the trace
+   CRobot target;             // connection to the server
+   REPLAY_STATS stats;        // results
+   int numChars;              // used to draw dividing line
+
+   if(!replayer.Open(strTraceFile))
+   {
+      printf("Cannot open trace file %s\n", strTraceFile);
+      return;
+   }
+
+   CWinSock::Initialize();
+   if(target.Connect(IPV4_STRING, port) == 0)
+   {
+      printf("\nNothing is listening on port %d\n", port);
+      CWinSock::Finalize();
+      return;
+   }
+   target.SetPacing(0);  // the trace holds the timing
+
+   numChars = dsprintf(NULL, "Replaying %s to port %d %s\n", strTraceFile, port, bFast ? "as fast as possible"
+                       : "with recorded timing");
+   printHLine(NULL, numChars - 1);
+
+   try
+   {
+      replayer.Run(&target, bFast, bWaitReplies, &stats);
+      dsprintf(NULL, "%lu commands, %lu bytes in %.3f s (recorded %.3f s)\n", stats.numCommands, stats.numBytes,
+               stats.elapsedSec, stats.recordedSec);
+      if(stats.elapsedSec > 0.0)
+         dsprintf(NULL, "Throughput: %.1f commands/s, %.1f KB/s\n", stats.numCommands / stats.elapsedSec,
+                  stats.numBytes / 1024.0 / stats.elapsedSec);
+      dsprintf(NULL, "%s latency (ms): p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n", bWaitReplies ? "Round trip" : "Send",
+               stats.p50Ms, stats.p90Ms, stats.p99Ms, stats.maxMs);
+   }
+   catch(CSocketException e)
+   {
+      dsprintf(NULL, "Replay failed: %s (error %d)\n", e.GetMessage(), e.GetCode());
+   }
+
+   target.Close();
+   CWinSock::Finalize();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  accepts the commands of one controller in place of the SCARA simulator and reports what it got
+// ARGUMENTS:    port:  port to listen on (PORT to stand in for the simulator)
+//               bRealTime:  true to take as long as the simulator would to move the joints
+//               strTraceFile:  trace file of the timing of every line (for calibrateEstimator), NULL for none
+// RETURN VALUE: none
+void runStandInSimulator(int port, bool bRealTime, const char *strTraceFile)
+{
+   STANDIN_STATS stats;       // results
+   CTraceRecorder recorder;   // what the stand-in reads
+   int numChars;              // used to draw dividing line
+
+   numChars = dsprintf(NULL, "Stand-in simulator listening on port %d\n", port);
+   printHLine(NULL, numChars - 1);
+   if(strTraceFile != NULL && !recorder.Open(strTraceFile))
+   {
+      printf("Cannot open trace file %s\n", strTraceFile);
+      return;
+   }
+
+   CWinSock::Initialize();
+   try
+   {
+      CStandInSimulator standIn(port);
+      if(strTraceFile != NULL) standIn.SetRecorder(&recorder);
+      standIn.Run(bRealTime, &stats);
+      dsprintf(NULL, "%lu commands (%lu joint moves), %lu bytes in %.3f s over %s\n", stats.numCommands,
+               stats.numRotations, stats.numBytes, stats.elapsedSec, stats.bSharedMemory ? "shared memory" : "TCP");
+      dsprintf(NULL, "Simulated joint motion time: %.3f s\n", stats.motionSec);
+      if(stats.numBlocks > 0) dsprintf(NULL, "%lu trajectory blocks received\n", stats.numBlocks);
+      if(strTraceFile != NULL)
+         dsprintf(NULL, "%lu trace records written to %s\n", recorder.GetNumRecords(), strTraceFile);
+   }
+   catch(CSocketException e)
+   {
+      dsprintf(NULL, "Stand-in failed: %s (error %d)\n", e.GetMessage(), e.GetCode());
+   }
+   CWinSock::Finalize();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  writes a synthetic commands file.  The same seed and mix always give the same file.
+// ARGUMENTS:    strFileName:  file to write
+//               numLines:  number of command lines
+//               seed:  random number seed
+//               mix:  command mix (see WORKLOAD_MIX)
+// RETURN VALUE: none
+void generateWorkload(const char *strFileName, unsigned long numLines, unsigned long long seed,
+                      const WORKLOAD_MIX *mix)
+{
+   FILE *fo = NULL;                             // output file handle
+
+   if(fopen_s(&fo, strFileName, "w") != 0 || fo == NULL)
+   {
+      printf("Cannot open %s for writing\n", strFileName);
+      return;
+   }
+
+   CWorkloadGenerator generator(seed, mix, SCARA_MODELS[0].LMIN, SCARA_MODELS[0].LMAX);  // default arm model
+   generator.Generate(fo, numLines);
+   fclose(fo);
+   printf("Wrote %lu lines to %s (seed %llu)\n", numLines, strFileName, seed);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  gets the workload mix from the command line options -mix, -depth and -unreachable
+// ARGUMENTS:    argc, argv:  command line
+//               mix:  receives the mix.  Options not given keep their defaults.
+// RETURN VALUE: false if an option is malformed
+bool getWorkloadMix(int argc, char *argv[], WORKLOAD_MIX *mix)
+{
+   int n;   // argument index
+
+   CWorkloadGenerator::GetDefaultMix(mix);
+   if((n = findArg(argc, argv, "-mix")) > 0)
+   {
+      if(n + 1 >= argc || sscanf_s(argv[n + 1], "%d,%d,%d,%d,%d,%d,%d", &mix->line, &mix->arc, &mix->bezier,
+                                   &mix->polygon, &mix->move, &mix->transform, &mix->color) != 7)
+      {
+         printf("-mix needs 7 weights: line,arc,bezier,polygon,move,transform,color\n");
+         return false;
+      }
+   }
+   if((n = findArg(argc, argv, "-depth")) > 0 && n + 1 < argc) mix->maxTransformDepth = atoi(argv[n + 1]);
+   if((n = findArg(argc, argv, "-unreachable")) > 0 && n + 1 < argc) mix->unreachablePercent = atoi(argv[n + 1]);
+   return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  processes a commands file end to end (parse, transform, IK, path planning and command formatting)
+//               without the simulator and reports the throughput.  Console output is turned off while timing.
+// ARGUMENTS:    strFileName:  commands file
+//               bLoopback:  true to send the commands to a stand-in simulator in this process, false to discard them
+//               bTcp:  true to reach the stand-in over TCP instead of its shared memory link
+//               bBlocks:  true to send joint paths to the stand-in as trajectory blocks
+// RETURN VALUE: none
+void runBenchmark(const char *strFileName, bool bLoopback, bool bTcp, bool bBlocks)
+{
+   FILE *fi = NULL;                             // input file handle
+   unsigned long numLines;                      // lines processed
+   unsigned long long tStartUs;                 // start time
+   double elapsedSec;                           // processing time
+   CStandInSimulator *standIn = NULL;           // loopback receiver
+   STANDIN_STATS standInStats;                  // what the loopback receiver got
+   std::thread standInThread;                   // runs the loopback receiver
+   SESSION *S;                                  // the benchmark job
+
+   if(fopen_s(&fi, strFileName, "r") != 0 || fi == NULL)
+   {
+      printf("Cannot open %s\n", strFileName);
+      return;
+   }
+   S = createSession();
+
+   if(bLoopback)
+   {
+      CWinSock::Initialize();
+      standIn = new CStandInSimulator(BENCHMARK_PORT);
+      try
+      {
+         standIn->Listen();
+      }
+      catch(CSocketException e)
+      {
+         printf("Cannot listen on port %d: %s (error %d)\n", BENCHMARK_PORT, e.GetMessage(), e.GetCode());
+         delete standIn;
+         CWinSock::Finalize();
+         destroySession(S);
+         fclose(fi);
+         return;
+      }
+      standInThread = std::thread(runBenchmarkStandIn, standIn, &standInStats);
+      S->robot.SetSharedMemory(!bTcp);
+      S->robot.SetTrajectoryBlocks(bBlocks);
+      S->robot.Connect(IPV4_STRING, BENCHMARK_PORT);
+      S->robot.SetPacing(0);
+   }
+   else
+   {
+      S->robot.SetNullTransport(true);
+   }
+
+   S->bQuiet = true;
+   tStartUs = TraceClockUs();
+   numLines = processCommandFile(S, fi);
+   elapsedSec = (TraceClockUs() - tStartUs) / 1.0e6;
+   pathCacheClear(S);
+   S->bQuiet = false;
+   fclose(fi);
+
+   if(bLoopback)
+   {
+      bBlocks = S->robot.HasTrajectoryBlocks();
+      S->robot.Close();
+      standInThread.join();
+      delete standIn;
+      CWinSock::Finalize();
+   }
+
+   printf("Benchmark %s (%s transport%s)\n", strFileName,
+          !bLoopback ? "null" : standInStats.bSharedMemory ? "shared memory" : "loopback TCP",
+          bLoopback && bBlocks ? ", trajectory blocks" : "");
+   printf("%lu lines, %lu points, %lu commands (%llu bytes) in %.3f s\n", numLines, S->numPointsDrawn,
+          S->robot.GetNumSends(), S->robot.GetNumBytesSent(), elapsedSec);
+   if(elapsedSec > 0.0)
+      printf("%.0f lines/s, %.0f points/s, %.0f commands/s\n", numLines / elapsedSec, S->numPointsDrawn / elapsedSec,
+             S->robot.GetNumSends() / elapsedSec);
+   if(bLoopback)
+      printf("Stand-in received %lu commands (%lu trajectory blocks)\n", standInStats.numCommands,
+             standInStats.numBlocks);
+   destroySession(S);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  runs the loopback stand-in simulator of a benchmark (thread function)
+// ARGUMENTS:    standIn:  the stand-in (already listening)
+//               stats:  receives what it got
+// RETURN VALUE: none
+void runBenchmarkStandIn(CStandInSimulator *standIn, STANDIN_STATS *stats)
+{
+   try
+   {
+      standIn->Run(false, stats);
+   }
+   catch(CSocketException e)
+   {
+      memset(stats, 0, sizeof(STANDIN_STATS));
+   }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  draws a commands file without the simulator.  The file goes through the same processing as when it
+//               is sent to the robot, but the commands are drawn by a preview renderer instead (see preview.h).
+// ARGUMENTS:    strFileName:  commands file
+//               strImageFile:  image file (.svg, .ppm, otherwise PNG)
+//               width:  image width in pixels
+// RETURN VALUE: none
+void renderCommandFile(const char *strFileName, const char *strImageFile, int width)
+{
+   FILE *fi = NULL;                             // input file handle
+   unsigned long numLines;                      // lines processed
+   unsigned long long tStartUs;                 // start time
+   double processSec, saveSec;                  // processing time, image writing time
+   CPreviewRenderer preview;                    // draws what is sent
+   bool bSaved;                                 // true if the image was written
+   SESSION *S;                                  // the render job
+
+   if(fopen_s(&fi, strFileName, "r") != 0 || fi == NULL)
+   {
+      printf("Cannot open %s\n", strFileName);
+      return;
+   }
+   S = createSession();
+   S->preview = &preview;
+   preview.SetArmModel(S->armModel);
+   S->robot.SetNullTransport(true);
+   S->robot.SetPreview(&preview);
+
+   S->bQuiet = true;
+   tStartUs = TraceClockUs();
+   numLines = processCommandFile(S, fi);
+   processSec = (TraceClockUs() - tStartUs) / 1.0e6;
+   pathCacheClear(S);
+   S->bQuiet = false;
+   fclose(fi);
+
+   tStartUs = TraceClockUs();
+   bSaved = preview.Save(strImageFile, width);
+   saveSec = (TraceClockUs() - tStartUs) / 1.0e6;
+
+   if(bSaved)
+      printf("Rendered %s to %s:  %lu lines, %zu strokes, %zu points in %.3f s (%.3f s to write the image)\n",
+             strFileName, strImageFile, numLines, preview.GetNumStrokes(), preview.GetNumPoints(),
+             processSec + saveSec, saveSec);
+   else
+      printf("Cannot write %s\n", strImageFile);
+   S->robot.SetPreview(NULL);
+   destroySession(S);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  runs a commands file through a job duration estimator.  The file goes through the same processing
+//               as when it is sent to the robot, but every send is timed by the estimator instead.
+// ARGUMENTS:    strFileName:  commands file
+//               estimator:  times the sends (its model is used as it is)
+//               numLines:  receives the number of lines processed
+// RETURN VALUE: false if the file cannot be opened
+bool estimateFile(const char *strFileName, CJobEstimator *estimator, unsigned long *numLines)
+{
+   FILE *fi = NULL;                             // input file handle
+   SESSION *S;                                  // the estimate job
+
+   if(fopen_s(&fi, strFileName, "r") != 0 || fi == NULL) return false;
+   S = createSession();
+   S->robot.SetNullTransport(true);
+   S->robot.SetEstimator(estimator);
+   S->timing = *estimator->GetModel();  // the planner weighs the model being estimated with
+   estimator->Reset();
+
+   S->bQuiet = true;
+   *numLines = processCommandFile(S, fi);
+   pathCacheClear(S);
+   S->bQuiet = false;
+   fclose(fi);
+
+   S->robot.SetEstimator(NULL);
+   destroySession(S);
+   return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  predicts how long the simulator will take to carry out a commands file and reports where the time
+//               goes
+// ARGUMENTS:    strFileName:  commands file
+//               strModelFile:  estimator model file.  The default model is used if it cannot be read.
+// RETURN VALUE: none
+void estimateCommandFile(const char *strFileName, const char *strModelFile)
+{
+   CJobEstimator estimator;                     // the prediction
+   const ESTIMATE_MODEL *model;                 // its timing
+   unsigned long numLines;                      // lines processed
+   unsigned long long tStartUs;                 // start time
+   double totalSec;                             // predicted time
+   bool bModel;                                 // true if the model file was read
+
+   bModel = estimator.LoadModel(strModelFile);
+   model = estimator.GetModel();
+   tStartUs = TraceClockUs();
+   if(!estimateFile(strFileName, &estimator, &numLines))
+   {
+      printf("Cannot open %s\n", strFileName);
+      return;
+   }
+   totalSec = estimator.GetTotalSec();
+
+   printf("Estimated %s in %.3f s:  %lu lines, %lu commands in %lu sends\n", strFileName,
+          (TraceClockUs() - tStartUs) / 1.0e6, numLines, estimator.GetNumCommands(), estimator.GetNumSends());
+   printf("Predicted run time:  %.1f s (%d:%02d:%02d)\n", totalSec, (int)(totalSec / 3600.0),
+          (int)fmod(totalSec / 60.0, 60.0), (int)fmod(totalSec, 60.0));
+   printf("Joint motion:  %.1f s (%.0f deg at LOW, %.0f deg at MEDIUM, %.0f deg at HIGH)\n",
+          estimator.GetMotionSec(), estimator.GetJointDeg(0), estimator.GetJointDeg(1), estimator.GetJointDeg(2));
+   if(estimator.GetNumSends() > 0)
+      printf("Sending:  %.1f s (%.3f s pacing)\n", model->pacingSec * (estimator.GetNumSends() - 1), model->pacingSec);
+   printf("Pen changes:  %lu, color changes:  %lu\n", estimator.GetNumPenChanges(), estimator.GetNumColorChanges());
+   printf("Model:  %s\n", bModel ? strModelFile : "default (run -calibrate to fit it)");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  fits the job duration estimator to recorded traces and saves the model.  The model file is read
+//               first, so what the traces cannot show keeps its value.
+// ARGUMENTS:    argc, argv:  command line
+//               n:  index of -calibrate (the trace files follow it)
+//               strModelFile:  estimator model file
+// RETURN VALUE: none
+void calibrateEstimator(int argc, char *argv[], int n, const char *strModelFile)
+{
+   static const char *strParameters[ESTIMATE_NUM_FEATURES] = {"command time", "LOW speed", "MEDIUM speed",
+                                                              "HIGH speed", "pen change time", "color change time"};
+   const char *traceFiles[ESTIMATE_MAX_TRACES]; // the traces
+   CJobEstimator estimator;                     // the model
+   const ESTIMATE_MODEL *model;                 // its timing
+   ESTIMATE_FIT fit;                            // calibration results
+   int numTraces = 0;                           // number of traces
+   int i;                                       // parameter index
+
+   for(n++; n < argc && argv[n][0] != '-' && numTraces < ESTIMATE_MAX_TRACES; n++) traceFiles[numTraces++] = argv[n];
+   estimator.LoadModel(strModelFile);
+   if(!estimator.Calibrate(traceFiles, numTraces, &fit))
+   {
+      if(fit.numTraces < numTraces)
+         printf("Cannot open trace file %s\n", traceFiles[fit.numTraces]);
+      else
+         printf("The traces hold no usable timing (record them with -record or -standin -realtime -record)\n");
+      return;
+   }
+
+   model = estimator.GetModel();
+   printf("Calibrated from %d traces:  %lu busy intervals, %lu send intervals\n", fit.numTraces, fit.numIntervals,
+          fit.numSendIntervals);
+   if(fit.numIntervals > 0)
+      printf("Busy time:  %.3f s measured, %.3f s predicted (RMS error %.2f ms per interval)\n", fit.measuredSec,
+             fit.predictedSec, fit.rmsErrorSec * 1000.0);
+   printf("Joint speed:  %.2f / %.2f / %.2f deg/s (LOW / MEDIUM / HIGH)\n", model->degPerSec[0],
+          model->degPerSec[1], model->degPerSec[2]);
+   printf("Command %.2f ms, pen change %.2f ms, color change %.2f ms, pacing %.1f ms, latency %.2f ms\n",
+          model->commandSec * 1000.0, model->penSec * 1000.0, model->colorSec * 1000.0, model->pacingSec * 1000.0,
+          model->latencySec * 1000.0);
+   for(i = 0; i < ESTIMATE_NUM_FEATURES; i++)
+      if(fit.numIntervals > 0 && !fit.bFitted[i]) printf("Not in the traces (unchanged):  %s\n", strParameters[i]);
+
+   if(estimator.SaveModel(strModelFile))
+      printf("Model saved to %s\n", strModelFile);
+   else
+      printf("Cannot write %s\n", strModelFile);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  dry run of a commands file.  Every line is parsed and the transform matrix and arm model are tracked
+//               as processCommand would, then the reach of every primitive (LINE, ARC, TRIANGLE, RECTANGLE,
+//               QUADRATIC_BEZIER and MOVE_TO) is checked by a pool of threads.  Every problem is reported with its
+//               line number, including a PUSH_TRANSFORM that is never popped.  Nothing is sent to the robot.
+// ARGUMENTS:    strFileName:  commands file
+//               numThreads:  number of checking threads
+// RETURN VALUE: none
+void validateCommandFile(const char *strFileName, int numThreads)
+{
+   char strLine[MAX_LINE_SIZE];                 // stores one line of the expanded file
+   char strError[VALIDATE_MESSAGE_SIZE];        // REPEAT, DEFINE or CALL problem with the line
+   FILE *fi = NULL;                             // input file handle
+   MACRO_STREAM ms;                             // the file with its macros expanded
+   VALIDATE_LINE *lines = NULL, *v;             // lines kept, line being filled in
+   size_t numLines = 0, capacity = 0, n;        // number of lines kept, size of lines, line index
+   unsigned long nLine = 0;                     // file line number
+   unsigned long numPrimitives = 0, numErrors = 0, numWarnings = 0;
+   TRANSFORM_STACK TS;                          // transform matrix and its pushed levels
+   size_t pushLines[MAX_TRANSFORM_DEPTH];       // line kept for the PUSH_TRANSFORM of every pushed level
+   SESSION *S;                                  // dry run job (tracks the arm model, prints nothing)
+   const ARG_SPEC *specs;                       // parameter specifications of a command
+   ARG_ERROR err;                               // parser error
+   JOINT_ANGLES ja;                             // ROTATE_JOINT angles
+   std::atomic<size_t> next(0);                 // next line for the thread pool
+   std::thread *workers;                        // the thread pool
+   unsigned long long tStartUs = TraceClockUs();// start time
+   int t;                                       // thread index
+
+   if(fopen_s(&fi, strFileName, "r") != 0 || fi == NULL)
+   {
+      printf("Cannot open %s\n", strFileName);
+      return;
+   }
+   initTransformStack(&TS);
+   initMacroStream(&ms, fi);
+   S = createSession();
+   S->bQuiet = true;
+
+   // parse every line and track the transform and arm model (quick, so done in order on this thread).  REPEAT and
+   // CALL are expanded, so every copy of a line is checked with the transform it is drawn with.
+   while(getNextLine(&ms, strLine, &nLine, strError, VALIDATE_MESSAGE_SIZE))
+   {
+      if(strLine[strspn(strLine, seps)] == '\0' && strError[0] == '\0') continue;  // blank line
+      makeStringUpperCase(strLine);
+
+      if(numLines == capacity)
+      {
+         capacity = capacity == 0 ? 1024 : 2 * capacity;
+         v = (VALIDATE_LINE *)realloc(lines, capacity * sizeof(VALIDATE_LINE));
+         if(v == NULL)  // no report:  the lines after this one would go unchecked
+         {
+            printf("Out of memory at line %lu, %s not validated!\n", nLine, strFileName);
+            free(lines);
+            freeMacroStream(&ms);
+            fclose(fi);
+            destroySession(S);
+            return;
+         }
+         lines = v;
+      }
+      v = &lines[numLines];
+      v->nLine = nLine;
+      v->commandIndex = getCommandIndex(strLine);
+      v->bCheck = v->bError = v->bWarning = false;
+      strcpy_s(v->strIssue, VALIDATE_MESSAGE_SIZE, strError);
+
+      if(strError[0] != '\0')
+      {
+         v->bError = true;
+         numLines++;
+         continue;
+      }
+      if(v->commandIndex == COMMAND_INDEX_NOT_FOUND)
+      {
+         strLine[strcspn(strLine, seps)] = '\0';
+         sprintf_s(v->strIssue, VALIDATE_MESSAGE_SIZE, "unknown command %s", strLine);
+         v->bError = true;
+         numLines++;
+         continue;
+      }
+
+      specs = getCommandSpecs(v->commandIndex, &v->numSpecs);
+      if(specs != NULL && !parseArguments(strLine, seps, specs, v->numSpecs, v->args, &err))
+      {
+         formatArgError(v->strIssue, VALIDATE_MESSAGE_SIZE, m_Commands[v->commandIndex].strCommand, specs,
+                        v->numSpecs, &err);
+         v->bError = true;
+         numLines++;
+         continue;
+      }
+
+      switch(v->commandIndex)
+      {
+         case ROTATE:
+         case TRANSLATE:
+         case SCALE:
+            setTransform(S, v->commandIndex, strLine, &TS);
+            break;
+         case RESET_TRANSFORM_MATRIX:
+            resetTransformMatrix(TS.TM);
+            TS.numOps = 0;
+            break;
+         case PUSH_TRANSFORM:
+         case POP_TRANSFORM:
+            if(!(v->commandIndex == PUSH_TRANSFORM ? pushTransform(S, &TS) : popTransform(S, &TS)))
+            {
+               sprintf_s(v->strIssue, VALIDATE_MESSAGE_SIZE, v->commandIndex == PUSH_TRANSFORM ?
+                         "PUSH_TRANSFORM more than %d levels deep" : "POP_TRANSFORM without PUSH_TRANSFORM",
+                         MAX_TRANSFORM_DEPTH);
+               v->bError = true;
+               numLines++;
+            }
+            else if(v->commandIndex == PUSH_TRANSFORM)
+            {
+               pushLines[TS.depth - 1] = numLines++;  // kept in case no POP_TRANSFORM closes it
+            }
+            break;
+         case MOTOR_SPEED:
+            if(checkMotorSpeedArgs(v->args) != NULL)
+            {
+               strcpy_s(v->strIssue, VALIDATE_MESSAGE_SIZE, checkMotorSpeedArgs(v->args));
+               v->bError = true;
+               numLines++;
+            }
+            break;
+         case ARM_MODEL:
+            S->armModel = &SCARA_MODELS[v->args[0].i];
+            break;
+         case BEZIER_SPACING:
+            S->bezierSpacing = v->args[0].i;
+            break;
+         case ROTATE_JOINT:
+            ja.theta1Deg = v->args[0].d;
+            ja.theta2Deg = v->args[1].d;
+            if(!S->armModel->forwardKinematics(ja).bCanReach)
+            {
+               sprintf_s(v->strIssue, VALIDATE_MESSAGE_SIZE, "ROTATE_JOINT angles out of range (|theta1| <= %.1lf, "
+                         "|theta2| <= %.1lf)", S->armModel->absTheta1DegMax, S->armModel->absTheta2DegMax);
+               v->bError = true;
+               numLines++;
+            }
+            break;
+         case LINE:
+         case ARC:
+         case TRIANGLE:
+         case RECTANGLE:
+         case QUADRATIC_BEZIER:
+         case MOVE_TO:
+            composeTransform(&TS);
+            memcpy(v->TM, TS.TM, sizeof(TS.TM));
+            v->model = S->armModel;
+            v->bezierSpacing = S->bezierSpacing;
+            v->bCheck = true;
+            numPrimitives++;
+            numLines++;
+            break;
+      }
+   }
+   for(t = 0; t < TS.depth; t++)
+   {
+      v = &lines[pushLines[t]];
+      sprintf_s(v->strIssue, VALIDATE_MESSAGE_SIZE, "PUSH_TRANSFORM without POP_TRANSFORM");
+      v->bError = true;
+   }
+   freeMacroStream(&ms);
+   fclose(fi);
+   destroySession(S);
+
+   // check the primitives on the thread pool
+   workers = new std::thread[numThreads];
+   for(t = 0; t < numThreads; t++) workers[t] = std::thread(validateWorker, lines, numLines, &next);
+   for(t = 0; t < numThreads; t++) workers[t].join();
+   delete[] workers;
+
+   // report in line order
+   printf("Validating %s\n", strFileName);
+   for(n = 0; n < numLines; n++)
+   {
+      v = &lines[n];
+      if(v->bError) numErrors++;
+      if(v->bWarning) numWarnings++;
+      if(v->bError || v->bWarning)
+         printf("Line %02lu: %s: %s\n", v->nLine, v->bError ? "error" : "warning", v->strIssue);
+   }
+   printf("%lu lines, %lu primitives checked on %d threads in %.1lf ms: %lu errors, %lu warnings\n", ms.nLine,
+          numPrimitives, numThreads, (TraceClockUs() - tStartUs) / 1000.0, numErrors, numWarnings);
+   free(lines);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  validator thread.  Takes lines off the shared queue until there are none left.
+// ARGUMENTS:    lines, numLines:  the lines kept by validateCommandFile
+//               next:  index of the next line to take
+// RETURN VALUE: none
+void validateWorker(VALIDATE_LINE *lines, size_t numLines, std::atomic<size_t> *next)
+{
+   size_t n;   // line index
+
+   while((n = (*next)++) < numLines)
+   {
+      if(lines[n].bCheck) validatePrimitive(&lines[n]);
+   }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  checks that the robot can reach every point of a primitive with the transform and arm model in
+//               effect for its line.  A path that needs both arm configurations is a warning (it is drawn in
+//               segments, see drawSplitJointPath).  Uses no global state so it can run on any thread.
+// ARGUMENTS:    v:  the line (result written back)
+// RETURN VALUE: none
+void validatePrimitive(VALIDATE_LINE *v)
+{
+   TOOL_POSITION *pts = NULL;          // path points
+   size_t NP = 0, n;                   // number of path points, point index
+   TOOL_POSITION tp;                   // transformed point
+   INVERSE_SOLUTION isol;              // inverse kinematics solution
+   bool bCanDraw[2] = {true, true};    // true if all points reached with the left/right arm
+   int arm;                            // arm index
+
+   if(v->commandIndex == MOVE_TO)
+   {
+      tp.x = v->args[0].d;
+      tp.y = v->args[1].d;
+      tp = transform(v->TM, tp);
+      isol = v->model->inverseKinematics(tp);
+      arm = v->args[2].bPresent ? v->args[2].i : -1;
+      if(arm >= 0 ? !isol.bCanReach[arm] : !isol.bCanReach[LEFT] && !isol.bCanReach[RIGHT])
+      {
+         sprintf_s(v->strIssue, VALIDATE_MESSAGE_SIZE, "MOVE_TO (%.*lf, %.*lf)%s%s out of reach", PRECISION, tp.x,
+                   PRECISION, tp.y, arm >= 0 ? " with " : "", arm >= 0 ? strArms[arm] : "");
+         v->bError = true;
+      }
+      return;
+   }
+
+   if(!buildShapePoints(v->commandIndex, v->args, v->numSpecs, v->bezierSpacing, &pts, &NP))
+   {
+      sprintf_s(v->strIssue, VALIDATE_MESSAGE_SIZE, "out of memory");
+      v->bError = true;
+      free(pts);
+      return;
+   }
+
+   for(n = 0; n < NP; n++)
+   {
+      tp = transform(v->TM, pts[n]);
+      isol = v->model->inverseKinematics(tp);
+      if(!isol.bCanReach[LEFT] && !isol.bCanReach[RIGHT])
+      {
+         sprintf_s(v->strIssue, VALIDATE_MESSAGE_SIZE, "%s point %u of %u (%.*lf, %.*lf) out of reach",
+                   m_Commands[v->commandIndex].strCommand, (unsigned)n + 1, (unsigned)NP, PRECISION, tp.x,
+                   PRECISION, tp.y);
+         v->bError = true;
+         break;
+      }
+      for(arm = LEFT; arm <= RIGHT; arm++)
+      {
+         if(!isol.bCanReach[arm]) bCanDraw[arm] = false;
+      }
+   }
+
+   if(!v->bError && !bCanDraw[LEFT] && !bCanDraw[RIGHT])
+   {
+      sprintf_s(v->strIssue, VALIDATE_MESSAGE_SIZE, "%s needs both arm configurations (drawn in segments)",
+                m_Commands[v->commandIndex].strCommand);
+      v->bWarning = true;
+   }
+   free(pts);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  starts a new gateway producer with its own identity transform and nothing pushed
+// ARGUMENTS:    producer:  producer slot
+//               context:  the GATEWAY_SESSION
+// RETURN VALUE: none
+void handleGatewayConnect(int producer, void *context)
+{
+   GATEWAY_SESSION *session = (GATEWAY_SESSION *)context;
+
+   initTransformStack(&session->TS[producer]);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  processes one line received by the gateway
+// ARGUMENTS:    producer:  producer slot
+//               lineNumber:  line number in the producer stream (1 for the first line of a new connection)
+//               strLine:  the line
+//               strMessage, messageSize:  receives a reason if the line failed
+//               context:  the GATEWAY_SESSION
+// RETURN VALUE: GATEWAY_OK, GATEWAY_ERROR or GATEWAY_STOP
+int handleGatewayLine(int producer, unsigned long lineNumber, char *strLine, char *strMessage, int messageSize,
+                      void *context)
+{
+   GATEWAY_SESSION *session = (GATEWAY_SESSION *)context;
+   SESSION *S = session->S;                     // the job
+   int commandIndex;                            // command index
+
+   if(strLine[strspn(strLine, seps)] == '\0') return GATEWAY_OK;     // blank line
+
+   dsprintf(S, "Producer %d line %02lu: %s", producer, lineNumber, strLine);
+   makeStringUpperCase(strLine);
+
+   commandIndex = getCommandIndex(strLine);
+   if(commandIndex == COMMAND_INDEX_NOT_FOUND)
+   {
+      dsprintf(S, "Command not found\n");
+      sprintf_s(strMessage, messageSize, "command not found");
+      return GATEWAY_ERROR;
+   }
+
+   if(!processCommand(S, commandIndex, strLine, &session->TS[producer]))
+   {
+      sprintf_s(strMessage, messageSize, "%s failed (see log)", m_Commands[commandIndex].strCommand);
+      return GATEWAY_ERROR;
+   }
+
+   return commandIndex == SHUTDOWN_SIMULATION ? GATEWAY_STOP : GATEWAY_OK;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  processes a command referenced by the commandIndex.  Parses the command string from the file and 
+//               packages up the command to be sent to the robot if no errors found.  
+// ARGUMENTS:    S:  the session
+//               commandIndex:  index of the command keyword string
+//               strCommandLine: command line from the file in the form of a string
+//               TS the transformation matrix and its pushed levels
+// RETURN VALUE: true if command processed, false if not
+bool processCommand(SESSION *S, int commandIndex, char *strCommandLine, TRANSFORM_STACK *TS)
+{
+   bool bSuccess = true;
+   JOINT_ANGLES homeAngles = {0.0, 0.0};
+
+   switch(commandIndex)
+   {
+      case PEN_UP:
+         sendPenPosition(S, PEN_UP);
+         break;
+      case PEN_DOWN:
+         sendPenPosition(S, PEN_DOWN);
+         break;
+      case CLEAR_TRACE:
+         S->robot.Send("CLEAR_TRACE\n");
+         break;
+      case CLEAR_REMOTE_COMMAND_LOG:
+         S->robot.Send("CLEAR_REMOTE_COMMAND_LOG\n");
+         break;
+      case CLEAR_POSITION_LOG:
+         S->robot.Send("CLEAR_POSITION_LOG\n");
+         break;
+      case SHUTDOWN_SIMULATION:
+         S->robot.Send("SHUTDOWN_SIMULATION\n");
+         break;
+      case END:
+         S->robot.Send("END\n");
+         break;
+      case HOME:
+         S->robot.Send("HOME\n");
+         robotAngles(S, &homeAngles, UPDATE_CURRENT_ANGLES);
+         break;
+      case PEN_COLOR:
+         bSuccess = setPenColor(S, strCommandLine);
+         break;
+      case CYCLE_PEN_COLORS:
+         bSuccess = setCyclePenColors(S, strCommandLine);
+         break;
+      case ROTATE_JOINT:
+         bSuccess = rotateJoint(S, strCommandLine);
+         break;
+      case MOVE_TO:
+         composeTransform(TS);
+         bSuccess = moveTo(S, strCommandLine, TS->TM);
+         break;
+      case MOTOR_SPEED:
+         bSuccess = setMotorSpeed(S, strCommandLine);
+         break;
+      case LINE:
+      case ARC:
+      case TRIANGLE:
+      case RECTANGLE:
+      case QUADRATIC_BEZIER:
+         composeTransform(TS);
+         bSuccess = drawShape(S, commandIndex, strCommandLine, TS->TM);
+         break;
+      case ROTATE:
+      case TRANSLATE:
+      case SCALE:
+         bSuccess = setTransform(S, commandIndex, strCommandLine, TS);
+         break;
+      case RESET_TRANSFORM_MATRIX:
+         resetTransformMatrix(TS->TM);  // pushed levels are kept
+         TS->numOps = 0;
+         break;
+      case PUSH_TRANSFORM:
+         bSuccess = pushTransform(S, TS);
+         break;
+      case POP_TRANSFORM:
+         bSuccess = popTransform(S, TS);
+         break;
+      case ARM_MODEL:
+         bSuccess = setArmModel(S, strCommandLine);
+         break;
+      case PATH_TOLERANCE:
+         bSuccess = setPathTolerance(S, strCommandLine);
+         break;
+      case BEZIER_SPACING:
+         bSuccess = setBezierSpacing(S, strCommandLine);
+         break;
+      case REPEAT:
+      case END_REPEAT:
+      case DEFINE:
+      case END_DEFINE:
+      case CALL:
+         dsprintf(S, "%s is only expanded in commands files!\n\n", m_Commands[commandIndex].strCommand);
+         bSuccess = false;
+         break;
+      default:
+         dsprintf(S, "unknown command!\n");
+         bSuccess = false;
+   }
+
+   if(bSuccess) dsprintf(S, "Command sent to robot!\n\n");
+   return bSuccess;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  Calculates the length of a quadratic Bezier Curve
+// ARGUMENTS:    P0: coordinates of start of curve.
+//               P2: coordinates of end of curve
+//               P1: control point coordinates
+// RETURN VALUE: length of the quadratic Bezier Curve
+double getQuadraticBezierArcLength(TOOL_POSITION P0, TOOL_POSITION P1, TOOL_POSITION P2)
+{
+   double A[2] = {P0.x - 2.0 * P1.x + P2.x, P0.y - 2.0 * P1.y + P2.y};  // B(t) = P0 + 2tB + t^2 A
+   double B[2] = {P1.x - P0.x, P1.y - P0.y};
+
+   return getQuadraticBezierLengthAt(A, B, 1.0);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  arc length of the quadratic Bezier curve P0 + 2tB + t^2 A from t = 0 to t, in closed form.  The speed
+//               is 2|B + tA| = 2 sqrt(a) sqrt(v^2 + m) with v = t + (A.B)/a, a = A.A and m = |A x B|^2 / a^2, and
+//               the integral of sqrt(v^2 + m) is (v sqrt(v^2 + m) + m asinh(v / sqrt(m))) / 2.
+//               For a nearly straight curve (|A| much smaller than |B|) v is huge and G1 - G0 cancels, so the
+//               speed is expanded in t/|B| instead:  2|B + tA| = 2|B| + 2t A.B/|B| + t^2 (A x B)^2/|B|^3 + ...
+//               Both forms are good to about 1e-12 of the length at the switch, |A|^2 = 1e-8 |B|^2.
+// ARGUMENTS:    A:  P0 - 2P1 + P2 (x, y)
+//               B:  P1 - P0 (x, y)
+//               t:  curve parameter (0 to 1)
+// RETURN VALUE: arc length
+double getQuadraticBezierLengthAt(const double A[2], const double B[2], double t)
+{
+   double a = A[0] * A[0] + A[1] * A[1];  // |A|^2
+   double c = B[0] * B[0] + B[1] * B[1];  // |B|^2
+   double b;                              // |B|
+   double cross, m, v0, v1, G0, G1;       // A x B, v^2 offset, v at 0 and t, integral at 0 and t
+
+   cross = A[0] * B[1] - A[1] * B[0];
+   if(a <= 1.0e-8 * c)  // nearly straight:  integrate the series of the speed
+   {
+      if(c == 0.0) return 0.0;  // a single point
+      b = sqrt(c);
+      return t * (2.0 * b + t * ((A[0] * B[0] + A[1] * B[1]) / b + t * cross * cross / (3.0 * c * b)));
+   }
+
+   m = cross * cross / (a * a);
+   v0 = (A[0] * B[0] + A[1] * B[1]) / a;
+   v1 = v0 + t;
+   G0 = v0 * sqrt(v0 * v0 + m);
+   G1 = v1 * sqrt(v1 * v1 + m);
+   if(m > 1.0e-20 * (v0 * v0 + v1 * v1))  // m = 0:  collinear points, no asinh term
+   {
+      G0 += m * asinh(v0 / sqrt(m));
+      G1 += m * asinh(v1 / sqrt(m));
+   }
+   return sqrt(a) * (G1 - G0);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Tranforms the tool position coordinates based on the current tranformation matrix.
+// INPUTS:  TM: the 3x3 transform matrix
+// RETURN:  tranformed tool position
+TOOL_POSITION transform(const double TM[][3], TOOL_POSITION tp)
+{
+   TOOL_POSITION tpt;  // transformed tool position
+
+   // matrix multiply transformation
+   tpt.x = tp.x * TM[0][0] + tp.y * TM[0][1] + TM[0][2];
+   tpt.y = tp.x * TM[1][0] + tp.y * TM[1][1] + TM[1][2];
+
+   return tpt;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Resets the tranform matrix to the unit matrix.  x, y points will no longer be transformed in inverseKinematics
+// INPUTS:  the 3x3 transform matrix
+// RETURN:  nothing
+void resetTransformMatrix(double TM[][3])  // resets to unit matrix
+{
+   int r, c;  // matrix row, column indexes
+
+   for(r = 0; r < 3; r++)
+   {
+      for(c = 0; c < 3; c++)
+      {
+         TM[r][c] = (r == c ? 1.0 : 0.0);
+      }
+   }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// Premultiplies the transform matrix by matrix M.  M is the rotation matrix, translation matrix, or the scaling matrix
+// INPUTS:  TM: the 3x3 transform matrix, M the premultiplier matrix
+// RETURN:  nothing
+void transformMatrixMultiply(double TM[][3], const double M[][3])
+{
+   int r, c, cc;     // row, column indexes
+   double TMM[3][3]; // temp matrix
+
+   for(r = 0; r < 3; r++)
+   {
+      for(c = 0; c < 3; c++)
+      {
+         TMM[r][c] = 0.0;  // set element to zero
+
+         for(cc = 0; cc < 3; cc++) // accumulate the multiples
+         {
+            TMM[r][c] += M[r][cc] * TM[cc][c];
+         }
+      }
+   }
+
+   for(r = 0; r < 3; r++)  // copy temp matrix to TM
+   {
+      for(c = 0; c < 3; c++)
+      {
+         TM[r][c] = TMM[r][c];
+      }
+   }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  sets a transform stack to the identity matrix with nothing pushed or queued
+// ARGUMENTS:    TS:  the transform stack
+// RETURN VALUE: none
+void initTransformStack(TRANSFORM_STACK *TS)
+{
+   resetTransformMatrix(TS->TM);
+   TS->numOps = 0;
+   TS->depth = 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  queues a premultiplier matrix (ROTATE, TRANSLATE or SCALE).  The queue is composed early if full.
+// ARGUMENTS:    TS:  the transform stack
+//               M:  the premultiplier matrix
+// RETURN VALUE: none
+void queueTransform(TRANSFORM_STACK *TS, const double M[][3])
+{
+   if(TS->numOps == MAX_PENDING_TRANSFORMS) composeTransform(TS);
+   memcpy(TS->ops[TS->numOps++], M, sizeof(TS->ops[0]));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  premultiplies the transform matrix by the queued matrices in the order they were queued.  Called
+//               before geometry is drawn.
+// ARGUMENTS:    TS:  the transform stack
+// RETURN VALUE: none
+void composeTransform(TRANSFORM_STACK *TS)
+{
+   int n;  // queued matrix index
+
+   for(n = 0; n < TS->numOps; n++) transformMatrixMultiply(TS->TM, TS->ops[n]);
+   TS->numOps = 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  PUSH_TRANSFORM.  Saves the current transform matrix so POP_TRANSFORM can return to it.
+// ARGUMENTS:    S:  the session
+//               TS:  the transform stack
+// RETURN VALUE: true if pushed, false if MAX_TRANSFORM_DEPTH levels are already pushed
+bool pushTransform(SESSION *S, TRANSFORM_STACK *TS)
+{
+   if(TS->depth == MAX_TRANSFORM_DEPTH)
+   {
+      dsprintf(S, "PUSH_TRANSFORM: more than %d levels pushed!\n", MAX_TRANSFORM_DEPTH);
+      return false;
+   }
+
+   composeTransform(TS);
+   memcpy(TS->saved[TS->depth++], TS->TM, sizeof(TS->TM));
+   return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  POP_TRANSFORM.  Returns to the transform matrix saved by the matching PUSH_TRANSFORM.  Transforms
+//               queued since then are dropped without being composed.
+// ARGUMENTS:    S:  the session
+//               TS:  the transform stack
+// RETURN VALUE: true if popped, false if nothing was pushed
+bool popTransform(SESSION *S, TRANSFORM_STACK *TS)
+{
+   if(TS->depth == 0)
+   {
+      dsprintf(S, "POP_TRANSFORM: no matching PUSH_TRANSFORM!\n");
+      return false;
+   }
+
+   memcpy(TS->TM, TS->saved[--TS->depth], sizeof(TS->TM));
+   TS->numOps = 0;
+   return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  parses a command string that contains CYCLE_PEN_COLORS and sends command to robot if data ok.
+// ARGUMENTS:    S:  the session
+//               strLine:  A file line string.
+// RETURN VALUE: true if command sent to robot, false if not.
+bool setCyclePenColors(SESSION *S, char *strLine)
+{
+   char cmd[COMMAND_STRING_ARRAY_SIZE];            // command string
+   CCommandWriter writer(cmd, COMMAND_STRING_ARRAY_SIZE);
+   ARG_VALUE args[NUM_ARGS(CYCLE_PEN_COLORS_ARGS)];  // parsed parameters
+
+   if(!getArguments(S, strLine, CYCLE_PEN_COLORS, CYCLE_PEN_COLORS_ARGS, NUM_ARGS(CYCLE_PEN_COLORS_ARGS), args))
+      return false;
+
+   // all good.  Send command.
+   writer.Begin("CYCLE_PEN_COLORS").Word(strOnOff[args[0].i]).End();
+   S->robot.Send(cmd, writer.GetLength());
+   S->pen.bCycleColors = args[0].i == 0;
+   return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  sends PEN_UP or PEN_DOWN to the robot and remembers the pen position (checkpoints)
+// ARGUMENTS:    S:  the session
+//               penPos:  PEN_UP or PEN_DOWN
+// RETURN VALUE: none
+void sendPenPosition(SESSION *S, int penPos)
+{
+   S->robot.Send(penPos == PEN_UP ? "PEN_UP\n" : "PEN_DOWN\n");
+   S->pen.penPos = penPos;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  get or update current robot shoulder and elbow angles
+// ARGUMENTS:    S:  the session
+//               pAngles:  shoulder/joint angles.
+//               getOrUpdate:  set to UPDATE_CURRENT_ANGLES to update the current angles
+//                             set to GET_CURRENT_ANGLES to retrieve the current angles
+// RETURN VALUE: none
+void robotAngles(SESSION *S, JOINT_ANGLES *pAngles, int getOrUpdate)
+{
+   if(pAngles == NULL) // safety
+   {
+      dsprintf(S, "NULL JOINT_ANGLES pointer! (robotAngles)");
+      return;
+   }
+
+   if(getOrUpdate == UPDATE_CURRENT_ANGLES)
+      S->currentAngles = *pAngles;
+   else if(getOrUpdate == GET_CURRENT_ANGLES)
+      *pAngles = S->currentAngles;
+   else
+      dsprintf(S, "Unknown value for getOrUpdate (robotAngles)");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  Pauses the robot then clears everthing after user presses ENTER
+// ARGUMENTS:    S:  the session
+// RETURN VALUE: none
+void pauseRobotThenClear(SESSION *S)
+{
+   waitForEnterKey();
+   system("cls");
+   S->robot.Send("HOME\n");
+   S->robot.Send("CLEAR_TRACE\n");
+   S->robot.Send("PEN_COLOR 0 0 255\n");
+   S->pen.penColor.r = S->pen.penColor.g = 0;
+   S->pen.penColor.b = 255;
+   S->robot.Send("CLEAR_REMOTE_COMMAND_LOG\n");
+   S->robot.Send("CLEAR_POSITION_LOG\n");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  Maps an angle in radians into a an equivalent angle understood by the robot (-PI <= ang <= +PI)
+// ARGUMENTS:    ang: the angle in radians 
+// RETURN VALUE: the mapped angle in radians
+double mapAngle(double angRad)
+{
+   angRad = fmod(angRad, 2.0 * PI);  // put in range -2*PI <= ang <= +2*PI
+
+   // map into range -PI <= ang <= +PI
+   if(angRad > PI)
+      angRad -= 2.0 * PI;
+   else if(angRad < -PI)
+      angRad += 2.0 * PI;
+
+   return angRad;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  Returns angle in degrees from input angle in radian
+// ARGUMENTS:    angDeg:  angle in degrees
+// RETURN VALUE: angle in radians
+double degToRad(double angDeg)
+{
+   return (PI / 180.0) * angDeg;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  Returns angle in radians from input angle in degrees
+// ARGUMENTS:    angRad:  angle in radians
+// RETURN VALUE: angle in degrees
+double radToDeg(double angRad)
+{
+   return (180.0 / PI) * angRad;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  This function flushes the input buffer to avoid scanf issues
+// ARGUMENTS:    none
+// RETURN VALUE: false if nothing or only '\n' in stdin. true if extra keystrokes precede the '\n'.
+//               Good for detecting left over garbage from scanf_s in the input buffer
+bool flushInputBuffer()
+{
+   int ch; // temp character variable
+   bool bHasGarbage = false;
+
+   // exit loop when all characters are flushed
+   while((ch = getchar()) != '\n' && ch != EOF)
+   {
+      if(!bHasGarbage) bHasGarbage = true;
+   }
+   return bHasGarbage;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  Waits for user to press enter.  flushes stdin if keystrokes precede enter
+// ARGUMENTS:    none
+// RETURN VALUE: none
+void waitForEnterKey()
+{
+   int ch;
+   if((ch = getchar()) != EOF && ch != '\n') flushInputBuffer();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  computes nearest integer to given double
+// ARGUMENTS:    d: double value
+// RETURN VALUE: nearest int
+int nint(double d)
+{
+   return (int)floor(d + 0.5);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  print a solid line to the console
+// ARGUMENTS:    S:  the session whose output it is (NULL = console only)
+//               N:  length of line in characters
+// RETURN VALUE: none
+void printHLine(SESSION *S, int N)
+{
+   int n;
+
+   for(n = 0; n < N; n++)
+   {
+      // can't use dsprintf because characters are different because code pages are different
+      // console = code page 437, file = code page 1252
+      if(S == NULL || S->bConsole) printf("%c", HL);
+      if(S != NULL && S->flog != NULL) fprintf(S->flog, "%c", FHL);
+   }
+   dsprintf(S, "\n");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  makes a string all upper case characters
+// ARGUMENTS:    str:  the string memory address
+// RETURN VALUE: none
+void makeStringUpperCase(char *str)
+{
+   if(str == NULL) return; // safety!
+
+   for(size_t i = 0; i < strlen(str); i++) str[i] = (char)toupper(str[i]);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  prints to both the log file of a session and to the console
+// ARGUMENTS:    S:  the session whose output it is (NULL = console only)
+//               fmt, ...: for variable number of parameters
+// RETURN VALUE: the number of characters printed
+int dsprintf(SESSION *S, char const *fmt, ...)
+{
+   va_list args;
+   int n1 = -1, n2 = -1;
+
+   if(S != NULL && S->bQuiet) return 0;
+
+   if(S != NULL && S->flog != NULL)
+   {
+      va_start(args, fmt);
+      n1 = vfprintf(S->flog, fmt, args);
+      va_end(args);
+   }
+   if(S == NULL || S->bConsole)
+   {
+      va_start(args, fmt);
+      n2 = vfprintf(stdout, fmt, args);
+      va_end(args);
+   }
+   else
+   {
+      n2 = n1;  // log file only
+   }
+
+   if(n2 < n1) n1 = n2;
+   return n1;
+}
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  Gets the number of points to check/draw a path based on the length of the path and a resolution value
+// ARGUMENTS:    len:  The arc length of the path
+//               resolution:  a parameter that determines the density of points on a path
+// RETURN VALUE: the number of points
+size_t getNumPathPoints(double len, int resolution)
+{
+   size_t NP;  // number of points used to check/draw the path points
+
+   if(resolution == RESOLUTION_LOW)
+      NP = (size_t)nint((len / 500.0) * (double)LOW_RESOLUTION_POINTS_PER_500_UNITS);
+   else if(resolution == RESOLUTION_MEDIUM)
+      NP = (size_t)nint((len / 500.0) * (double)MEDIUM_RESOLUTION_POINTS_PER_500_UNITS);
+   else
+      NP = (size_t)nint((len / 500.0) * (double)HIGH_RESOLUTION_POINTS_PER_500_UNITS);
+
+   NP = max(NP, 2);  //safety
+
+   return NP;
+}
+
+int getCommandIndex(const char *strLine)
+{
+   char *tok = NULL, *nextTok = NULL;
+   char strLineCopy[MAX_LINE_SIZE];
+
+   if(strLine == NULL || strlen(strLine) == 0)
+   {
+      return BLANK_LINE;
+   }
+
+   strcpy_s(strLineCopy, MAX_LINE_SIZE, strLine);
+   tok = strtok_s(strLineCopy, seps, &nextTok);
+
+   if(tok == NULL)
+   {
+      return COMMAND_INDEX_NOT_FOUND;
+   }
+
+   for(int i = 0; i < NUM_COMMANDS; i++)
+   {
+      if(strcmp(tok, m_Commands[i].strCommand) == 0)
+      {
+         return m_Commands[i].index;
+      }
+   }
+   return COMMAND_INDEX_NOT_FOUND;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  parses a command string that contains PEN_COLOR r g b and sends command to robot if data ok.
+// ARGUMENTS:    S:  the session
+//               strLine:  A file line string.
+// RETURN VALUE: true if command sent to robot, false if not.
+bool setPenColor(SESSION *S, const char *strLine)
+{
+   char cmd[COMMAND_STRING_ARRAY_SIZE];            // command string
+   CCommandWriter writer(cmd, COMMAND_STRING_ARRAY_SIZE);
+   ARG_VALUE args[NUM_ARGS(PEN_COLOR_ARGS)];       // parsed parameters
+   RGB color;                                      // the pen color
+
+   if(!getArguments(S, strLine, PEN_COLOR, PEN_COLOR_ARGS, NUM_ARGS(PEN_COLOR_ARGS), args)) return false;
+
+   color.r = args[0].i;
+   color.g = args[1].i;
+   color.b = args[2].i;
+
+   writer.Begin("PEN_COLOR").Int(color.r).Int(color.g).Int(color.b).End();
+   S->robot.Send(cmd, writer.GetLength());
+   S->pen.penColor = color;
+   return true;
+}
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  parses the parameters of a command with parseArguments and prints an error message if they are bad
+// ARGUMENTS:    S:  the session
+//               strLine:  A file line string.
+//               commandIndex:  index of the command keyword (for error messages)
+//               specs, numSpecs:  parameter specifications
+//               args:  receives the parsed parameters
+// RETURN VALUE: true if all parameters are valid, false if not
+bool getArguments(SESSION *S, const char *strLine, int commandIndex, const ARG_SPEC *specs, int numSpecs,
+                  ARG_VALUE *args)
+{
+   ARG_ERROR err;                   // parser error
+   char strError[MAX_LINE_SIZE];    // parser error message
+
+   if(parseArguments(strLine, seps, specs, numSpecs, args, &err)) return true;
+
+   formatArgError(strError, MAX_LINE_SIZE, m_Commands[commandIndex].strCommand, specs, numSpecs, &err);
+   dsprintf(S, "%s\n\n", strError);
+   return false;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  parses a MOTOR_SPEED command.  LOW, MEDIUM and HIGH are sent to the robot.
+//               AUTO tolerance mediumError highError turns on the motor speed planner which picks a speed for every
+//               path segment (see scheduleMotorSpeeds).  The errors are its error model at MEDIUM and HIGH.
+// ARGUMENTS:    S:  the session
+//               strLine:  A file line string.
+// RETURN VALUE: true if command ok, false if not.
+bool setMotorSpeed(SESSION *S, char *strLine)
+{
+   ARG_VALUE args[NUM_ARGS(MOTOR_SPEED_ARGS)];     // parsed parameters
+   MOTOR_SPEED_STATE mss;                          // motor speed state
+   const char *strError;                           // parameter problem
+
+   if(!getArguments(S, strLine, MOTOR_SPEED, MOTOR_SPEED_ARGS, NUM_ARGS(MOTOR_SPEED_ARGS), args)) return false;
+   if((strError = checkMotorSpeedArgs(args)) != NULL)
+   {
+      dsprintf(S, "%s!\n\n", strError);
+      return false;
+   }
+
+   robotMotorSpeed(S, &mss, GET_CURRENT_STATE);
+
+   if(args[0].i == MOTOR_SPEED_AUTO)
+   {
+      mss.bAuto = true;
+      mss.tolerance = args[1].d;
+      mss.errorPerDeg[MOTOR_SPEED_LOW] = 0.0;
+      mss.errorPerDeg[MOTOR_SPEED_MEDIUM] = args[2].d;
+      mss.errorPerDeg[MOTOR_SPEED_HIGH] = args[3].d;
+      robotMotorSpeed(S, &mss, UPDATE_CURRENT_STATE);
+      dsprintf(S, "Automatic motor speed on (tolerance %.*lf, error per degree %.*lf MEDIUM, %.*lf HIGH)\n", PRECISION,
+               mss.tolerance, PRECISION, mss.errorPerDeg[MOTOR_SPEED_MEDIUM], PRECISION,
+               mss.errorPerDeg[MOTOR_SPEED_HIGH]);
+      return true;
+   }
+
+   mss.bAuto = false;
+   mss.currentSpeed = -1;  // always send a speed given in the file
+   robotMotorSpeed(S, &mss, UPDATE_CURRENT_STATE);
+   sendMotorSpeed(S, args[0].i);
+   return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  checks the parameters given to MOTOR_SPEED:  AUTO needs the tolerance and the error model, the other
+//               speeds take none
+// ARGUMENTS:    args:  parsed MOTOR_SPEED parameters
+// RETURN VALUE: NULL if ok, else the problem
+const char *checkMotorSpeedArgs(const ARG_VALUE *args)
+{
+   if(args[0].i == MOTOR_SPEED_AUTO && !args[3].bPresent)
+      return "MOTOR_SPEED AUTO needs tolerance mediumError highError (measured corner error per degree)";
+   if(args[0].i != MOTOR_SPEED_AUTO && args[1].bPresent)
+      return "MOTOR_SPEED tolerance and errors are only used with AUTO";
+   return NULL;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  parses a ROTATE_JOINT theta1 theta2 command (degrees) and sends it to the robot if within limits
+// ARGUMENTS:    S:  the session
+//               strLine:  A file line string.
+// RETURN VALUE: true if command sent to robot, false if not.
+bool rotateJoint(SESSION *S, char *strLine)
+{
+   ARG_VALUE args[NUM_ARGS(ROTATE_JOINT_ARGS)];    // parsed parameters
+   JOINT_ANGLES ja;                                // joint angles to send
+
+   if(!getArguments(S, strLine, ROTATE_JOINT, ROTATE_JOINT_ARGS, NUM_ARGS(ROTATE_JOINT_ARGS), args)) return false;
+
+   ja.theta1Deg = args[0].d;
+   ja.theta2Deg = args[1].d;
+   if(!forwardKinematics(S, ja).bCanReach)
+   {
+      dsprintf(S, "ROTATE_JOINT angles out of range!  |theta1| <= %.1lf%c, |theta2| <= %.1lf%c\n\n",
+               S->armModel->absTheta1DegMax, DEGREE_SYMBOL, S->armModel->absTheta2DegMax, DEGREE_SYMBOL);
+      return false;
+   }
+
+   sendRotateJoint(S, ja);
+   return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  parses a MOVE_TO x y [LEFT|RIGHT] command and moves the tool tip there.  If the arm is not given, the
+//               configuration that needs the least joint rotation is used.  The current pen position is not changed.
+// ARGUMENTS:    S:  the session
+//               strLine:  A file line string.
+//               TM:  the transform matrix
+// RETURN VALUE: true if command sent to robot, false if not.
+bool moveTo(SESSION *S, char *strLine, const double TM[][3])
+{
+   ARG_VALUE args[NUM_ARGS(MOVE_TO_ARGS)];         // parsed parameters
+   TOOL_POSITION tp;                               // tool position
+   INVERSE_SOLUTION isol;                          // inverse kinematics solution
+   JOINT_ANGLES current;                           // current robot angles
+   MOTOR_SPEED_STATE mss;                          // motor speed state
+   double dTheta, dThetaMin = ERROR_VALUE;
+   int arm, bestArm = -1;
+
+   if(!getArguments(S, strLine, MOVE_TO, MOVE_TO_ARGS, NUM_ARGS(MOVE_TO_ARGS), args)) return false;
+
+   tp.x = args[0].d;
+   tp.y = args[1].d;
+   isol = inverseKinematics(S, transform(TM, tp));
+   robotAngles(S, &current, GET_CURRENT_ANGLES);
+
+   for(arm = LEFT; arm <= RIGHT; arm++)
+   {
+      if(!isol.bCanReach[arm] || (args[2].bPresent && args[2].i != arm)) continue;
+      dTheta = fabs(isol.jointAngles[arm].theta1Deg - current.theta1Deg)
+             + fabs(isol.jointAngles[arm].theta2Deg - current.theta2Deg);
+      if(dTheta < dThetaMin)
+      {
+         dThetaMin = dTheta;
+         bestArm = arm;
+      }
+   }
+
+   if(bestArm < 0)
+   {
+      dsprintf(S, "Robot cannot reach (%.*lf, %.*lf)%s%s!\n\n", PRECISION, tp.x, PRECISION, tp.y,
+               args[2].bPresent ? " with the arm " : "", args[2].bPresent ? strArms[args[2].i] : "");
+      return false;
+   }
+
+   robotMotorSpeed(S, &mss, GET_CURRENT_STATE);
+   if(mss.bAuto) sendMotorSpeed(S, MOTOR_SPEED_HIGH);    // point to point move.  No path accuracy to keep.
+   sendRotateJoint(S, isol.jointAngles[bestArm]);
+   return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  parses a shape command and draws it.  Shape parameters are followed by an optional resolution
+//               keyword (LOW, MEDIUM or HIGH):
+//                  LINE x1 y1 x2 y2
+//                  ARC xc yc r startAngleDeg endAngleDeg
+//                  TRIANGLE x1 y1 x2 y2 x3 y3
+//                  RECTANGLE x1 y1 x2 y2            (opposite corners)
+//                  QUADRATIC_BEZIER x0 y0 x1 y1 x2 y2
+//               Expanded paths are kept in the path cache so a repeated shape with the same transform is not
+//               expanded again.
+// ARGUMENTS:    S:  the session
+//               commandIndex:  LINE, ARC, TRIANGLE, RECTANGLE or QUADRATIC_BEZIER
+//               strLine:  A file line string.
+//               TM:  the transform matrix
+// RETURN VALUE: true if shape drawn, false if not.
+bool drawShape(SESSION *S, int commandIndex, char *strLine, const double TM[][3])
+{
+   const ARG_SPEC *specs;              // shape parameter specifications
+   int numSpecs, resolution;           // number of shape parameters (including resolution), path resolution
+   ARG_VALUE args[MAX_ARGS];           // parsed parameters
+   TOOL_POSITION *pts = NULL;          // path points
+   size_t NP = 0;                      // number of path points
+   PATH_KEY key;                       // path cache key
+   JOINT_PATH path;                    // expanded path
+   const JOINT_PATH *pCached;          // cached expanded path
+   int n;                              // parameter index
+   bool bOk;
+
+   specs = getCommandSpecs(commandIndex, &numSpecs);
+   if(!getArguments(S, strLine, commandIndex, specs, numSpecs, args)) return false;
+   resolution = args[numSpecs - 1].bPresent ? args[numSpecs - 1].i : RESOLUTION_MEDIUM;
+
+   // already expanded?
+   memset(&key, 0, sizeof(key));
+   key.commandIndex = commandIndex;
+   key.resolution = resolution;
+   for(n = 0; n < numSpecs - 1; n++) key.params[n] = args[n].d;
+   memcpy(key.TM, TM, sizeof(key.TM));
+   key.model = S->armModel;
+   if(commandIndex == QUADRATIC_BEZIER) key.bezierSpacing = S->bezierSpacing;
+
+   pCached = pathCacheFind(S, &key);
+   if(pCached != NULL) return drawJointPath(S, pCached);
+
+   bOk = buildShapePoints(commandIndex, args, numSpecs, S->bezierSpacing, &pts, &NP);
+   if(!bOk)
+      dsprintf(S, "Out of memory! (buildShapePoints)\n\n");
+   else
+      bOk = expandJointPath(S, pts, NP, TM, &path);
+   free(pts);
+   if(!bOk) return false;
+
+   pCached = pathCacheInsert(S, &key, &path);
+   return drawJointPath(S, pCached);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  gets the parameter specifications of a command
+// ARGUMENTS:    commandIndex:  the command
+//               numSpecs:  receives the number of parameters
+// RETURN VALUE: the specifications, NULL for commands without parameters
+const ARG_SPEC *getCommandSpecs(int commandIndex, int *numSpecs)
+{
+   switch(commandIndex)
+   {
+      case ROTATE_JOINT:     *numSpecs = NUM_ARGS(ROTATE_JOINT_ARGS);     return ROTATE_JOINT_ARGS;
+      case MOTOR_SPEED:      *numSpecs = NUM_ARGS(MOTOR_SPEED_ARGS);      return MOTOR_SPEED_ARGS;
+      case CYCLE_PEN_COLORS: *numSpecs = NUM_ARGS(CYCLE_PEN_COLORS_ARGS); return CYCLE_PEN_COLORS_ARGS;
+      case PEN_COLOR:        *numSpecs = NUM_ARGS(PEN_COLOR_ARGS);        return PEN_COLOR_ARGS;
+      case LINE:             *numSpecs = NUM_ARGS(LINE_ARGS);             return LINE_ARGS;
+      case ARC:              *numSpecs = NUM_ARGS(ARC_ARGS);              return ARC_ARGS;
+      case MOVE_TO:          *numSpecs = NUM_ARGS(MOVE_TO_ARGS);          return MOVE_TO_ARGS;
+      case TRIANGLE:         *numSpecs = NUM_ARGS(TRIANGLE_ARGS);         return TRIANGLE_ARGS;
+      case RECTANGLE:        *numSpecs = NUM_ARGS(RECTANGLE_ARGS);        return RECTANGLE_ARGS;
+      case QUADRATIC_BEZIER: *numSpecs = NUM_ARGS(QUADRATIC_BEZIER_ARGS); return QUADRATIC_BEZIER_ARGS;
+      case ROTATE:           *numSpecs = NUM_ARGS(ROTATE_ARGS);           return ROTATE_ARGS;
+      case TRANSLATE:        *numSpecs = NUM_ARGS(TRANSLATE_ARGS);        return TRANSLATE_ARGS;
+      case SCALE:            *numSpecs = NUM_ARGS(SCALE_ARGS);            return SCALE_ARGS;
+      case ARM_MODEL:        *numSpecs = NUM_ARGS(ARM_MODEL_ARGS);        return ARM_MODEL_ARGS;
+      case PATH_TOLERANCE:   *numSpecs = NUM_ARGS(PATH_TOLERANCE_ARGS);   return PATH_TOLERANCE_ARGS;
+      case BEZIER_SPACING:   *numSpecs = NUM_ARGS(BEZIER_SPACING_ARGS);   return BEZIER_SPACING_ARGS;
+      case REPEAT:           *numSpecs = NUM_ARGS(REPEAT_ARGS);           return REPEAT_ARGS;
+      default:               *numSpecs = 0;                               return NULL;
+   }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  generates the (untransformed) path points of a shape
+// ARGUMENTS:    commandIndex:  LINE, ARC, TRIANGLE, RECTANGLE or QUADRATIC_BEZIER
+//               args, numSpecs:  parsed shape parameters (the last one is the optional resolution)
+//               bezierSpacing:  QUADRATIC_BEZIER point spacing (BEZIER_SPACING_PARAMETER or BEZIER_SPACING_LENGTH)
+//               pPts, pNP:  receive the dynamically allocated path points and the number of points
+// RETURN VALUE: true if ok, false if out of memory
+bool buildShapePoints(int commandIndex, const ARG_VALUE *args, int numSpecs, int bezierSpacing, TOOL_POSITION **pPts,
+                      size_t *pNP)
+{
+   TOOL_POSITION P[4];                 // shape vertices/control points
+   TOOL_POSITION *pts = NULL;          // path points
+   size_t NP = 0;                      // number of path points
+   int resolution = args[numSpecs - 1].bPresent ? args[numSpecs - 1].i : RESOLUTION_MEDIUM;
+   bool bOk = true;
+
+   P[0].x = args[0].d;
+   P[0].y = args[1].d;
+   P[1].x = args[2].d;
+   P[1].y = args[3].d;
+   if(numSpecs == 7)
+   {
+      P[2].x = args[4].d;
+      P[2].y = args[5].d;
+   }
+
+   switch(commandIndex)
+   {
+      case LINE:
+         bOk = appendLinePoints(&pts, &NP, P[0], P[1], resolution);
+         break;
+      case ARC:
+         bOk = appendArcPoints(&pts, &NP, P[0], args[2].d, args[3].d, args[4].d, resolution);
+         break;
+      case TRIANGLE:
+         bOk = appendLinePoints(&pts, &NP, P[0], P[1], resolution)
+            && appendLinePoints(&pts, &NP, P[1], P[2], resolution)
+            && appendLinePoints(&pts, &NP, P[2], P[0], resolution);
+         break;
+      case RECTANGLE:
+         P[2] = P[1];
+         P[1].x = P[2].x;
+         P[1].y = P[0].y;
+         P[3].x = P[0].x;
+         P[3].y = P[2].y;
+         bOk = appendLinePoints(&pts, &NP, P[0], P[1], resolution)
+            && appendLinePoints(&pts, &NP, P[1], P[2], resolution)
+            && appendLinePoints(&pts, &NP, P[2], P[3], resolution)
+            && appendLinePoints(&pts, &NP, P[3], P[0], resolution);
+         break;
+      case QUADRATIC_BEZIER:
+         bOk = appendQuadraticBezierPoints(&pts, &NP, P[0], P[1], P[2], resolution, bezierSpacing);
+         break;
+   }
+
+   *pPts = pts;
+   *pNP = NP;
+   return bOk;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  parses ROTATE angleDeg, TRANSLATE dx dy or SCALE sx [sy] and premultiplies the transform matrix
+// ARGUMENTS:    S:  the session
+//               commandIndex:  ROTATE, TRANSLATE or SCALE
+//               strLine:  A file line string.
+//               TS:  the transform stack (the matrix is queued, see composeTransform)
+// RETURN VALUE: true if transform matrix updated, false if not.
+bool setTransform(SESSION *S, int commandIndex, char *strLine, TRANSFORM_STACK *TS)
+{
+   ARG_VALUE args[2];                  // parsed parameters
+   double M[3][3] = {{1.0, 0.0, 0.0},{0.0, 1.0, 0.0},{0.0, 0.0, 1.0}};  // premultiplier matrix
+
+   switch(commandIndex)
+   {
+      case ROTATE:
+         if(!getArguments(S, strLine, ROTATE, ROTATE_ARGS, NUM_ARGS(ROTATE_ARGS), args)) return false;
+         M[0][0] = cos(degToRad(args[0].d));
+         M[0][1] = -sin(degToRad(args[0].d));
+         M[1][0] = sin(degToRad(args[0].d));
+         M[1][1] = cos(degToRad(args[0].d));
+         break;
+      case TRANSLATE:
+         if(!getArguments(S, strLine, TRANSLATE, TRANSLATE_ARGS, NUM_ARGS(TRANSLATE_ARGS), args)) return false;
+         M[0][2] = args[0].d;
+         M[1][2] = args[1].d;
+         break;
+      case SCALE:
+         if(!getArguments(S, strLine, SCALE, SCALE_ARGS, NUM_ARGS(SCALE_ARGS), args)) return false;
+         M[0][0] = args[0].d;
+         M[1][1] = args[1].bPresent ? args[1].d : args[0].d;  // uniform scaling unless sy given
+         break;
+      default:
+         return false;
+   }
+
+   queueTransform(TS, M);
+   return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  computes the left and right arm joint angles for a tool tip position with the current arm model
+// ARGUMENTS:    S:  the session
+//               tp:  tool tip position
+// RETURN VALUE: left/right joint angles (degrees) and whether each configuration can reach the point
+INVERSE_SOLUTION inverseKinematics(SESSION *S, TOOL_POSITION tp)
+{
+   return S->armModel->inverseKinematics(tp);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  computes the tool tip position for a set of joint angles with the current arm model
+// ARGUMENTS:    S:  the session
+//               ja:  joint angles (degrees)
+// RETURN VALUE: tool tip position and whether the joint angles are within the robot limits
+FORWARD_SOLUTION forwardKinematics(SESSION *S, JOINT_ANGLES ja)
+{
+   return S->armModel->forwardKinematics(ja);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  parses an ARM_MODEL command and selects the arm model used for kinematics and joint limits
+// ARGUMENTS:    S:  the session
+//               strLine:  A file line string.
+// RETURN VALUE: true if arm model selected, false if not.
+bool setArmModel(SESSION *S, const char *strLine)
+{
+   ARG_VALUE args[NUM_ARGS(ARM_MODEL_ARGS)];       // parsed parameters
+
+   if(!getArguments(S, strLine, ARM_MODEL, ARM_MODEL_ARGS, NUM_ARGS(ARM_MODEL_ARGS), args)) return false;
+
+   S->armModel = &SCARA_MODELS[args[0].i];
+   if(S->preview != NULL) S->preview->SetArmModel(S->armModel);
+   dsprintf(S, "Arm model %s: L1 = %.*lf, L2 = %.*lf, reach %.*lf to %.*lf, |theta1| <= %.1lf%c, "
+            "|theta2| <= %.1lf%c\n", S->armModel->name, PRECISION, S->armModel->L1, PRECISION, S->armModel->L2,
+            PRECISION, S->armModel->LMIN, PRECISION, S->armModel->LMAX, S->armModel->absTheta1DegMax, DEGREE_SYMBOL,
+            S->armModel->absTheta2DegMax, DEGREE_SYMBOL);
+   return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  parses a PATH_TOLERANCE command.  Path points are dropped as long as the tool tip stays within the
+//               tolerance of the original path (see decimateJointPath).  A tolerance of 0 sends every point.
+// ARGUMENTS:    S:  the session
+//               strLine:  A file line string.
+// RETURN VALUE: true if tolerance set, false if not.
+bool setPathTolerance(SESSION *S, const char *strLine)
+{
+   ARG_VALUE args[NUM_ARGS(PATH_TOLERANCE_ARGS)];  // parsed parameters
+
+   if(!getArguments(S, strLine, PATH_TOLERANCE, PATH_TOLERANCE_ARGS, NUM_ARGS(PATH_TOLERANCE_ARGS), args)) return false;
+
+   S->pathTolerance = args[0].d;
+   if(S->pathTolerance > 0.0)
+      dsprintf(S, "Path tolerance %.*lf\n", PRECISION, S->pathTolerance);
+   else
+      dsprintf(S, "Path tolerance off\n");
+   return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  parses a BEZIER_SPACING command.  PARAMETER spaces QUADRATIC_BEZIER points evenly in the curve
+//               parameter t (bunched up where the curve bends sharply), LENGTH evenly along the curve.
+// ARGUMENTS:    S:  the session
+//               strLine:  A file line string.
+// RETURN VALUE: true if spacing set, false if not.
+bool setBezierSpacing(SESSION *S, const char *strLine)
+{
+   ARG_VALUE args[NUM_ARGS(BEZIER_SPACING_ARGS)];  // parsed parameters
+
+   if(!getArguments(S, strLine, BEZIER_SPACING, BEZIER_SPACING_ARGS, NUM_ARGS(BEZIER_SPACING_ARGS), args)) return false;
+
+   S->bezierSpacing = args[0].i;
+   dsprintf(S, "Bezier points spaced evenly in %s\n", args[0].i == BEZIER_SPACING_LENGTH ? "length" : "t");
+   return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  appends points on a straight line to a dynamically allocated path point array.  If the array
+//               already has points, P1 is assumed to be its last point and is not repeated.
+// ARGUMENTS:    pPts, pNP:  path point array and number of points (updated)
+//               P1, P2:  line end points
+//               resolution:  path point density
+// RETURN VALUE: true if ok, false if out of memory
+bool appendLinePoints(TOOL_POSITION **pPts, size_t *pNP, TOOL_POSITION P1, TOOL_POSITION P2, int resolution)
+{
+   size_t NP = getNumPathPoints(sqrt(pow(P2.x - P1.x, 2) + pow(P2.y - P1.y, 2)), resolution);
+   size_t n, n0 = (*pNP > 0 ? 1 : 0);  // point index, first point index to append
+   TOOL_POSITION *pts;                 // resized array
+   double t;                           // line parameter
+
+   pts = (TOOL_POSITION *)realloc(*pPts, (*pNP + NP - n0) * sizeof(TOOL_POSITION));
+   if(pts == NULL) return false;
+
+   for(n = n0; n < NP; n++)
+   {
+      t = (double)n / (double)(NP - 1);
+      pts[*pNP + n - n0].x = P1.x + t * (P2.x - P1.x);
+      pts[*pNP + n - n0].y = P1.y + t * (P2.y - P1.y);
+   }
+
+   *pPts = pts;
+   *pNP += NP - n0;
+   return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  appends points on a circular arc to a dynamically allocated path point array
+// ARGUMENTS:    pPts, pNP:  path point array and number of points (updated)
+//               PC, r:  arc center and radius
+//               ang0Deg, ang1Deg:  start and end angles (degrees)
+//               resolution:  path point density
+// RETURN VALUE: true if ok, false if out of memory
+bool appendArcPoints(TOOL_POSITION **pPts, size_t *pNP, TOOL_POSITION PC, double r, double ang0Deg, double ang1Deg,
+                     int resolution)
+{
+   size_t NP = getNumPathPoints(r * fabs(degToRad(ang1Deg - ang0Deg)), resolution);
+   size_t n;                           // point index
+   TOOL_POSITION *pts;                 // resized array
+   double ang;                         // angle of point (radians)
+
+   pts = (TOOL_POSITION *)realloc(*pPts, (*pNP + NP) * sizeof(TOOL_POSITION));
+   if(pts == NULL) return false;
+
+   for(n = 0; n < NP; n++)
+   {
+      ang = degToRad(ang0Deg + (ang1Deg - ang0Deg) * (double)n / (double)(NP - 1));
+      pts[*pNP + n].x = PC.x + r * cos(ang);
+      pts[*pNP + n].y = PC.y + r * sin(ang);
+   }
+
+   *pPts = pts;
+   *pNP += NP;
+   return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  appends points on a quadratic Bezier curve to a dynamically allocated path point array.
+//               BEZIER_SPACING_PARAMETER steps t evenly by forward differencing:  the curve P0 + 2tB + t^2 A is a
+//               quadratic, so the difference between two points changes by the constant 2h^2 A and every point costs
+//               two additions per coordinate, like a LINE point.  x and y are stepped in two element arrays the
+//               compiler can keep in one vector register.
+//               BEZIER_SPACING_LENGTH spaces the points evenly along the curve:  the t of every point is found by
+//               Newton's method on the closed form arc length, starting from the t of the point before.
+// ARGUMENTS:    pPts, pNP:  path point array and number of points (updated)
+//               P0, P2:  curve end points
+//               P1:  control point
+//               resolution:  path point density
+//               spacing:  BEZIER_SPACING_PARAMETER or BEZIER_SPACING_LENGTH
+// RETURN VALUE: true if ok, false if out of memory
+bool appendQuadraticBezierPoints(TOOL_POSITION **pPts, size_t *pNP, TOOL_POSITION P0, TOOL_POSITION P1,
+                                 TOOL_POSITION P2, int resolution, int spacing)
+{
+   double A[2] = {P0.x - 2.0 * P1.x + P2.x, P0.y - 2.0 * P1.y + P2.y};  // B(t) = P0 + 2tB + t^2 A
+   double B[2] = {P1.x - P0.x, P1.y - P0.y};
+   double len = getQuadraticBezierLengthAt(A, B, 1.0);                 // curve length
+   size_t NP = getNumPathPoints(len, resolution);
+   size_t n;                           // point index
+   int k;                              // coordinate index (x, y)
+   TOOL_POSITION *pts;                 // resized array
+   double h = 1.0 / (double)(NP - 1);  // t step
+   double p[2] = {P0.x, P0.y};         // point
+   double d[2], dd[2];                 // first and second forward differences
+   double t = 0.0, tLo, tHi;           // bezier parameter, bracket of the t searched for
+   double s, err, speed;               // arc length wanted, arc length error, |dB/dt|
+   int it;                             // Newton iteration
+
+   pts = (TOOL_POSITION *)realloc(*pPts, (*pNP + NP) * sizeof(TOOL_POSITION));
+   if(pts == NULL) return false;
+   pts += *pNP;
+
+   if(spacing == BEZIER_SPACING_LENGTH && len > 0.0)
+   {
+      for(n = 0; n < NP - 1; n++)
+      {
+         s = len * (double)n / (double)(NP - 1);
+         tLo = t;                      // t of the point before
+         tHi = 1.0;
+         speed = 2.0 * sqrt(pow(B[0] + t * A[0], 2) + pow(B[1] + t * A[1], 2));
+         if(n > 0) t = speed > 0.0 ? min(t + len * h / speed, 1.0) : 0.5 * (tLo + tHi);
+         for(it = 0; it < 50; it++)
+         {
+            err = getQuadraticBezierLengthAt(A, B, t) - s;
+            if(fabs(err) <= 1.0e-9 * len) break;
+            if(err < 0.0) tLo = t; else tHi = t;
+            speed = 2.0 * sqrt(pow(B[0] + t * A[0], 2) + pow(B[1] + t * A[1], 2));
+            t = speed > 0.0 ? t - err / speed : tHi;
+            if(t <= tLo || t >= tHi) t = 0.5 * (tLo + tHi);  // Newton left the bracket (cusp):  bisect
+         }
+         pts[n].x = P0.x + t * (2.0 * B[0] + t * A[0]);
+         pts[n].y = P0.y + t * (2.0 * B[1] + t * A[1]);
+      }
+   }
+   else
+   {
+      for(k = 0; k < 2; k++)
+      {
+         dd[k] = 2.0 * h * h * A[k];
+         d[k] = 2.0 * h * B[k] + h * h * A[k];
+      }
+      for(n = 0; n < NP - 1; n++)
+      {
+         pts[n].x = p[0];
+         pts[n].y = p[1];
+         for(k = 0; k < 2; k++)
+         {
+            p[k] += d[k];
+            d[k] += dd[k];
+         }
+      }
+   }
+   pts[NP - 1] = P2;  // exact end point (no rounding error carried along the curve)
+
+   *pPts = pts - *pNP;
+   *pNP += NP;
+   return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  transforms the path points and computes the left and right arm joint angles for every point
+// ARGUMENTS:    S:  the session
+//               pts:  path points (not transformed)
+//               NP:  number of path points
+//               TM:  the transform matrix
+//               path:  receives the joint path.  Free with freeJointPath.
+// RETURN VALUE: true if ok, false if out of memory
+bool expandJointPath(SESSION *S, const TOOL_POSITION *pts, size_t NP, const double TM[][3], JOINT_PATH *path)
+{
+   INVERSE_SOLUTION isol;                      // inverse kinematics solution for one point
+   int arm;                                    // arm index
+   size_t n;                                   // point index
+
+   path->NP = NP;
+   path->tpts = (TOOL_POSITION *)malloc(NP * sizeof(TOOL_POSITION));
+   path->ja[LEFT] = (JOINT_ANGLES *)malloc(NP * sizeof(JOINT_ANGLES));
+   path->ja[RIGHT] = (JOINT_ANGLES *)malloc(NP * sizeof(JOINT_ANGLES));
+   if(NP == 0 || path->tpts == NULL || path->ja[LEFT] == NULL || path->ja[RIGHT] == NULL)
+   {
+      dsprintf(S, "Out of memory! (expandJointPath)\n\n");
+      freeJointPath(path);
+      return false;
+   }
+
+   for(arm = LEFT; arm <= RIGHT; arm++)
+   {
+      path->pathCheck.bCanDraw[arm] = true;
+      path->pathCheck.dThetaDeg[arm] = 0.0;
+   }
+   for(n = 0; n < NP; n++)
+   {
+      path->tpts[n] = transform(TM, pts[n]);
+      isol = inverseKinematics(S, path->tpts[n]);
+      for(arm = LEFT; arm <= RIGHT; arm++)
+      {
+         path->ja[arm][n] = isol.jointAngles[arm];
+         if(!isol.bCanReach[arm]) path->pathCheck.bCanDraw[arm] = false;
+         if(n > 0 && path->pathCheck.bCanDraw[arm])
+         {
+            path->pathCheck.dThetaDeg[arm] += fabs(path->ja[arm][n].theta1Deg - path->ja[arm][n - 1].theta1Deg)
+                                            + fabs(path->ja[arm][n].theta2Deg - path->ja[arm][n - 1].theta2Deg);
+         }
+      }
+   }
+
+   return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  draws a joint path with the arm configuration that needs the least total joint rotation (including
+//               the move from the current robot angles to the start of the path).  A path that neither arm
+//               configuration can draw on its own is split between them (see drawSplitJointPath).
+// ARGUMENTS:    S:  the session
+//               path:  the joint path
+// RETURN VALUE: true if path drawn, false if robot can't draw it
+bool drawJointPath(SESSION *S, const JOINT_PATH *path)
+{
+   JOINT_ANGLES current;                       // current robot angles
+   double dThetaDeg[2];                        // total joint rotation for each arm
+   int arm, bestArm = -1;                      // arm index, arm used to draw
+   size_t NK;                                  // number of points sent
+
+   robotAngles(S, &current, GET_CURRENT_ANGLES);
+   for(arm = LEFT; arm <= RIGHT; arm++)
+   {
+      if(!path->pathCheck.bCanDraw[arm]) continue;
+
+      dThetaDeg[arm] = fabs(path->ja[arm][0].theta1Deg - current.theta1Deg)
+                     + fabs(path->ja[arm][0].theta2Deg - current.theta2Deg) + path->pathCheck.dThetaDeg[arm];
+      if(bestArm < 0 || dThetaDeg[arm] < dThetaDeg[bestArm]) bestArm = arm;
+   }
+
+   if(bestArm < 0) return drawSplitJointPath(S, path, current);
+
+   NK = sendJointPathSegment(S, path, bestArm, 0, path->NP);
+   if(NK < path->NP)
+      dsprintf(S, "Drawing %u of %u points with %s arm (%.*lf%c total joint rotation)\n", (unsigned)NK,
+               (unsigned)path->NP, strArms[bestArm], PRECISION, dThetaDeg[bestArm], DEGREE_SYMBOL);
+   else
+      dsprintf(S, "Drawing %u points with %s arm (%.*lf%c total joint rotation)\n", (unsigned)path->NP,
+               strArms[bestArm], PRECISION, dThetaDeg[bestArm], DEGREE_SYMBOL);
+   return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  draws a path that neither arm configuration can draw on its own (e.g. one that runs along the edge
+//               of the workspace) as segments drawn with alternating arms.  Between segments the pen is lifted and
+//               the arm flips to the other configuration at the same tool position.
+// ARGUMENTS:    S:  the session
+//               path:  the joint path
+//               current:  current robot angles
+// RETURN VALUE: true if path drawn, false if some point can't be reached with either arm
+bool drawSplitJointPath(SESSION *S, const JOINT_PATH *path, JOINT_ANGLES current)
+{
+   size_t *segStart;                           // first point of every segment
+   int *segArm;                                // arm of every segment
+   size_t numSegs, seg, first, last;           // number of segments, segment index, segment end points
+   double dThetaDeg;                           // total joint rotation
 
-   // Got token.  Check if token is "ON" or "OFF"
-   if(strcmp(tok, "ON") != 0 && strcmp(tok, "OFF") != 0)
+   segStart = (size_t *)malloc(path->NP * sizeof(size_t));
+   segArm = (int *)malloc(path->NP * sizeof(int));
+   if(segStart == NULL || segArm == NULL)
    {
-      dsprintf("Invalid parameter for CYCLE_PEN_COLORS!  Must be ON or OFF.\n\n");
+      dsprintf(S, "Out of memory! (drawSplitJointPath)\n\n");
+      free(segStart);
+      free(segArm);
       return false;
    }
 
-   // all good.  Send command.
-   sprintf_s(cmd, COMMAND_STRING_ARRAY_SIZE, "CYCLE_PEN_COLORS %s\n", tok);
-   robot.Send(cmd);
+   numSegs = planArmSegments(S, path, current, segStart, segArm, &dThetaDeg);
+   if(numSegs == 0)
+   {
+      dsprintf(S, "Robot cannot draw the path with either arm configuration!\n\n");
+      free(segStart);
+      free(segArm);
+      return false;
+   }
+
+   dsprintf(S, "Drawing %u points in %u segments with %u arm flips (%.*lf%c total joint rotation)\n",
+            (unsigned)path->NP, (unsigned)numSegs, (unsigned)(numSegs - 1), PRECISION, dThetaDeg, DEGREE_SYMBOL);
+   for(seg = 0; seg < numSegs; seg++)
+   {
+      first = segStart[seg];
+      last = (seg + 1 < numSegs ? segStart[seg + 1] : path->NP - 1);
+      dsprintf(S, "   points %u to %u with %s arm\n", (unsigned)first + 1, (unsigned)last + 1, strArms[segArm[seg]]);
+      sendJointPathSegment(S, path, segArm[seg], first, last - first + 1);
+   }
+
+   free(segStart);
+   free(segArm);
    return true;
 }
 
 //---------------------------------------------------------------------------------------------------------------------
-// DESCRIPTION:  get or update current robot shoulder and elbow angles
-// ARGUMENTS:    pAngles:  shoulder/joint angles.
-//               getOrUpdate:  set to UPDATE_CURRENT_ANGLES to update the current angles
-//                             set to GET_CURRENT_ANGLES to retrieve the current angles
-// RETURN VALUE: none
-void robotAngles(JOINT_ANGLES *pAngles, int getOrUpdate)
+// DESCRIPTION:  splits a path into the fewest segments that can each be drawn with one arm configuration, and of
+//               those splits the one with the least total joint rotation (lead-in, path and flips).  Dynamic
+//               programming over (point, arm): the arm can flip at any point both configurations reach, and the
+//               next segment starts at that point.
+// ARGUMENTS:    S:  the session
+//               path:  the joint path
+//               current:  current robot angles
+//               segStart, segArm:  receive the first point and the arm of every segment (path->NP entries)
+//               dThetaDeg:  receives the total joint rotation
+// RETURN VALUE: number of segments, 0 if some point can't be reached with either arm
+size_t planArmSegments(SESSION *S, const JOINT_PATH *path, JOINT_ANGLES current, size_t *segStart, int *segArm,
+                       double *dThetaDeg)
 {
-   static JOINT_ANGLES currentAngles = {0.0, 0.0};   // NOTE:  robot must be in home position when program starts!
+   size_t NP = path->NP;                       // number of points
+   int *flips;                                 // flips to reach [arm * NP + n] (before flipping at n)
+   double *travel;                             // joint rotation to reach [arm * NP + n] (before flipping at n)
+   bool *bFlipped;                             // true if the best way to leave [arm * NP + n] is flipped from the
+                                               // other arm at n
+   int *flipsOut;                              // flips when leaving [arm * NP + n]
+   double *travelOut;                          // joint rotation when leaving [arm * NP + n]
+   size_t n, numSegs = 0, seg;                 // point index, number of segments, segment index
+   int arm, other, bestArm;                    // arm indexes
+   double flip;                                // joint rotation of a flip
 
-   if(pAngles == NULL) // safety
+   flips = (int *)malloc(2 * NP * sizeof(int));
+   flipsOut = (int *)malloc(2 * NP * sizeof(int));
+   travel = (double *)malloc(2 * NP * sizeof(double));
+   travelOut = (double *)malloc(2 * NP * sizeof(double));
+   bFlipped = (bool *)malloc(2 * NP * sizeof(bool));
+   if(flips == NULL || flipsOut == NULL || travel == NULL || travelOut == NULL || bFlipped == NULL)
    {
-      dsprintf("NULL JOINT_ANGLES pointer! (robotAngles)");
-      return;
+      free(flips); free(flipsOut); free(travel); free(travelOut); free(bFlipped);
+      return 0;
    }
 
-   if(getOrUpdate == UPDATE_CURRENT_ANGLES)
-      currentAngles = *pAngles;
-   else if(getOrUpdate == GET_CURRENT_ANGLES)
-      *pAngles = currentAngles;
-   else
-      dsprintf("Unknown value for getOrUpdate (robotAngles)");
+   for(n = 0; n < NP; n++)
+   {
+      // arrive at point n with each arm
+      for(arm = LEFT; arm <= RIGHT; arm++)
+      {
+         const JOINT_ANGLES *ja = path->ja[arm];
+         flips[arm * NP + n] = INT_MAX;
+         if(!isJointReachable(S, ja[n])) continue;
+
+         if(n == 0)
+         {
+            flips[arm * NP] = 0;
+            travel[arm * NP] = fabs(ja[0].theta1Deg - current.theta1Deg) + fabs(ja[0].theta2Deg - current.theta2Deg);
+         }
+         else if(flipsOut[arm * NP + n - 1] != INT_MAX)
+         {
+            flips[arm * NP + n] = flipsOut[arm * NP + n - 1];
+            travel[arm * NP + n] = travelOut[arm * NP + n - 1] + fabs(ja[n].theta1Deg - ja[n - 1].theta1Deg)
+                                 + fabs(ja[n].theta2Deg - ja[n - 1].theta2Deg);
+         }
+      }
+
+      // leave point n with each arm, flipping from the other arm if that is better
+      flip = fabs(path->ja[LEFT][n].theta1Deg - path->ja[RIGHT][n].theta1Deg)
+           + fabs(path->ja[LEFT][n].theta2Deg - path->ja[RIGHT][n].theta2Deg);
+      for(arm = LEFT; arm <= RIGHT; arm++)
+      {
+         other = 1 - arm;
+         flipsOut[arm * NP + n] = flips[arm * NP + n];
+         travelOut[arm * NP + n] = travel[arm * NP + n];
+         bFlipped[arm * NP + n] = false;
+         if(!isJointReachable(S, path->ja[arm][n]) || flips[other * NP + n] == INT_MAX) continue;
+
+         if(flips[other * NP + n] + 1 < flips[arm * NP + n]
+            || (flips[other * NP + n] + 1 == flips[arm * NP + n]
+                && travel[other * NP + n] + flip < travel[arm * NP + n]))
+         {
+            flipsOut[arm * NP + n] = flips[other * NP + n] + 1;
+            travelOut[arm * NP + n] = travel[other * NP + n] + flip;
+            bFlipped[arm * NP + n] = true;
+         }
+      }
+   }
+
+   // best arm at the last point
+   bestArm = -1;
+   for(arm = LEFT; arm <= RIGHT; arm++)
+   {
+      if(flips[arm * NP + NP - 1] == INT_MAX) continue;
+      if(bestArm < 0 || flips[arm * NP + NP - 1] < flips[bestArm * NP + NP - 1]
+         || (flips[arm * NP + NP - 1] == flips[bestArm * NP + NP - 1]
+             && travel[arm * NP + NP - 1] < travel[bestArm * NP + NP - 1]))
+         bestArm = arm;
+   }
+
+   if(bestArm >= 0)
+   {
+      // walk back recording where the arm flipped.  The segments come out last first.
+      *dThetaDeg = travel[bestArm * NP + NP - 1];
+      arm = bestArm;
+      segArm[numSegs] = arm;
+      for(n = NP - 1; n > 0; n--)
+      {
+         if(bFlipped[arm * NP + n - 1])
+         {
+            segStart[numSegs++] = n - 1;
+            arm = 1 - arm;
+            segArm[numSegs] = arm;
+         }
+      }
+      segStart[numSegs++] = 0;
+
+      for(seg = 0; seg < numSegs / 2; seg++)
+      {
+         n = segStart[seg];
+         segStart[seg] = segStart[numSegs - 1 - seg];
+         segStart[numSegs - 1 - seg] = n;
+         arm = segArm[seg];
+         segArm[seg] = segArm[numSegs - 1 - seg];
+         segArm[numSegs - 1 - seg] = arm;
+      }
+   }
+
+   free(flips); free(flipsOut); free(travel); free(travelOut); free(bFlipped);
+   return numSegs;
 }
 
 //---------------------------------------------------------------------------------------------------------------------
-// DESCRIPTION:  Pauses the robot then clears everthing after user presses ENTER
-// ARGUMENTS:    none
-// RETURN VALUE: none
-void pauseRobotThenClear()
+// DESCRIPTION:  checks joint angles against the limits of the arm model (ERROR_VALUE angles fail)
+// ARGUMENTS:    S:  the session
+//               ja:  joint angles (degrees)
+// RETURN VALUE: true if the angles are within the limits
+bool isJointReachable(SESSION *S, JOINT_ANGLES ja)
 {
-   waitForEnterKey();
-   system("cls");
-   robot.Send("HOME\n");
-   robot.Send("CLEAR_TRACE\n");
-   robot.Send("PEN_COLOR 0 0 255\n");
-   robot.Send("CLEAR_REMOTE_COMMAND_LOG\n");
-   robot.Send("CLEAR_POSITION_LOG\n");
+   return fabs(ja.theta1Deg) <= S->armModel->absTheta1DegMax && fabs(ja.theta2Deg) <= S->armModel->absTheta2DegMax;
 }
 
 //---------------------------------------------------------------------------------------------------------------------
-// DESCRIPTION:  Maps an angle in radians into a an equivalent angle understood by the robot (-PI <= ang <= +PI)
-// ARGUMENTS:    ang: the angle in radians 
-// RETURN VALUE: the mapped angle in radians
-double mapAngle(double angRad)
+// DESCRIPTION:  sends part of a joint path with one arm configuration, dropping the points that PATH_TOLERANCE
+//               allows (see decimateJointPath)
+// ARGUMENTS:    S:  the session
+//               path:  the joint path
+//               arm:  arm configuration
+//               first, NP:  first point and number of points to send
+// RETURN VALUE: number of points sent
+size_t sendJointPathSegment(SESSION *S, const JOINT_PATH *path, int arm, size_t first, size_t NP)
 {
-   angRad = fmod(angRad, 2.0 * PI);  // put in range -2*PI <= ang <= +2*PI
+   const TOOL_POSITION *tpts = path->tpts + first;  // tool positions of the segment
+   const JOINT_ANGLES *ja = path->ja[arm] + first;  // joint angles of the segment
+   size_t *keep = NULL;                        // indexes of the points kept by decimation
+   TOOL_POSITION *tptsK = NULL;                // kept tool positions
+   JOINT_ANGLES *jaK = NULL;                   // kept joint angles
+   size_t n, NK = NP;                          // point index, number of points kept
 
-   // map into range -PI <= ang <= +PI
-   if(angRad > PI)
-      angRad -= 2.0 * PI;
-   else if(angRad < -PI)
-      angRad += 2.0 * PI;
+   // drop the points that the joint motion between their neighbours already passes close enough to
+   if(S->pathTolerance > 0.0 && NP > 2)
+   {
+      keep = (size_t *)malloc(NP * sizeof(size_t));
+      tptsK = (TOOL_POSITION *)malloc(NP * sizeof(TOOL_POSITION));
+      jaK = (JOINT_ANGLES *)malloc(NP * sizeof(JOINT_ANGLES));
+      if(keep != NULL && tptsK != NULL && jaK != NULL)
+      {
+         NK = decimateJointPath(S, tpts, ja, NP, S->pathTolerance, keep);
+         for(n = 0; n < NK; n++)
+         {
+            tptsK[n] = tpts[keep[n]];
+            jaK[n] = ja[keep[n]];
+         }
+      }
+   }
 
-   return angRad;
+   if(NK < NP)
+      sendJointPath(S, tptsK, jaK, NK);
+   else
+      sendJointPath(S, tpts, ja, NP);
+   S->numPointsDrawn += (unsigned long)NK;
+
+   free(keep);
+   free(tptsK);
+   free(jaK);
+   return NK;
 }
 
 //---------------------------------------------------------------------------------------------------------------------
-// DESCRIPTION:  Returns angle in degrees from input angle in radian
-// ARGUMENTS:    angDeg:  angle in degrees
-// RETURN VALUE: angle in radians
-double degToRad(double angDeg)
+// DESCRIPTION:  frees the memory of a joint path
+// ARGUMENTS:    path:  the joint path
+// RETURN VALUE: none
+void freeJointPath(JOINT_PATH *path)
 {
-   return (PI / 180.0) * angDeg;
+   free(path->tpts);
+   free(path->ja[LEFT]);
+   free(path->ja[RIGHT]);
+   path->tpts = NULL;
+   path->ja[LEFT] = path->ja[RIGHT] = NULL;
+   path->NP = 0;
 }
 
 //---------------------------------------------------------------------------------------------------------------------
-// DESCRIPTION:  Returns angle in radians from input angle in degrees
-// ARGUMENTS:    angRad:  angle in radians
-// RETURN VALUE: angle in degrees
-double radToDeg(double angRad)
+// DESCRIPTION:  finds an expanded path in the path cache and marks it most recently used
+// ARGUMENTS:    S:  the session
+//               key:  the path key
+// RETURN VALUE: the cached path, NULL if not in the cache
+const JOINT_PATH *pathCacheFind(SESSION *S, const PATH_KEY *key)
 {
-   return (180.0 / PI) * angRad;
+   int n;  // entry index
+
+   S->pathCache.useCount++;
+   for(n = 0; n < PATH_CACHE_SIZE; n++)
+   {
+      if(S->pathCache.lastUsed[n] != 0 && memcmp(&S->pathCache.keys[n], key, sizeof(PATH_KEY)) == 0)
+      {
+         S->pathCache.lastUsed[n] = S->pathCache.useCount;
+         S->pathCache.hits++;
+         return &S->pathCache.paths[n];
+      }
+   }
+
+   S->pathCache.misses++;
+   return NULL;
 }
 
 //---------------------------------------------------------------------------------------------------------------------
-// DESCRIPTION:  This function flushes the input buffer to avoid scanf issues
-// ARGUMENTS:    none
-// RETURN VALUE: false if nothing or only '\n' in stdin. true if extra keystrokes precede the '\n'.
-//               Good for detecting left over garbage from scanf_s in the input buffer
-bool flushInputBuffer()
+// DESCRIPTION:  moves an expanded path into the path cache.  The least recently used entry is dropped if the cache
+//               is full.  The cache owns the path memory afterwards.
+// ARGUMENTS:    S:  the session
+//               key:  the path key
+//               path:  the expanded path
+// RETURN VALUE: the cached path
+const JOINT_PATH *pathCacheInsert(SESSION *S, const PATH_KEY *key, JOINT_PATH *path)
 {
-   int ch; // temp character variable
-   bool bHasGarbage = false;
+   int n, oldest = 0;  // entry index, least recently used entry
 
-   // exit loop when all characters are flushed
-   while((ch = getchar()) != '\n' && ch != EOF)
+   for(n = 1; n < PATH_CACHE_SIZE; n++)
    {
-      if(!bHasGarbage) bHasGarbage = true;
+      if(S->pathCache.lastUsed[n] < S->pathCache.lastUsed[oldest]) oldest = n;
    }
-   return bHasGarbage;
+
+   if(S->pathCache.lastUsed[oldest] != 0)
+   {
+      freeJointPath(&S->pathCache.paths[oldest]);
+      S->pathCache.evictions++;
+   }
+
+   S->pathCache.keys[oldest] = *key;
+   S->pathCache.paths[oldest] = *path;
+   S->pathCache.lastUsed[oldest] = S->pathCache.useCount;
+   return &S->pathCache.paths[oldest];
 }
 
 //---------------------------------------------------------------------------------------------------------------------
-// DESCRIPTION:  Waits for user to press enter.  flushes stdin if keystrokes precede enter
-// ARGUMENTS:    none
+// DESCRIPTION:  empties the path cache and prints its hit/miss statistics
+// ARGUMENTS:    S:  the session
 // RETURN VALUE: none
-void waitForEnterKey()
+void pathCacheClear(SESSION *S)
 {
-   int ch;
-   if((ch = getchar()) != EOF && ch != '\n') flushInputBuffer();
-}
+   unsigned long lookups = S->pathCache.hits + S->pathCache.misses;    // number of cache lookups
+   int n;                                                       // entry index
 
-//---------------------------------------------------------------------------------------------------------------------
-// DESCRIPTION:  computes nearest integer to given double
-// ARGUMENTS:    d: double value
-// RETURN VALUE: nearest int
-int nint(double d)
-{
-   return (int)floor(d + 0.5);
+   if(lookups > 0)
+   {
+      dsprintf(S, "Path cache: %lu hits, %lu misses, %lu evictions (%.1lf%% hit rate)\n", S->pathCache.hits,
+               S->pathCache.misses, S->pathCache.evictions, 100.0 * (double)S->pathCache.hits / (double)lookups);
+   }
+
+   for(n = 0; n < PATH_CACHE_SIZE; n++)
+   {
+      if(S->pathCache.lastUsed[n] != 0) freeJointPath(&S->pathCache.paths[n]);
+   }
+   memset(&S->pathCache, 0, sizeof(S->pathCache));
 }
 
 //---------------------------------------------------------------------------------------------------------------------
-// DESCRIPTION:  print a solid line to the console
-// ARGUMENTS:    length of line in characters
+// DESCRIPTION:  sends a path to the robot.  Moves to the first point with the pen up, draws the rest of the points
+//               with the pen down, then lifts the pen.  If automatic motor speed is on, the pen up move runs at HIGH
+//               speed and every drawn segment runs at the speed chosen by scheduleMotorSpeeds.
+// ARGUMENTS:    S:  the session
+//               tpts:  transformed path points
+//               ja:  joint angles for every path point
+//               NP:  number of path points
 // RETURN VALUE: none
-void printHLine(int N)
+void sendJointPath(SESSION *S, const TOOL_POSITION *tpts, const JOINT_ANGLES *ja, size_t NP)
 {
-   int n;
+   MOTOR_SPEED_STATE mss;   // motor speed state
+   int *speeds = NULL;      // motor speed for every path segment
+   size_t n;                // point index
 
-   for(n = 0; n < N; n++)
+   robotMotorSpeed(S, &mss, GET_CURRENT_STATE);
+   if(mss.bAuto && NP > 1)
    {
-      // can't use dsprintf because characters are different because code pages are different
-      // console = code page 437, file = code page 1252
-      printf("%c", HL);
-      fprintf(flog, "%c", FHL);
+      speeds = (int *)malloc((NP - 1) * sizeof(int));
+      if(speeds != NULL) scheduleMotorSpeeds(tpts, ja, NP, &mss, &S->timing, MOTOR_SPEED_HIGH, speeds);
+   }
+
+   if(S->robot.HasTrajectoryBlocks())
+   {
+      sendJointPathBlocks(S, ja, NP, mss.bAuto, speeds);
+   }
+   else
+   {
+      sendPenPosition(S, PEN_UP);
+      if(mss.bAuto) sendMotorSpeed(S, MOTOR_SPEED_HIGH);
+      sendRotateJoint(S, ja[0]);
+      sendPenPosition(S, PEN_DOWN);
+
+      for(n = 1; n < NP; n++)
+      {
+         if(speeds != NULL) sendMotorSpeed(S, speeds[n - 1]);
+         sendRotateJoint(S, ja[n]);
+      }
+
+      sendPenPosition(S, PEN_UP);
    }
-   dsprintf("\n");
+   free(speeds);
 }
 
 //---------------------------------------------------------------------------------------------------------------------
-// DESCRIPTION:  makes a string all upper case characters
-// ARGUMENTS:    str:  the string memory address
+// DESCRIPTION:  sends a pen down joint path as trajectory blocks (see trajblock.h) instead of one command per point:
+//               the same PEN_UP, MOTOR_SPEED, ROTATE_JOINT and PEN_DOWN commands as sendJointPath, in as few sends
+//               as fit TRAJ_BLOCK_MAX_BYTES.  Only for a robot that accepted the extension.
+// ARGUMENTS:    S:  the session
+//               ja, NP:  joint angles of the path, number of points
+//               bAuto:  true if the motor speed is chosen automatically (the first move is at HIGH)
+//               speeds:  motor speed of every segment (NULL to keep the speed)
 // RETURN VALUE: none
-void makeStringUpperCase(char *str)
+void sendJointPathBlocks(SESSION *S, const JOINT_ANGLES *ja, size_t NP, bool bAuto, const int *speeds)
 {
-   if(str == NULL) return; // safety!
+   MOTOR_SPEED_STATE mss;   // motor speed state
+   CTrajectoryBlock block;  // commands not sent yet
+   std::string wire;        // a block as it is sent
+   JOINT_ANGLES last;       // where the path ends
+   size_t n;                // point index
+   int len;                 // bytes of a block
 
-   for(size_t i = 0; i < strlen(str); i++) str[i] = (char)toupper(str[i]);
+   robotMotorSpeed(S, &mss, GET_CURRENT_STATE);
+   block.PenUp();
+   if(bAuto && mss.currentSpeed != MOTOR_SPEED_HIGH) block.Speed(mss.currentSpeed = MOTOR_SPEED_HIGH);
+   block.Move(ja[0].theta1Deg, ja[0].theta2Deg);
+   block.PenDown();
+
+   for(n = 1; n < NP; n++)
+   {
+      if(block.IsFull())
+      {
+         len = block.Build(&wire);
+         S->robot.Send(wire.c_str(), len);
+         block.Clear();
+      }
+      if(speeds != NULL && speeds[n - 1] != mss.currentSpeed) block.Speed(mss.currentSpeed = speeds[n - 1]);
+      block.Move(ja[n].theta1Deg, ja[n].theta2Deg);
+   }
+   block.PenUp();
+   len = block.Build(&wire);
+   S->robot.Send(wire.c_str(), len);
+
+   robotMotorSpeed(S, &mss, UPDATE_CURRENT_STATE);
+   last = ja[NP - 1];
+   robotAngles(S, &last, UPDATE_CURRENT_ANGLES);
+   S->pen.penPos = PEN_UP;
 }
 
 //---------------------------------------------------------------------------------------------------------------------
-// DESCRIPTION:  prints to both a file and to the console
-// ARGUMENTS:    f:  the file handle
-//               fmt, ...: for variable number of parameters
-// RETURN VALUE: the number of characters printed
-int dsprintf(char const *fmt, ...)
+// DESCRIPTION:  Douglas-Peucker simplification of a joint path.  The robot moves both joints linearly between
+//               ROTATE_JOINT waypoints, so dropping the points between ja[i] and ja[j] makes the tool tip follow the
+//               forward kinematics of the straight joint space move from ja[i] to ja[j].  Points are dropped as
+//               long as that curve stays within the tolerance of the original tool path.
+// ARGUMENTS:    S:  the session
+//               tpts, ja, NP:  tool positions and joint angles of the path, number of points
+//               tolerance:  largest tool tip error allowed
+//               keep:  receives the indexes of the points kept (NP entries, first and last always kept)
+// RETURN VALUE: number of points kept
+size_t decimateJointPath(SESSION *S, const TOOL_POSITION *tpts, const JOINT_ANGLES *ja, size_t NP, double tolerance,
+                         size_t *keep)
 {
-   va_list args;
-   int n1 = -1, n2 = -1;
+   bool *bKeep;                        // true for every point kept
+   size_t *stack;                      // segments still to check (pairs of point indexes)
+   size_t top = 0;                     // number of indexes on the stack
+   size_t i, j, k, n, NK = 0;          // segment end indexes, worst point, point index, number kept
 
-   if(flog != NULL)
+   bKeep = (bool *)calloc(NP, sizeof(bool));
+   stack = (size_t *)malloc(2 * NP * sizeof(size_t));
+   if(bKeep == NULL || stack == NULL)
    {
-      va_start(args, fmt);
-      n1 = vfprintf(flog, fmt, args);
-      va_end(args);
+      for(n = 0; n < NP; n++) keep[n] = n;  // out of memory.  Keep everything.
+      free(bKeep);
+      free(stack);
+      return NP;
    }
-   va_start(args, fmt);
-   n2 = vfprintf(stdout, fmt, args);
-   va_end(args);
 
-   if(n2 < n1) n1 = n2;
-   return n1;
+   bKeep[0] = bKeep[NP - 1] = true;
+   stack[top++] = 0;
+   stack[top++] = NP - 1;
+   while(top > 0)
+   {
+      j = stack[--top];
+      i = stack[--top];
+      if(j - i < 2) continue;
+
+      if(getJointSegmentError(S, tpts, ja, i, j, &k) > tolerance)
+      {
+         bKeep[k] = true;
+         stack[top++] = i;
+         stack[top++] = k;
+         stack[top++] = k;
+         stack[top++] = j;
+      }
+   }
+
+   for(n = 0; n < NP; n++)
+   {
+      if(bKeep[n]) keep[NK++] = n;
+   }
+   free(bKeep);
+   free(stack);
+   return NK;
 }
+
 //---------------------------------------------------------------------------------------------------------------------
-// DESCRIPTION:  Gets the number of points to check/draw a path based on the length of the path and a resolution value
-// ARGUMENTS:    len:  The arc length of the path
-//               resolution:  a parameter that determines the density of points on a path
-// RETURN VALUE: the number of points
-size_t getNumPathPoints(double len, int resolution)
+// DESCRIPTION:  tool tip error of replacing the path points i to j by a single straight joint space move.  The move
+//               is sampled with forward kinematics.  The error is the larger of the distance from every original
+//               point to the sampled move and the distance from every sample to the original tool path.
+// ARGUMENTS:    S:  the session
+//               tpts, ja:  tool positions and joint angles of the path
+//               i, j:  first and last point of the move (j > i + 1)
+//               kWorst:  receives the point strictly between i and j to split at if the error is too big
+// RETURN VALUE: the error
+double getJointSegmentError(SESSION *S, const TOOL_POSITION *tpts, const JOINT_ANGLES *ja, size_t i, size_t j,
+                            size_t *kWorst)
 {
-   size_t NP;  // number of points used to check/draw the path points
+   const size_t MAX_SAMPLES = 64;      // most forward kinematics samples per move
+   TOOL_POSITION samples[MAX_SAMPLES + 1]; // tool tip along the move
+   JOINT_ANGLES jat;                   // joint angles along the move
+   size_t NS, s, k;                    // number of sample intervals, sample index, point index
+   double t, d, dMin, error = 0.0, worst = -1.0;
 
-   if(resolution == RESOLUTION_LOW)
-      NP = (size_t)nint((len / 500.0) * (double)LOW_RESOLUTION_POINTS_PER_500_UNITS);
-   else if(resolution == RESOLUTION_MEDIUM)
-      NP = (size_t)nint((len / 500.0) * (double)MEDIUM_RESOLUTION_POINTS_PER_500_UNITS);
-   else
-      NP = (size_t)nint((len / 500.0) * (double)HIGH_RESOLUTION_POINTS_PER_500_UNITS);
+   NS = 2 * (j - i);
+   if(NS > MAX_SAMPLES) NS = MAX_SAMPLES;
+   for(s = 0; s <= NS; s++)
+   {
+      t = (double)s / NS;
+      jat.theta1Deg = ja[i].theta1Deg + t * (ja[j].theta1Deg - ja[i].theta1Deg);
+      jat.theta2Deg = ja[i].theta2Deg + t * (ja[j].theta2Deg - ja[i].theta2Deg);
+      samples[s] = forwardKinematics(S, jat).toolPos;
+   }
 
-   NP = max(NP, 2);  //safety
+   // original points to the move.  The worst of these is where the path is split.
+   *kWorst = (i + j) / 2;
+   for(k = i + 1; k < j; k++)
+   {
+      dMin = DBL_MAX;
+      for(s = 0; s < NS; s++)
+      {
+         d = pointToSegmentDistance(tpts[k], samples[s], samples[s + 1]);
+         if(d < dMin) dMin = d;
+      }
+      if(dMin > worst)
+      {
+         worst = dMin;
+         *kWorst = k;
+      }
+   }
+   error = worst;
 
-   return NP;
+   // move to the original path (catches a move that bulges out between points that are all close to it)
+   for(s = 1; s < NS; s++)
+   {
+      dMin = DBL_MAX;
+      for(k = i; k < j; k++)
+      {
+         d = pointToSegmentDistance(samples[s], tpts[k], tpts[k + 1]);
+         if(d < dMin) dMin = d;
+      }
+      if(dMin > error) error = dMin;
+   }
+   return error;
 }
 
-int getCommandIndex(const char *strLine)
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  distance from a point to a line segment
+// ARGUMENTS:    p:  the point
+//               a, b:  segment end points
+// RETURN VALUE: the distance
+double pointToSegmentDistance(TOOL_POSITION p, TOOL_POSITION a, TOOL_POSITION b)
 {
-   char *tok = NULL, *nextTok = NULL;
-   char strLineCopy[MAX_LINE_SIZE];
+   double dx = b.x - a.x, dy = b.y - a.y;  // segment vector
+   double len2 = dx * dx + dy * dy;         // squared segment length
+   double t = 0.0;                          // closest point parameter
 
-   if(strLine == NULL || strlen(strLine) == 0)
+   if(len2 > 0.0)
    {
-      return BLANK_LINE;
+      t = ((p.x - a.x) * dx + (p.y - a.y) * dy) / len2;
+      if(t < 0.0) t = 0.0;
+      if(t > 1.0) t = 1.0;
    }
+   return hypot(p.x - (a.x + t * dx), p.y - (a.y + t * dy));
+}
 
-   strcpy_s(strLineCopy, MAX_LINE_SIZE, strLine);
-   tok = strtok_s(strLineCopy, seps, &nextTok);
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  sends a ROTATE_JOINT command to the robot and updates the current robot angles
+// ARGUMENTS:    S:  the session
+//               ja:  joint angles (degrees)
+// RETURN VALUE: none
+void sendRotateJoint(SESSION *S, JOINT_ANGLES ja)
+{
+   char cmd[COMMAND_STRING_ARRAY_SIZE];   // command string
+   CCommandWriter writer(cmd, COMMAND_STRING_ARRAY_SIZE);
 
-   if(tok == NULL)
+   writer.Begin("ROTATE_JOINT").Word("ANG1").Fixed(ja.theta1Deg, 2).Word("ANG2").Fixed(ja.theta2Deg, 2).End();
+   S->robot.Send(cmd, writer.GetLength());
+   robotAngles(S, &ja, UPDATE_CURRENT_ANGLES);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  sends a MOTOR_SPEED command to the robot if the speed is different from the current speed
+// ARGUMENTS:    S:  the session
+//               speed:  MOTOR_SPEED_LOW, MOTOR_SPEED_MEDIUM or MOTOR_SPEED_HIGH
+// RETURN VALUE: none
+void sendMotorSpeed(SESSION *S, int speed)
+{
+   char cmd[COMMAND_STRING_ARRAY_SIZE];   // command string
+   CCommandWriter writer(cmd, COMMAND_STRING_ARRAY_SIZE);
+   MOTOR_SPEED_STATE mss;                 // motor speed state
+
+   robotMotorSpeed(S, &mss, GET_CURRENT_STATE);
+   if(speed == mss.currentSpeed) return;
+
+   writer.Begin("MOTOR_SPEED").Word(strMotorSpeeds[speed]).End();
+   S->robot.Send(cmd, writer.GetLength());
+
+   mss.currentSpeed = speed;
+   robotMotorSpeed(S, &mss, UPDATE_CURRENT_STATE);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  get or update the motor speed state
+// ARGUMENTS:    S:  the session
+//               pState:  motor speed state.
+//               getOrUpdate:  set to UPDATE_CURRENT_STATE to update the state
+//                             set to GET_CURRENT_STATE to retrieve the state
+// RETURN VALUE: none
+void robotMotorSpeed(SESSION *S, MOTOR_SPEED_STATE *pState, int getOrUpdate)
+{
+   if(pState == NULL) // safety
    {
-      return COMMAND_INDEX_NOT_FOUND;
+      dsprintf(S, "NULL MOTOR_SPEED_STATE pointer! (robotMotorSpeed)");
+      return;
    }
 
-   for(int i = 0; i < NUM_COMMANDS; i++)
+   if(getOrUpdate == UPDATE_CURRENT_STATE)
+      S->motorSpeed = *pState;
+   else if(getOrUpdate == GET_CURRENT_STATE)
+      *pState = S->motorSpeed;
+   else
+      dsprintf(S, "Unknown value for getOrUpdate (robotMotorSpeed)");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  returns the largest joint rotation needed to move between two joint positions
+// ARGUMENTS:    ja0, ja1:  joint angles (degrees)
+// RETURN VALUE: largest joint rotation (degrees)
+double getJointStepDeg(JOINT_ANGLES ja0, JOINT_ANGLES ja1)
+{
+   return fmax(fabs(ja1.theta1Deg - ja0.theta1Deg), fabs(ja1.theta2Deg - ja0.theta2Deg));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  chooses a motor speed for every segment of a pen down path.
+//               1) Every segment gets the fastest speed whose predicted tool tip error is within tolerance.  The error
+//                  grows with the joint step of the segment and with how sharply the path turns at its end point:
+//                  error = errorPerDeg[speed] * jointStepDeg * (1 - cos(turnAngle)).
+//                  Straight strokes have no turn and always run at HIGH speed.
+//               2) A run of segments that is faster than its neighbours is slowed down to the neighbour speed when
+//                  the motion time it saves is less than the time cost of the extra MOTOR_SPEED commands (simulator
+//                  command time plus the pacing of the send).
+// ARGUMENTS:    tpts:  transformed path points
+//               ja:  joint angles for every path point
+//               NP:  number of path points
+//               mss:  planner settings (tolerance:  allowed tool tip error, errorPerDeg:  error model)
+//               timing:  simulator joint speeds and command cost (job duration estimator model)
+//               entrySpeed:  motor speed in effect before the first segment
+//               speeds:  receives the motor speed of every segment (NP - 1 values)
+// RETURN VALUE: none
+void scheduleMotorSpeeds(const TOOL_POSITION *tpts, const JOINT_ANGLES *ja, size_t NP, const MOTOR_SPEED_STATE *mss,
+                         const ESTIMATE_MODEL *timing, int entrySpeed, int *speeds)
+{
+   size_t NS = NP - 1;              // number of segments
+   size_t n, r0, r1;                // segment index, run start/end
+   double ax, ay, bx, by, ab;       // segment vectors and length product
+   double turn, stepDeg;            // 1 - cos(turn angle), joint step of segment
+   double timeSaved;                // motion time saved by running a run faster
+   int speed, prevSpeed, nextSpeed, slowSpeed, numChanges;
+   bool bChanged;
+
+   // 1) fastest speed within tolerance for each segment
+   for(n = 0; n < NS; n++)
    {
-      if(strcmp(tok, m_Commands[i].strCommand) == 0)
+      turn = 0.0;
+      if(n + 2 < NP)
       {
-         return m_Commands[i].index;
+         ax = tpts[n + 1].x - tpts[n].x;
+         ay = tpts[n + 1].y - tpts[n].y;
+         bx = tpts[n + 2].x - tpts[n + 1].x;
+         by = tpts[n + 2].y - tpts[n + 1].y;
+         ab = sqrt(ax * ax + ay * ay) * sqrt(bx * bx + by * by);
+         if(ab > 0.0) turn = 1.0 - (ax * bx + ay * by) / ab;
+      }
+
+      stepDeg = getJointStepDeg(ja[n], ja[n + 1]);
+      for(speed = MOTOR_SPEED_HIGH; speed > MOTOR_SPEED_LOW; speed--)
+      {
+         if(mss->errorPerDeg[speed] * stepDeg * turn <= mss->tolerance) break;
       }
+      speeds[n] = speed;
    }
-   return COMMAND_INDEX_NOT_FOUND;
-}
 
-bool setPenColor(const char *strLine)
-{
-   char *tok = NULL, *nextTok = NULL;
-   char strLineCopy[MAX_LINE_SIZE];
+   // 2) remove speed changes that cost more than they save
+   do
+   {
+      bChanged = false;
+      for(r0 = 0; r0 < NS; r0 = r1)
+      {
+         for(r1 = r0 + 1; r1 < NS && speeds[r1] == speeds[r0]; r1++);
 
+         prevSpeed = (r0 == 0 ? entrySpeed : speeds[r0 - 1]);
+         nextSpeed = (r1 == NS ? -1 : speeds[r1]);
 
+         // slow down only to a slower neighbour speed.  Never speed up a run (accuracy).
+         slowSpeed = -1;
+         if(prevSpeed < speeds[r0]) slowSpeed = prevSpeed;
+         if(nextSpeed < speeds[r0] && nextSpeed > slowSpeed) slowSpeed = nextSpeed;
+         if(slowSpeed < 0) continue;
 
-}
\ No newline at end of file
+         timeSaved = 0.0;
+         for(n = r0; n < r1; n++)
+         {
+            stepDeg = getJointStepDeg(ja[n], ja[n + 1]);
+            timeSaved += stepDeg / timing->degPerSec[slowSpeed] - stepDeg / timing->degPerSec[speeds[r0]];
+         }
+         numChanges = (prevSpeed == slowSpeed ? 1 : 0) + (nextSpeed == slowSpeed ? 1 : 0);
+
+         if(timeSaved < numChanges * (timing->commandSec + timing->pacingSec))
+         {
+            for(n = r0; n < r1; n++) speeds[n] = slowSpeed;
+            bChanged = true;
+         }
+      }
+   }
+   while(bChanged);
+}
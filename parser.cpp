@@ -0,0 +1,166 @@
+#include <stdio.h>   // i/o functions
+#include <string.h>  // string functions
+#include <math.h>    // math functions
+#include <charconv>  // std::from_chars
+#include "parser.h"  // argument parser
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  parses the fields that follow the command keyword of a line string.  The line is not modified.
+// ARGUMENTS:    strLine:  the line string (keyword first)
+//               seps:  field separator characters
+//               specs, numSpecs:  field specifications
+//               values:  receives numSpecs parsed values
+//               pError:  receives the first problem found (code ARG_OK if none)
+// RETURN VALUE: true if all fields are valid, false if not
+bool parseArguments(const char *strLine, const char *seps, const ARG_SPEC *specs, int numSpecs, ARG_VALUE *values,
+                    ARG_ERROR *pError)
+{
+   const char *p = strLine;         // current position in the line
+   const char *tok, *tokEnd;        // current field
+   const char *numStart;            // first character of a number (after optional '+')
+   int field, k;                    // field index, keyword index
+   size_t len;                      // field length
+
+   pError->code = ARG_OK;
+   pError->field = 0;
+   pError->column = 1;
+   pError->bTooLarge = false;
+
+   // skip the command keyword
+   p += strspn(p, seps);
+   p += strcspn(p, seps);
+
+   for(field = 0; field <= numSpecs; field++)
+   {
+      p += strspn(p, seps);
+      tok = p;
+      len = strcspn(p, seps);
+      tokEnd = p + len;
+      p = tokEnd;
+
+      pError->field = field;
+      pError->column = (int)(tok - strLine) + 1;
+
+      if(field == numSpecs)  // nothing may follow the last field
+      {
+         if(len == 0) return true;
+         pError->code = ARG_UNEXPECTED;
+         return false;
+      }
+
+      values[field].bPresent = len > 0;
+      values[field].i = 0;
+      values[field].d = 0.0;
+
+      if(len == 0)
+      {
+         if(specs[field].bOptional) continue;
+         pError->code = ARG_MISSING;
+         return false;
+      }
+
+      if(specs[field].type == ARG_KEYWORD)
+      {
+         for(k = 0; k < specs[field].numKeywords; k++)
+         {
+            if(strlen(specs[field].keywords[k]) == len && strncmp(tok, specs[field].keywords[k], len) == 0) break;
+         }
+         if(k == specs[field].numKeywords)
+         {
+            pError->code = ARG_BAD_KEYWORD;
+            return false;
+         }
+         values[field].i = k;
+         continue;
+      }
+
+      numStart = (*tok == '+' && len > 1 && tok[1] != '-') ? tok + 1 : tok;  // from_chars does not accept '+'
+      if(specs[field].type == ARG_INT)
+      {
+         std::from_chars_result res = std::from_chars(numStart, tokEnd, values[field].i);
+         if(res.ec == std::errc::result_out_of_range)
+         {
+            pError->code = ARG_OUT_OF_RANGE;
+            pError->bTooLarge = *numStart != '-';
+            return false;
+         }
+         if(res.ec != std::errc() || res.ptr != tokEnd)
+         {
+            pError->code = ARG_BAD_NUMBER;
+            return false;
+         }
+         values[field].d = (double)values[field].i;
+      }
+      else
+      {
+         std::from_chars_result res = std::from_chars(numStart, tokEnd, values[field].d);
+         if(res.ec != std::errc() || res.ptr != tokEnd || !isfinite(values[field].d))
+         {
+            pError->code = ARG_BAD_NUMBER;
+            return false;
+         }
+      }
+
+      if(values[field].d < specs[field].minVal || values[field].d > specs[field].maxVal)
+      {
+         pError->code = ARG_OUT_OF_RANGE;
+         pError->bTooLarge = values[field].d > specs[field].maxVal;
+         return false;
+      }
+   }
+
+   return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  writes an error message for a parser error, e.g.
+//                  "PEN_COLOR column 15: g must be at most 255"
+// ARGUMENTS:    strError, size:  message buffer
+//               strCommand:  command keyword
+//               specs, numSpecs:  field specifications used by parseArguments
+//               pError:  the parser error
+// RETURN VALUE: number of characters written
+int formatArgError(char *strError, size_t size, const char *strCommand, const ARG_SPEC *specs, int numSpecs,
+                   const ARG_ERROR *pError)
+{
+   const ARG_SPEC *spec = (pError->field < numSpecs ? &specs[pError->field] : NULL);
+   double limit;  // range limit that was broken
+   int n, k;      // characters written, keyword index
+
+   n = snprintf(strError, size, "%s column %d: ", strCommand, pError->column);
+   if(n < 0 || (size_t)n >= size) return n;
+
+   switch(pError->code)
+   {
+      case ARG_OK:
+         return n + snprintf(strError + n, size - n, "no error");
+      case ARG_UNEXPECTED:
+         return n + snprintf(strError + n, size - n, "unexpected parameter (%d expected)", numSpecs);
+      case ARG_MISSING:
+         return n + snprintf(strError + n, size - n, "missing %s", spec->name);
+      case ARG_BAD_NUMBER:
+         return n + snprintf(strError + n, size - n, "%s must be %s", spec->name,
+                             spec->type == ARG_INT ? "a whole number" : "a number");
+      case ARG_OUT_OF_RANGE:
+         limit = pError->bTooLarge ? spec->maxVal : spec->minVal;
+         if(!pError->bTooLarge && limit == ARG_POSITIVE)
+            return n + snprintf(strError + n, size - n, "%s must be greater than zero", spec->name);
+         if(limit == ARG_NO_LIMIT || limit == -ARG_NO_LIMIT)  // ARG_INT overflow
+            return n + snprintf(strError + n, size - n, "%s is too %s", spec->name,
+                                pError->bTooLarge ? "large" : "small");
+         n += snprintf(strError + n, size - n, "%s must be at %s ", spec->name, pError->bTooLarge ? "most" : "least");
+         if((size_t)n >= size) return n;
+         if(spec->type == ARG_INT) return n + snprintf(strError + n, size - n, "%d", (int)limit);
+         return n + snprintf(strError + n, size - n, "%g", limit);
+      case ARG_BAD_KEYWORD:
+         n += snprintf(strError + n, size - n, "%s must be", spec->name);
+         for(k = 0; k < spec->numKeywords && (size_t)n < size; k++)
+         {
+            n += snprintf(strError + n, size - n, "%s%s", k == 0 ? " " : (k == spec->numKeywords - 1 ? " or " : ", "),
+                          spec->keywords[k]);
+         }
+         return n;
+      default:
+         return n + snprintf(strError + n, size - n, "unknown error");
+   }
+}
@@ -0,0 +1,64 @@
+#ifndef _PARSER_H_
+#define _PARSER_H_
+
+//---------------------------- Argument Parser ------------------------------------------------------------------------
+// Typed, allocation free parser for the parameters that follow a command keyword.  Numbers are converted with
+// std::from_chars (locale independent) straight out of the line string.  Every field is checked against its spec
+// (type, range, keyword list) in one pass and the first problem is returned as an ARG_ERROR with its column.
+
+#include <float.h>   // DBL_MAX, DBL_MIN
+
+#define ARG_NO_LIMIT DBL_MAX   // range limit for fields with no limit
+#define ARG_POSITIVE DBL_MIN   // minimum value for fields that must be greater than zero
+
+// shorthand for field specifications
+#define ARG_NUMBER(name)                    {name, ARG_DOUBLE, -ARG_NO_LIMIT, ARG_NO_LIMIT, NULL, 0, false}
+#define ARG_RANGE(name, minVal, maxVal)     {name, ARG_DOUBLE, minVal, maxVal, NULL, 0, false}
+#define ARG_INT_RANGE(name, minVal, maxVal) {name, ARG_INT, minVal, maxVal, NULL, 0, false}
+#define ARG_KEYWORDS(name, list, optional)  {name, ARG_KEYWORD, 0.0, 0.0, list, (int)(sizeof(list) / sizeof(list[0])), \
+                                             optional}
+
+enum ARG_TYPE { ARG_INT, ARG_DOUBLE, ARG_KEYWORD };   // field types
+
+enum ARG_ERROR_CODE  // parser results
+{
+   ARG_OK, ARG_MISSING, ARG_BAD_NUMBER, ARG_OUT_OF_RANGE, ARG_BAD_KEYWORD, ARG_UNEXPECTED
+};
+
+// specification of one field
+typedef struct ARG_SPEC
+{
+   const char *name;                // field name (for error messages)
+   int type;                        // ARG_INT, ARG_DOUBLE or ARG_KEYWORD
+   double minVal, maxVal;           // allowed range of numbers (inclusive)
+   const char *const *keywords;     // allowed keywords (ARG_KEYWORD only)
+   int numKeywords;                 // number of allowed keywords
+   bool bOptional;                  // true if the field may be left out (optional fields must be last)
+}
+ARG_SPEC;
+
+// parsed value of one field
+typedef struct ARG_VALUE
+{
+   bool bPresent;                   // false if an optional field was left out
+   int i;                           // ARG_INT value or ARG_KEYWORD index
+   double d;                        // ARG_DOUBLE value (also set for ARG_INT)
+}
+ARG_VALUE;
+
+// parser error
+typedef struct ARG_ERROR
+{
+   int code;                        // ARG_ERROR_CODE
+   int field;                       // index of the field with the problem
+   int column;                      // column in the line string (1 = first character)
+   bool bTooLarge;                  // ARG_OUT_OF_RANGE:  true if above the maximum, false if below the minimum
+}
+ARG_ERROR;
+
+bool parseArguments(const char *strLine, const char *seps, const ARG_SPEC *specs, int numSpecs, ARG_VALUE *values,
+                    ARG_ERROR *pError);  // parses the fields that follow the command keyword
+int formatArgError(char *strError, size_t size, const char *strCommand, const ARG_SPEC *specs, int numSpecs,
+                   const ARG_ERROR *pError);  // writes an error message for a parser error
+
+#endif
@@ -0,0 +1,378 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "preview.h"
+using namespace openutils;
+
+static const PREVIEW_COLOR PREVIEW_HOME_COLOR = {0, 0, 255};  // pen color at the start (see pauseRobotThenClear)
+static const PREVIEW_COLOR PREVIEW_CYCLE[] = {{255, 0, 0}, {255, 128, 0}, {224, 192, 0}, {0, 160, 0}, {0, 0, 255},
+                                              {128, 0, 192}};  // CYCLE_PEN_COLORS ON (the simulator's are similar)
+static const int PREVIEW_NUM_CYCLE = (int)(sizeof(PREVIEW_CYCLE) / sizeof(PREVIEW_CYCLE[0]));
+static const int PREVIEW_LINE_SIZE = 256;  // longest robot command line
+
+// PNG output:  stored (uncompressed) deflate blocks, so no compression library is needed
+static const unsigned char PNG_SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+static const size_t PNG_MAX_STORED_BLOCK = 65535;  // largest stored deflate block
+static const size_t PNG_ADLER_RUN = 5552;          // bytes added up before the Adler-32 sums could overflow
+
+// CRC-32 table of PNG chunks.  Built once, the first time it is used.
+struct PNG_CRC_TABLE
+{
+   unsigned int entry[256];
+   PNG_CRC_TABLE()
+   {
+      unsigned int c;
+      int n, k;
+      for(n = 0; n < 256; n++)
+      {
+         c = (unsigned int)n;
+         for(k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+         entry[n] = c;
+      }
+   }
+};
+
+static void putBigEndian(unsigned char *p, unsigned int value)
+{
+   p[0] = (unsigned char)(value >> 24);
+   p[1] = (unsigned char)(value >> 16);
+   p[2] = (unsigned char)(value >> 8);
+   p[3] = (unsigned char)value;
+}
+
+static void writePngChunk(FILE *f, const char *type, const unsigned char *data, size_t len)
+{
+   static const PNG_CRC_TABLE crcTable;
+   unsigned char word[4];
+   unsigned int crc = 0xFFFFFFFFu;
+   size_t n;
+
+   for(n = 0; n < 4; n++) crc = crcTable.entry[(crc ^ (unsigned char)type[n]) & 0xFF] ^ (crc >> 8);
+   for(n = 0; n < len; n++) crc = crcTable.entry[(crc ^ data[n]) & 0xFF] ^ (crc >> 8);
+
+   putBigEndian(word, (unsigned int)len);
+   fwrite(word, 1, 4, f);
+   fwrite(type, 1, 4, f);
+   if(len > 0) fwrite(data, 1, len, f);
+   putBigEndian(word, crc ^ 0xFFFFFFFFu);
+   fwrite(word, 1, 4, f);
+}
+
+CPreviewRenderer::CPreviewRenderer()
+{
+   m_model = &SCARA_MODELS[0];
+   m_angles.theta1Deg = m_angles.theta2Deg = 0.0;
+   m_bPenDown = true;
+   m_bCycleColors = false;
+   m_nCycle = 0;
+   m_color = PREVIEW_HOME_COLOR;
+   m_bStrokeOpen = false;
+}
+
+/**
+* Carries out the robot commands in data. Every Send of the controller is one or more whole lines.
+* @param data command lines
+* @param len number of bytes
+*/
+void CPreviewRenderer::Draw(const char *data, int len)
+{
+   char line[PREVIEW_LINE_SIZE];
+   const char *end = data + len, *eol;
+   size_t n;
+
+   while(data < end)
+   {
+      eol = (const char *)memchr(data, '\n', end - data);
+      if(eol == NULL) eol = end;
+      n = (size_t)(eol - data) < sizeof(line) - 1 ? (size_t)(eol - data) : sizeof(line) - 1;
+      memcpy(line, data, n);
+      line[n] = '\0';
+      DrawLine(line);
+      data = eol + 1;
+   }
+}
+
+/**
+* Forgets everything drawn. The pen position, state and color are kept, as in the simulator.
+*/
+void CPreviewRenderer::Clear()
+{
+   m_points.clear();
+   m_strokes.clear();
+   m_bStrokeOpen = false;
+}
+
+/**
+* Carries out one robot command. Commands that do not change the drawing (MOTOR_SPEED, the logs) are ignored.
+*/
+void CPreviewRenderer::DrawLine(const char *line)
+{
+   JOINT_ANGLES ja;
+   int r, g, b;
+
+   line += strspn(line, " \t\r");
+   if(sscanf_s(line, "ROTATE_JOINT ANG1 %lf ANG2 %lf", &ja.theta1Deg, &ja.theta2Deg) == 2)
+   {
+      MoveTo(ja);
+   }
+   else if(strncmp(line, "PEN_UP", 6) == 0)
+   {
+      m_bPenDown = false;
+      m_bStrokeOpen = false;
+   }
+   else if(strncmp(line, "PEN_DOWN", 8) == 0)
+   {
+      m_bPenDown = true;
+   }
+   else if(sscanf_s(line, "PEN_COLOR %d %d %d", &r, &g, &b) == 3)
+   {
+      m_color.r = (unsigned char)r;
+      m_color.g = (unsigned char)g;
+      m_color.b = (unsigned char)b;
+      m_bStrokeOpen = false;
+   }
+   else if(strncmp(line, "CYCLE_PEN_COLORS ", 17) == 0)
+   {
+      m_bCycleColors = strncmp(line + 17, "ON", 2) == 0;
+      m_bStrokeOpen = false;
+   }
+   else if(strncmp(line, "HOME", 4) == 0)
+   {
+      ja.theta1Deg = ja.theta2Deg = 0.0;
+      MoveTo(ja);
+   }
+   else if(strncmp(line, "CLEAR_TRACE", 11) == 0)
+   {
+      Clear();
+   }
+}
+
+/**
+* Moves both joints to ja together, in steps of PREVIEW_STEP_DEG, so a pen down move leaves the same curve as
+* in the simulator rather than a straight line.
+* @param ja joint angles to move to
+*/
+void CPreviewRenderer::MoveTo(JOINT_ANGLES ja)
+{
+   double d1 = ja.theta1Deg - m_angles.theta1Deg, d2 = ja.theta2Deg - m_angles.theta2Deg;
+   int numSteps = (int)ceil(fmax(fabs(d1), fabs(d2)) / PREVIEW_STEP_DEG), n;
+   PREVIEW_STROKE stroke;
+   JOINT_ANGLES step;
+
+   if(m_bPenDown && numSteps > 0)
+   {
+      if(!m_bStrokeOpen || m_bCycleColors)
+      {
+         stroke.first = m_points.size();
+         stroke.count = 1;
+         stroke.color = NextColor();
+         m_strokes.push_back(stroke);
+         m_points.push_back(m_model->forwardKinematics(m_angles).toolPos);
+         m_bStrokeOpen = true;
+      }
+      for(n = 1; n <= numSteps; n++)
+      {
+         step.theta1Deg = m_angles.theta1Deg + d1 * n / numSteps;
+         step.theta2Deg = m_angles.theta2Deg + d2 * n / numSteps;
+         m_points.push_back(m_model->forwardKinematics(step).toolPos);
+      }
+      m_strokes.back().count += numSteps;
+   }
+   m_angles = ja;
+}
+
+/**
+* Returns the pen color of the next stroke: PEN_COLOR, or the next color of the cycle.
+*/
+PREVIEW_COLOR CPreviewRenderer::NextColor()
+{
+   PREVIEW_COLOR color;
+
+   if(!m_bCycleColors) return m_color;
+   color = PREVIEW_CYCLE[m_nCycle];
+   m_nCycle = (m_nCycle + 1) % PREVIEW_NUM_CYCLE;
+   return color;
+}
+
+/**
+* Gets the area shown in the image: the drawing with a margin around it, or the reach of the arm if nothing
+* was drawn.
+*/
+void CPreviewRenderer::GetBounds(double *xMin, double *yMin, double *xMax, double *yMax)
+{
+   double margin;
+   size_t n;
+
+   if(m_points.empty())
+   {
+      *xMin = *yMin = -m_model->LMAX;
+      *xMax = *yMax = m_model->LMAX;
+      return;
+   }
+
+   *xMin = *xMax = m_points[0].x;
+   *yMin = *yMax = m_points[0].y;
+   for(n = 1; n < m_points.size(); n++)
+   {
+      *xMin = fmin(*xMin, m_points[n].x);
+      *xMax = fmax(*xMax, m_points[n].x);
+      *yMin = fmin(*yMin, m_points[n].y);
+      *yMax = fmax(*yMax, m_points[n].y);
+   }
+   margin = PREVIEW_MARGIN * fmax(fmax(*xMax - *xMin, *yMax - *yMin), 1.0);
+   *xMin -= margin;
+   *xMax += margin;
+   *yMin -= margin;
+   *yMax += margin;
+}
+
+/**
+* Writes the image. The format comes from the extension of the file name: .svg, .ppm or else PNG.
+* @param fileName image file
+* @param width image width in pixels (the height keeps the proportions of the drawing)
+*/
+bool CPreviewRenderer::Save(const char *fileName, int width)
+{
+   const char *ext = strrchr(fileName, '.');
+
+   if(width < 1 || width > PREVIEW_MAX_WIDTH) width = PREVIEW_DEFAULT_WIDTH;
+   if(ext != NULL && _stricmp(ext, ".svg") == 0) return SaveSvg(fileName, width);
+   return SaveRaster(fileName, width, ext == NULL || _stricmp(ext, ".ppm") != 0);
+}
+
+/**
+* Writes the strokes as SVG polylines in image coordinates (y up in the drawing is up in the image).
+*/
+bool CPreviewRenderer::SaveSvg(const char *fileName, int width)
+{
+   FILE *f = NULL;
+   double xMin, yMin, xMax, yMax, scale;
+   size_t s, n;
+   int height;
+
+   GetBounds(&xMin, &yMin, &xMax, &yMax);
+   scale = width / (xMax - xMin);
+   height = (int)ceil((yMax - yMin) * scale);
+   if(fopen_s(&f, fileName, "w") != 0 || f == NULL) return false;
+
+   fprintf(f, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" viewBox=\"0 0 %d %d\">\n",
+           width, height, width, height);
+   fprintf(f, "<rect width=\"100%%\" height=\"100%%\" fill=\"white\"/>\n");
+   for(s = 0; s < m_strokes.size(); s++)
+   {
+      const PREVIEW_STROKE &stroke = m_strokes[s];
+      fprintf(f, "<polyline fill=\"none\" stroke=\"rgb(%d,%d,%d)\" stroke-width=\"2\" stroke-linejoin=\"round\" "
+              "points=\"", stroke.color.r, stroke.color.g, stroke.color.b);
+      for(n = stroke.first; n < stroke.first + stroke.count; n++)
+         fprintf(f, "%s%.1f,%.1f", n == stroke.first ? "" : " ", (m_points[n].x - xMin) * scale,
+                 (yMax - m_points[n].y) * scale);
+      fprintf(f, "\"/>\n");
+   }
+   fprintf(f, "</svg>\n");
+   return fclose(f) == 0;
+}
+
+/**
+* Rasterizes the strokes (2 pixel pen, white background) and writes a binary PPM or a PNG image.
+*/
+bool CPreviewRenderer::SaveRaster(const char *fileName, int width, bool bPng)
+{
+   FILE *f = NULL;
+   double xMin, yMin, xMax, yMax, scale, x0, y0, x1, y1, t;
+   size_t s, n, rowSize, pos, blockLen;
+   int height, numSteps, step, px, py, dx, dy;
+   std::vector<unsigned char> pixels, png;
+   unsigned char header[13];
+   unsigned int a = 1, b = 0;  // Adler-32 of the PNG image data
+
+   GetBounds(&xMin, &yMin, &xMax, &yMax);
+   scale = width / (xMax - xMin);
+   height = (int)ceil((yMax - yMin) * scale);
+   if(height < 1) height = 1;
+   if(height > PREVIEW_MAX_WIDTH) height = PREVIEW_MAX_WIDTH;
+
+   // every row starts with a filter byte (0 = none) so the PNG image data is the pixels as they are
+   rowSize = 1 + (size_t)width * 3;
+   pixels.assign(rowSize * height, 255);
+   for(py = 0; py < height; py++) pixels[py * rowSize] = 0;
+
+   for(s = 0; s < m_strokes.size(); s++)
+   {
+      const PREVIEW_STROKE &stroke = m_strokes[s];
+      for(n = stroke.first; n < stroke.first + stroke.count; n++)
+      {
+         x1 = (m_points[n].x - xMin) * scale;
+         y1 = (yMax - m_points[n].y) * scale;
+         if(n == stroke.first)
+         {
+            x0 = x1;
+            y0 = y1;
+         }
+         numSteps = (int)ceil(fmax(fabs(x1 - x0), fabs(y1 - y0)));
+         for(step = 0; step <= numSteps; step++)
+         {
+            t = numSteps > 0 ? (double)step / numSteps : 0.0;
+            px = (int)(x0 + (x1 - x0) * t);
+            py = (int)(y0 + (y1 - y0) * t);
+            for(dy = 0; dy < 2; dy++)
+               for(dx = 0; dx < 2; dx++)
+               {
+                  if(px + dx < 0 || px + dx >= width || py + dy < 0 || py + dy >= height) continue;
+                  pos = (py + dy) * rowSize + 1 + (size_t)(px + dx) * 3;
+                  pixels[pos] = stroke.color.r;
+                  pixels[pos + 1] = stroke.color.g;
+                  pixels[pos + 2] = stroke.color.b;
+               }
+         }
+         x0 = x1;
+         y0 = y1;
+      }
+   }
+
+   if(fopen_s(&f, fileName, "wb") != 0 || f == NULL) return false;
+   if(!bPng)
+   {
+      fprintf(f, "P6\n%d %d\n255\n", width, height);
+      for(py = 0; py < height; py++) fwrite(&pixels[py * rowSize + 1], 1, rowSize - 1, f);
+      return fclose(f) == 0;
+   }
+
+   putBigEndian(header, (unsigned int)width);
+   putBigEndian(header + 4, (unsigned int)height);
+   header[8] = 8;   // bits per sample
+   header[9] = 2;   // RGB
+   header[10] = header[11] = header[12] = 0;  // deflate, adaptive filtering, no interlace
+
+   png.reserve(pixels.size() + pixels.size() / PNG_MAX_STORED_BLOCK * 5 + 16);
+   png.push_back(0x78);  // zlib header:  deflate, 32K window
+   png.push_back(0x01);
+   for(pos = 0; pos < pixels.size(); pos += blockLen)
+   {
+      blockLen = pixels.size() - pos < PNG_MAX_STORED_BLOCK ? pixels.size() - pos : PNG_MAX_STORED_BLOCK;
+      png.push_back(pos + blockLen == pixels.size() ? 1 : 0);  // last block flag, stored
+      png.push_back((unsigned char)blockLen);
+      png.push_back((unsigned char)(blockLen >> 8));
+      png.push_back((unsigned char)~blockLen);
+      png.push_back((unsigned char)(~blockLen >> 8));
+      png.insert(png.end(), pixels.begin() + pos, pixels.begin() + pos + blockLen);
+   }
+   for(pos = 0; pos < pixels.size(); pos += blockLen)
+   {
+      blockLen = pixels.size() - pos < PNG_ADLER_RUN ? pixels.size() - pos : PNG_ADLER_RUN;
+      for(n = pos; n < pos + blockLen; n++)
+      {
+         a += pixels[n];
+         b += a;
+      }
+      a %= 65521;
+      b %= 65521;
+   }
+   png.resize(png.size() + 4);
+   putBigEndian(&png[png.size() - 4], (b << 16) | a);
+
+   fwrite(PNG_SIGNATURE, 1, sizeof(PNG_SIGNATURE), f);
+   writePngChunk(f, "IHDR", header, sizeof(header));
+   writePngChunk(f, "IDAT", png.data(), png.size());
+   writePngChunk(f, "IEND", NULL, 0);
+   return fclose(f) == 0;
+}
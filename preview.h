@@ -0,0 +1,63 @@
+#ifndef _PREVIEW_H_
+#define _PREVIEW_H_
+
+#include <vector>
+#include "scara.h"
+
+#define PREVIEW_DEFAULT_WIDTH 800   /// image width in pixels when none is given
+#define PREVIEW_MAX_WIDTH 8000      /// widest image
+#define PREVIEW_STEP_DEG 1.0        /// largest joint step between the points drawn for one ROTATE_JOINT
+#define PREVIEW_MARGIN 0.05         /// space around the drawing (fraction of its size)
+
+namespace openutils
+{
+
+   /// a pen color
+   struct PREVIEW_COLOR
+   {
+      unsigned char r, g, b;
+   };
+
+   /// a pen down polyline: m_points[first] to m_points[first + count - 1]
+   struct PREVIEW_STROKE
+   {
+      size_t first; /// index of the first point
+      size_t count; /// number of points
+      PREVIEW_COLOR color; /// pen color
+   };
+
+   /// Draws what the simulator would draw for the commands sent to it, without the simulator. The joint angles
+   /// of every ROTATE_JOINT are turned back into tool tip positions with the forward kinematics of the arm model,
+   /// both joints moving together as the simulator moves them, and pen down moves are kept as colored strokes.
+   /// Save writes the strokes as an SVG, a binary PPM or (any other extension) a PNG image.
+   class CPreviewRenderer
+   {
+   private:
+      const SCARA_MODEL *m_model; /// arm model the joint angles are for
+      JOINT_ANGLES m_angles; /// current joint angles
+      bool m_bPenDown; /// pen state
+      bool m_bCycleColors; /// CYCLE_PEN_COLORS ON: every move gets the next color of the cycle
+      int m_nCycle; /// next color of the cycle
+      PREVIEW_COLOR m_color; /// PEN_COLOR
+      std::vector<TOOL_POSITION> m_points; /// points of all strokes
+      std::vector<PREVIEW_STROKE> m_strokes; /// pen down polylines
+      bool m_bStrokeOpen; /// true if the next move continues the last stroke
+   public:
+      CPreviewRenderer(); /// home position, pen down, blue
+      void SetArmModel(const SCARA_MODEL *model) { m_model = model; } /// arm model of the following commands
+      void Draw(const char *data, int len); /// carries out the robot commands in data (whole lines)
+      void Clear(); /// forgets everything drawn (CLEAR_TRACE)
+      size_t GetNumStrokes() { return m_strokes.size(); } /// returns the number of pen down polylines
+      size_t GetNumPoints() { return m_points.size(); } /// returns the number of points drawn
+      bool Save(const char *fileName, int width); /// writes the image.  false if the file cannot be written
+   private:
+      void DrawLine(const char *line); /// carries out one robot command
+      void MoveTo(JOINT_ANGLES ja); /// moves the joints, drawing if the pen is down
+      PREVIEW_COLOR NextColor(); /// color of the next move
+      void GetBounds(double *xMin, double *yMin, double *xMax, double *yMax); /// area shown in the image
+      bool SaveSvg(const char *fileName, int width); /// writes an SVG image
+      bool SaveRaster(const char *fileName, int width, bool bPng); /// rasterizes and writes a PPM or PNG image
+   };
+}
+
+#endif
@@ -0,0 +1,92 @@
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include "replay.h"
+using namespace openutils;
+
+bool CTraceReplayer::Open(const char *fileName)
+{
+   return m_reader.Open(fileName);
+}
+
+/**
+* Sends every recorded command to target and measures how long each send takes. Reads in the trace are
+* counted but not replayed.
+* @param target connected robot. Its pacing should be 0 since the trace already holds the recorded timing
+* @param bFast true to send as fast as possible, false to keep the recorded gaps between sends
+* @param bWaitReplies true if the target answers every line (the command gateway). Latency is then the time
+*        until the replies for the send have arrived.
+* @param stats receives the results
+*/
+void CTraceReplayer::Run(CRobot *target, bool bFast, bool bWaitReplies, REPLAY_STATS *stats)
+{
+   TRACE_RECORD rec;
+   char reply[1024];
+   unsigned long long tFirstRecUs = 0, tLastRecUs = 0, tStartUs = 0, tSendUs, tNowUs, tDueUs;
+   long numPending = 0;   // replies still expected
+   int nRead;
+
+   memset(stats, 0, sizeof(REPLAY_STATS));
+   m_latencyMs.clear();
+
+   while(m_reader.Next(&rec))
+   {
+      if(rec.type != TRACE_SEND)
+      {
+         stats->numRecordedReads++;
+         continue;
+      }
+
+      if(stats->numCommands == 0)
+      {
+         tFirstRecUs = rec.timeUs;
+         tStartUs = TraceClockUs();
+      }
+      else if(!bFast)
+      {
+         tDueUs = tStartUs + (rec.timeUs - tFirstRecUs);
+         tNowUs = TraceClockUs();
+         if(tDueUs > tNowUs) Sleep((DWORD)((tDueUs - tNowUs) / 1000));
+      }
+      tLastRecUs = rec.timeUs;
+
+      tSendUs = TraceClockUs();
+      target->Send(rec.data, rec.len);
+      if(bWaitReplies)
+      {
+         numPending += (long)std::count(rec.data, rec.data + rec.len, '\n');
+         while(numPending > 0)
+         {
+            nRead = target->Read(reply, sizeof(reply) - 1);
+            if(nRead <= 0) throw CSocketException(0, "Connection closed: Run()");
+            numPending -= (long)std::count(reply, reply + nRead, '\n');
+         }
+      }
+      m_latencyMs.push_back((TraceClockUs() - tSendUs) / 1000.0);
+
+      stats->numCommands++;
+      stats->numBytes += rec.len;
+   }
+
+   if(stats->numCommands == 0) return;
+
+   stats->recordedSec = (tLastRecUs - tFirstRecUs) / 1.0e6;
+   stats->elapsedSec = (TraceClockUs() - tStartUs) / 1.0e6;
+   std::sort(m_latencyMs.begin(), m_latencyMs.end());
+   stats->p50Ms = Percentile(0.50);
+   stats->p90Ms = Percentile(0.90);
+   stats->p99Ms = Percentile(0.99);
+   stats->maxMs = m_latencyMs.back();
+}
+
+/**
+* Nearest rank percentile of the sorted latencies.
+* @param p fraction (0 to 1)
+*/
+double CTraceReplayer::Percentile(double p)
+{
+   size_t rank = (size_t)ceil(p * m_latencyMs.size());
+   if(rank < 1) rank = 1;
+   if(rank > m_latencyMs.size()) rank = m_latencyMs.size();
+   return m_latencyMs[rank - 1];
+}
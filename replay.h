@@ -0,0 +1,35 @@
+#ifndef _REPLAY_H_
+#define _REPLAY_H_
+
+#include "robot.h"
+
+namespace openutils
+{
+
+   /// results of a trace replay
+   struct REPLAY_STATS
+   {
+      unsigned long numCommands; /// number of sends replayed
+      unsigned long numBytes; /// number of bytes sent
+      unsigned long numRecordedReads; /// number of reads in the trace (not replayed)
+      double recordedSec; /// time from first to last send when recorded
+      double elapsedSec; /// time from first to last send when replayed
+      double p50Ms, p90Ms, p99Ms, maxMs; /// send latency percentiles (round trip when waiting for replies)
+   };
+
+   /// Pushes the commands of a trace written by CTraceRecorder into a robot (the simulator, the stand-in
+   /// simulator or the command gateway) either with the recorded timing or as fast as possible.
+   class CTraceReplayer
+   {
+   private:
+      CTraceReader m_reader; /// the trace
+      vector<double> m_latencyMs; /// latency of every replayed send
+   public:
+      bool Open(const char *fileName); /// opens a trace. false if missing or not a trace
+      void Run(CRobot *target, bool bFast, bool bWaitReplies, REPLAY_STATS *stats); /// Throws CSocketException
+   private:
+      double Percentile(double p); /// latency percentile of the sorted latencies
+   };
+}
+
+#endif
@@ -1,8 +1,18 @@
 #include <string>
 #include <vector>
+#include <deque>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
 using namespace std;
-#include <windows.h>
+#include "estimator.h"
+#include "preview.h"
 #include "robot.h"
+#include "shmlink.h"
+#include "trajblock.h"
 #include <conio.h>
 using namespace openutils;
 
@@ -10,7 +20,7 @@ using namespace openutils;
 
 void CWinSock::Initialize()
 {
-   WORD ver = MAKEWORD(1, 1);
+   WORD ver = MAKEWORD(2, 2);  // getaddrinfo
    WSADATA wsadata;
    WSAStartup(ver, &wsadata);
 }
@@ -21,6 +31,161 @@ void CWinSock::Finalize()
    WSACleanup();
 }
 
+// class CResolver
+
+// a host name being or already resolved
+struct RESOLVER_ENTRY
+{
+   bool bPending; // lookup running
+   bool bResolved; // lookup succeeded
+   unsigned long long timeUs; // when the lookup finished
+   int numAddrs; // number of addresses
+   SOCKADDR_STORAGE addrs[MAX_HOST_ADDRESSES]; // addresses (port 0)
+   int addrLens[MAX_HOST_ADDRESSES]; // address lengths
+   string canonicalName; // official name
+};
+
+// resolved host names.  Never freed: a lookup that timed out may still finish while the program exits.
+struct RESOLVER_CACHE
+{
+   mutex lock; // protects entries
+   condition_variable done; // notified when a lookup finishes
+   map<string, RESOLVER_ENTRY> entries; // by host name
+};
+
+static RESOLVER_CACHE *GetResolverCache()
+{
+   static RESOLVER_CACHE *cache = new RESOLVER_CACHE();
+   return cache;
+}
+
+// copies the result of getaddrinfo (NULL if it failed) into a cache entry
+static void StoreAddresses(RESOLVER_ENTRY *entry, const ADDRINFOA *list)
+{
+   entry->numAddrs = 0;
+   for(const ADDRINFOA *ai = list; ai != NULL && entry->numAddrs < MAX_HOST_ADDRESSES; ai = ai->ai_next)
+   {
+      if(ai->ai_family != AF_INET && ai->ai_family != AF_INET6) continue;
+      memcpy(&entry->addrs[entry->numAddrs], ai->ai_addr, ai->ai_addrlen);
+      entry->addrLens[entry->numAddrs++] = (int)ai->ai_addrlen;
+      if(ai->ai_canonname != NULL && entry->canonicalName.empty()) entry->canonicalName = ai->ai_canonname;
+   }
+   entry->bResolved = entry->numAddrs > 0;
+   entry->bPending = false;
+   entry->timeUs = TraceClockUs();
+}
+
+/**
+* Gets the addresses of a host (IPv4 and IPv6, in the order getaddrinfo prefers them). Waits at most timeoutMs
+* for a lookup that is not cached; the lookup carries on in the background if it takes longer.
+* @param host host name or address
+* @param port port to put in the addresses
+* @param addrs receives the addresses
+* @param addrLens receives the length of every address
+* @param maxAddrs size of addrs and addrLens
+* @param timeoutMs longest wait
+*/
+int CResolver::Resolve(const char *host, int port, SOCKADDR_STORAGE *addrs, int *addrLens, int maxAddrs,
+                       int timeoutMs)
+{
+   RESOLVER_CACHE *cache = GetResolverCache();
+   unique_lock<mutex> lock(cache->lock);
+   RESOLVER_ENTRY *entry;
+   int n;
+
+   Start(host);
+   entry = &cache->entries[host];  // map elements do not move
+   cache->done.wait_for(lock, chrono::milliseconds(timeoutMs), [entry] { return !entry->bPending; });
+   if(entry->bPending || !entry->bResolved) return 0;
+
+   for(n = 0; n < entry->numAddrs && n < maxAddrs; n++)
+   {
+      addrs[n] = entry->addrs[n];
+      addrLens[n] = entry->addrLens[n];
+      if(addrs[n].ss_family == AF_INET6)
+         ((SOCKADDR_IN6 *)&addrs[n])->sin6_port = htons((u_short)port);
+      else
+         ((SOCKADDR_IN *)&addrs[n])->sin_port = htons((u_short)port);
+   }
+   return n;
+}
+
+/**
+* Gets the official name of a host (the canonical name getaddrinfo reports).
+* @param host host name or address
+* @param name receives the name
+* @param timeoutMs longest wait
+*/
+bool CResolver::GetCanonicalName(const char *host, string *name, int timeoutMs)
+{
+   SOCKADDR_STORAGE addr;
+   int addrLen;
+   RESOLVER_CACHE *cache = GetResolverCache();
+
+   if(Resolve(host, 0, &addr, &addrLen, 1, timeoutMs) == 0) return false;
+   lock_guard<mutex> lock(cache->lock);
+   *name = cache->entries[host].canonicalName;
+   return !name->empty();
+}
+
+/**
+* Starts a lookup of host unless it is cached (and not too old) or running. Numeric addresses are converted
+* here without a worker thread. Call with the cache locked.
+* @param host host name or address
+*/
+bool CResolver::Start(const char *host)
+{
+   RESOLVER_CACHE *cache = GetResolverCache();
+   map<string, RESOLVER_ENTRY>::iterator it = cache->entries.find(host);
+   ADDRINFOA hints, *list = NULL;
+   RESOLVER_ENTRY *entry;
+
+   if(it != cache->entries.end() && (it->second.bPending || (it->second.bResolved &&
+      TraceClockUs() - it->second.timeUs < RESOLVE_CACHE_SEC * 1000000ULL))) return false;
+
+   entry = &cache->entries[host];
+   entry->bPending = true;
+   entry->bResolved = false;
+   entry->canonicalName.clear();
+
+   memset(&hints, 0, sizeof(hints));
+   hints.ai_family = AF_UNSPEC;
+   hints.ai_socktype = SOCK_STREAM;
+   hints.ai_flags = AI_NUMERICHOST;
+   if(getaddrinfo(host, NULL, &hints, &list) == 0)
+   {
+      StoreAddresses(entry, list);
+      entry->canonicalName = host;
+      freeaddrinfo(list);
+      return true;
+   }
+
+   thread(Lookup, string(host)).detach();
+   return true;
+}
+
+/**
+* Worker thread of a lookup. Runs the blocking getaddrinfo and stores the result in the cache.
+* @param host host name
+*/
+void CResolver::Lookup(string host)
+{
+   RESOLVER_CACHE *cache = GetResolverCache();
+   ADDRINFOA hints, *list = NULL;
+   int nret;
+
+   memset(&hints, 0, sizeof(hints));
+   hints.ai_family = AF_UNSPEC;
+   hints.ai_socktype = SOCK_STREAM;
+   hints.ai_flags = AI_CANONNAME;
+   nret = getaddrinfo(host.c_str(), NULL, &hints, &list);
+
+   lock_guard<mutex> lock(cache->lock);
+   StoreAddresses(&cache->entries[host], nret == 0 ? list : NULL);
+   if(list != NULL) freeaddrinfo(list);
+   cache->done.notify_all();
+}
+
 CServerSocket::CServerSocket()
 {
    m_nPort = 80;
@@ -56,7 +221,7 @@ void CServerSocket::Bind(CSocketAddress *sock_addr)
 /**
 * Listens and accepts a client.Returns the accepted connection.
 */
-CRobot *CServerSocket::Accept() throw (CSocketException)
+CRobot *CServerSocket::Accept()
 {
    if(m_sockAddr != NULL)
       m_sockAddrIn = m_sockAddr->GetSockAddrIn();
@@ -88,11 +253,41 @@ CRobot *CServerSocket::Accept() throw (CSocketException)
       throw CSocketException(nret2, "Invalid client socket: Accept()");
    }
    CRobot *sockClient = new CRobot();
+   CWinSock::Initialize();  // balanced by the CWinSock::Finalize in sockClient->Close()
+   sockClient->m_bWinSockStarted = true;
+   sockClient->SetPacing(0);  // clients are not the simulator
    sockClient->SetSocket(theClient);
    sockClient->SetClientAddr(clientAddr);
    return sockClient;
 }
 
+/**
+* Binds the server and starts listening. Clients are then taken with Accept() when select() reports the
+* listening socket readable.
+* @param bLocalOnly true to accept connections from this machine only
+*/
+void CServerSocket::Listen(bool bLocalOnly)
+{
+   if(bLocalOnly) m_sockAddrIn.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   if(!m_bBound)
+   {
+      m_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+      int nret = bind(m_socket, (LPSOCKADDR)&m_sockAddrIn, sizeof(struct sockaddr));
+      if(nret == SOCKET_ERROR)
+      {
+         nret = WSAGetLastError();
+         throw CSocketException(nret, "Failed to bind: Listen()");
+      }
+      m_bBound = true;
+   }
+   int nret = listen(m_socket, m_nQueue);
+   if(nret == SOCKET_ERROR)
+   {
+      nret = WSAGetLastError();
+      throw CSocketException(nret, "Failed to listen: Listen()");
+   }
+}
+
 void CServerSocket::Close()
 {
    closesocket(m_socket);
@@ -156,7 +351,23 @@ bool CServerSocket::IsListening()
 
 CRobot::CRobot()
 {
+   m_socket = INVALID_SOCKET;
    m_clientAddr = NULL;
+   m_nPacingMs = 200;
+   m_nConnectTimeoutMs = CONNECT_TIMEOUT_MS;
+   m_bWinSockStarted = false;
+   m_recorder = NULL;
+   m_preview = NULL;
+   m_estimator = NULL;
+   m_bNullTransport = false;
+   m_nSends = 0;
+   m_nBytesSent = 0;
+   m_bQueued = false;
+   m_tReadyUs = 0;
+   m_shm = NULL;
+   m_bSharedMemory = true;
+   m_bOfferBlocks = false;
+   m_bBlocks = false;
 }
 
 void CRobot::SetSocket(SOCKET sock)
@@ -164,6 +375,15 @@ void CRobot::SetSocket(SOCKET sock)
    m_socket = sock;
 }
 
+/**
+* Sends and reads through a shared memory link instead of a socket. The link is deleted by Close.
+* @param link an open link
+*/
+void CRobot::SetSharedMemoryLink(CSharedMemoryLink *link)
+{
+   m_shm = link;
+}
+
 /**
 * Sets address details
 * @param addr SOCKADDR_IN
@@ -176,64 +396,240 @@ void CRobot::SetClientAddr(SOCKADDR_IN addr)
 
 int CRobot::Connect()
 {
-   if(m_clientAddr == NULL)
-   {
-      printf("Cannot connect to NULL host");
-   }
-   Connect(m_clientAddr->GetName(), m_clientAddr->GetPort());
-   return 1;
+   if(m_clientAddr == NULL) return 0;  // no host set
+   return Connect(m_clientAddr->GetIP(), m_clientAddr->GetPort());
 }
 
 /**
-* Connects to a server
+* Connects to a server. Prints nothing (Initialize reports a failure on the console).
 * @param host_name Server name
 * @param port Port to connect
+* @return 1 if connected, 0 if the host cannot be resolved or no address takes the connection
 */
 int CRobot::Connect(const char *host_name, int port)
 {
-   int nret;
-   LPHOSTENT hostEntry;
-   hostEntry = gethostbyname(host_name);
-   if(!hostEntry)
+   SOCKADDR_STORAGE addrs[MAX_HOST_ADDRESSES];  // addresses of the host
+   int addrLens[MAX_HOST_ADDRESSES];            // address lengths
+   int numAddrs, n;
+   unsigned long long tDeadlineUs, tNowUs;
+
+   // a simulator on this host is reached through its shared memory link if it has one
+   if(m_bSharedMemory && (strcmp(host_name, IPV4_STRING) == 0 || _stricmp(host_name, "localhost") == 0))
    {
-      nret = WSAGetLastError();
-      printf("Failed to resolve host");
-      return 0;
+      m_shm = new CSharedMemoryLink();
+      if(m_shm->Open(port))
+      {
+         if(m_bOfferBlocks) NegotiateBlocks();
+         return 1;
+      }
+      delete m_shm;
+      m_shm = NULL;
    }
 
-   m_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-   if(m_socket == INVALID_SOCKET)
+   numAddrs = CResolver::Resolve(host_name, port, addrs, addrLens, MAX_HOST_ADDRESSES, RESOLVE_TIMEOUT_MS);
+   if(numAddrs == 0) return 0;  // host not resolved
+
+   // try the addresses in turn, all within one deadline.  Every address gets an even share of the time left, so an
+   // address that never answers (an unreachable IPv6 route) does not use up the time of the ones after it
+   tDeadlineUs = TraceClockUs() + (unsigned long long)m_nConnectTimeoutMs * 1000;
+   for(n = 0; n < numAddrs; n++)
    {
-      nret = WSAGetLastError();
-      printf("Failed to create client socket");
-      return 0;
+      tNowUs = TraceClockUs();
+      if(tNowUs >= tDeadlineUs) break;
+      m_socket = ConnectSocket((const SOCKADDR *)&addrs[n], addrLens[n],
+                               tNowUs + (tDeadlineUs - tNowUs) / (numAddrs - n));
+      if(m_socket != INVALID_SOCKET)
+      {
+         if(m_bOfferBlocks) NegotiateBlocks();
+         return 1;
+      }
    }
+   return 0;  // no address took the connection
+}
 
-   SOCKADDR_IN serverInfo;
-   serverInfo.sin_family = AF_INET;
-   serverInfo.sin_addr = *((LPIN_ADDR)*hostEntry->h_addr_list);
-   serverInfo.sin_port = htons((u_short)port);
-   nret = connect(m_socket, (LPSOCKADDR)&serverInfo, sizeof(struct sockaddr));
-   if(nret == SOCKET_ERROR)
+/**
+* Connects a new socket to one address without blocking past a deadline. Returns the connected (blocking)
+* socket or INVALID_SOCKET.
+* @param addr address with port
+* @param addrLen address length
+* @param tDeadlineUs TraceClockUs time to give up at
+*/
+SOCKET CRobot::ConnectSocket(const SOCKADDR *addr, int addrLen, unsigned long long tDeadlineUs)
+{
+   SOCKET sock;
+   u_long nonBlocking = 1;
+   unsigned long long tNowUs;
+   fd_set writeSet, errorSet;
+   timeval timeout;
+   int err = 0, errLen = sizeof(err), nret;
+
+   sock = socket(addr->sa_family, SOCK_STREAM, IPPROTO_TCP);
+   if(sock == INVALID_SOCKET) return INVALID_SOCKET;
+   ioctlsocket(sock, FIONBIO, &nonBlocking);
+
+   if(connect(sock, addr, addrLen) == SOCKET_ERROR)
    {
       nret = WSAGetLastError();
-      printf("Connect failed.");
-      return 0;
+      tNowUs = TraceClockUs();
+      if((nret != WSAEWOULDBLOCK && nret != WSAEINPROGRESS) || tNowUs >= tDeadlineUs)
+      {
+         closesocket(sock);
+         return INVALID_SOCKET;
+      }
+
+      FD_ZERO(&writeSet);
+      FD_ZERO(&errorSet);
+      FD_SET(sock, &writeSet);
+      FD_SET(sock, &errorSet);
+      timeout.tv_sec = (long)((tDeadlineUs - tNowUs) / 1000000);
+      timeout.tv_usec = (long)((tDeadlineUs - tNowUs) % 1000000);
+      nret = select((int)sock + 1, NULL, &writeSet, &errorSet, &timeout);
+      if(nret > 0 && !FD_ISSET(sock, &errorSet)) getsockopt(sock, SOL_SOCKET, SO_ERROR, (char *)&err, &errLen);
+      if(nret <= 0 || FD_ISSET(sock, &errorSet) || err != 0)
+      {
+         closesocket(sock);  // refused or timed out
+         return INVALID_SOCKET;
+      }
    }
 
-   return 1;
+   nonBlocking = 0;
+   ioctlsocket(sock, FIONBIO, &nonBlocking);
+   return sock;
+}
+
+/**
+* Offers trajectory blocks to the peer and waits up to TRAJ_NEGOTIATE_MS for it to answer with the same line. A
+* peer that does not know the extension (the SCARA simulator) ignores the offer, and text commands are sent.
+*/
+void CRobot::NegotiateBlocks()
+{
+   char answer[sizeof(TRAJ_PROTOCOL_LINE)];
+   int len = 0, nRead;
+   unsigned long long tDeadlineUs = TraceClockUs() + TRAJ_NEGOTIATE_MS * 1000ULL;
+   long long tLeftUs;
+
+   m_bBlocks = false;
+   try
+   {
+      Write(TRAJ_PROTOCOL_LINE, (int)strlen(TRAJ_PROTOCOL_LINE));
+      while(len < (int)sizeof(answer) - 1 && (len == 0 || answer[len - 1] != '\n'))
+      {
+         tLeftUs = (long long)(tDeadlineUs - TraceClockUs());
+         if(tLeftUs <= 0 || !WaitForData((int)(tLeftUs / 1000))) return;
+         nRead = Read(answer + len, (int)sizeof(answer) - 1 - len);
+         if(nRead <= 0) return;
+         len += nRead;
+      }
+   }
+   catch(CSocketException e)
+   {
+      return;  // Connect succeeded.  Later sends find the broken connection.
+   }
+   m_bBlocks = strcmp(answer, TRAJ_PROTOCOL_LINE) == 0;
+}
+
+/**
+* Waits for data to read.
+* @param timeoutMs longest wait
+* @return true if there is data (or the connection closed, so Read returns at once)
+*/
+bool CRobot::WaitForData(int timeoutMs)
+{
+   fd_set readSet;
+   timeval timeout;
+
+   if(m_shm != NULL) return m_shm->WaitForData(timeoutMs);
+   FD_ZERO(&readSet);
+   FD_SET(m_socket, &readSet);
+   timeout.tv_sec = timeoutMs / 1000;
+   timeout.tv_usec = (timeoutMs % 1000) * 1000;
+   return select((int)m_socket + 1, &readSet, NULL, NULL, &timeout) > 0;
 }
 
 /**
 * Writes data to the socket. Returns number of bytes written
 * @param data data to write
 */
-int CRobot::Send(const char *data) throw (CSocketException)
+int CRobot::Send(const char *data)
+{
+   return Send(data, (int)strlen(data));
+}
+
+/**
+* Writes len bytes of data to the socket. Used when the length is already known (see CCommandWriter)
+* The data is only queued when SetQueued(true) was called.
+* @param data data to write
+* @param len number of bytes to write
+*/
+int CRobot::Send(const char *data, int len)
+{
+   int nret;
+
+   if(m_bQueued)
+   {
+      m_queue.push_back(string(data, len));
+      return 0;
+   }
+
+   nret = Write(data, len);
+   if(m_nPacingMs > 0 && !m_bNullTransport) Sleep(m_nPacingMs);
+   return nret;
+}
+
+/**
+* Writes the oldest queued send. Instead of sleeping for the pacing delay it sets the time the next one may be
+* written (GetReadyTimeUs) so the caller can do other work in the meantime.
+*/
+int CRobot::SendQueued()
 {
-   int len, nret = 0, nSent, nTotalSent = 0;
+   string data;
+   int nret;
 
-   len = (int)strlen(data);
+   if(m_queue.empty()) return 0;
+   data = m_queue.front();
+   m_queue.pop_front();
 
+   nret = Write(data.c_str(), (int)data.size());
+   m_tReadyUs = TraceClockUs() + (m_bNullTransport ? 0 : (unsigned long long)m_nPacingMs * 1000);
+   return nret;
+}
+
+/**
+* Writes len bytes of data to the socket, counts and records it
+* @param data data to write
+* @param len number of bytes to write
+*/
+int CRobot::Write(const char *data, int len)
+{
+   int nret = 0, nSent, nTotalSent = 0;
+
+   m_nSends++;
+   m_nBytesSent += len;
+   if(m_preview != NULL || m_estimator != NULL)
+   {
+      string text;                              // the lines a trajectory block stands for
+      const char *lines = data;
+      int numBytes = len, size = GetTrajectoryBlockSize(data, len);
+      if(size >= 0 && size < len)
+      {
+         if(DecodeTrajectoryBlock(data + len - size, size, &text) < 0) text.clear();
+         lines = text.c_str();
+         numBytes = (int)text.size();
+      }
+      if(m_preview != NULL) m_preview->Draw(lines, numBytes);
+      if(m_estimator != NULL) m_estimator->Add(lines, numBytes);
+   }
+   if(m_bNullTransport)
+   {
+      if(m_recorder != NULL) m_recorder->Record(TRACE_SEND, data, len);
+      return 0;
+   }
+
+   if(m_shm != NULL)
+   {
+      if(m_shm->Write(data, len) < 0) throw CSocketException(WSAECONNRESET, "Shared memory link closed: Send()");
+      nTotalSent = len;
+   }
    while(nTotalSent < len)
    {
       nSent = send(m_socket, data + nTotalSent, len - nTotalSent, 0);
@@ -247,7 +643,7 @@ int CRobot::Send(const char *data) throw (CSocketException)
          nTotalSent += nSent;
       }
    }
-   Sleep(200);
+   if(m_recorder != NULL) m_recorder->Record(TRACE_SEND, data, len);
    return nret;
 }
 
@@ -256,24 +652,37 @@ int CRobot::Send(const char *data) throw (CSocketException)
 * @param buffer Data buffer
 * @param len Number of bytes to read
 */
-int CRobot::Read(char *buffer, int len) throw (CSocketException)
+int CRobot::Read(char *buffer, int len)
 {
    int nret = 0;
-   nret = recv(m_socket, buffer, len, 0);
+   if(m_shm != NULL)
+      nret = m_shm->Read(buffer, len);
+   else
+      nret = recv(m_socket, buffer, len, 0);
    if(nret == SOCKET_ERROR)
    {
       nret = WSAGetLastError();
       throw CSocketException(nret, "Network failure: Read()");
    }
    buffer[nret] = '\0';
+   if(m_recorder != NULL) m_recorder->Record(TRACE_READ, buffer, nret);
    return nret;
 }
 
+/**
+* Closes the socket. Safe to call more than once.
+*/
 void CRobot::Close()
 {
-   closesocket(m_socket);
+   if(m_shm != NULL) delete m_shm;  // the peer sees the end of the stream
+   m_shm = NULL;
+   if(m_socket != INVALID_SOCKET) closesocket(m_socket);
+   m_socket = INVALID_SOCKET;
+   m_bBlocks = false;
    if(m_clientAddr != NULL) delete m_clientAddr;
-   CWinSock::Finalize();
+   m_clientAddr = NULL;
+   if(m_bWinSockStarted) CWinSock::Finalize();
+   m_bWinSockStarted = false;
 }
 
 int CRobot::Initialize()
@@ -282,20 +691,36 @@ int CRobot::Initialize()
    system("cls");
    printf("Connecting to %s through port %d...\n", IPV4_STRING, PORT);
 
-   // initializes winsock
-   CWinSock::Initialize();
-   nret = Connect(IPV4_STRING, PORT);
+   nret = Open(IPV4_STRING, PORT);
    if(nret == 0)
    {
+      printf("Connect failed.");
       printf("\n\nSimulator must be started and placed in\n");
       printf("remote mode before running this program.\n\n");
       printf("Press ENTER to close program...");
       getchar();
       return FALSE;
    }
+   if(m_shm != NULL) printf("Connected through shared memory\n");
+   if(m_bOfferBlocks)
+      printf(m_bBlocks ? "Simulator takes trajectory blocks\n" : "Simulator does not take trajectory blocks, "
+             "sending text commands\n");
    return TRUE;
 }
 
+/**
+* Starts WinSock for this robot (WSAStartup is reference counted, so Close only ends this robot's use of it) and
+* connects to host. Prints nothing, so any number of robots can be opened from different threads.
+* @param host_name host name or address
+* @param port port number
+*/
+int CRobot::Open(const char *host_name, int port)
+{
+   if(!m_bWinSockStarted) CWinSock::Initialize();
+   m_bWinSockStarted = true;
+   return Connect(host_name, port);
+}
+
 CRobot::~CRobot()
 {
    Close();
@@ -309,6 +734,8 @@ CSocketAddress::CSocketAddress(const char *host, int port)
    m_sockAddrIn.sin_addr.s_addr = INADDR_ANY; // initialized only in GetSockAddrIn()
    m_sockAddrIn.sin_port = htons((u_short)port);
    m_strHostName = host;
+   m_strIP[0] = '\0';
+   m_bNameLookedUp = false;
    m_nPort = port;
 }
 
@@ -317,54 +744,67 @@ CSocketAddress::CSocketAddress(SOCKADDR_IN sockAddr)
    m_sockAddrIn.sin_family = sockAddr.sin_family;
    m_sockAddrIn.sin_addr.s_addr = sockAddr.sin_addr.s_addr;
    m_sockAddrIn.sin_port = sockAddr.sin_port;
-   m_strHostName = inet_ntoa(m_sockAddrIn.sin_addr);
+   m_strHostName = GetIP();
+   m_bNameLookedUp = false;
    m_nPort = sockAddr.sin_port;;
 }
 
 const char *CSocketAddress::GetIP()
 {
-   return (const char *)inet_ntoa(m_sockAddrIn.sin_addr);
+   if(inet_ntop(AF_INET, &m_sockAddrIn.sin_addr, m_strIP, sizeof(m_strIP)) == NULL) m_strIP[0] = '\0';
+   return m_strIP;
 }
 
+/**
+* Returns the official name of the IP address (looked up once) or NULL if it has none
+*/
 const char *CSocketAddress::GetName()
 {
-   HOSTENT *lpHost = gethostbyname(GetIP());
-   if(lpHost == NULL) return NULL;
-   return lpHost->h_name;
+   char name[NI_MAXHOST];
+
+   if(!m_bNameLookedUp)
+   {
+      m_bNameLookedUp = true;
+      if(getnameinfo((const SOCKADDR *)&m_sockAddrIn, sizeof(m_sockAddrIn), name, sizeof(name), NULL, 0,
+                     NI_NAMEREQD) == 0) m_strName = name;
+   }
+   return m_strName.empty() ? NULL : m_strName.c_str();
 }
 
+/**
+* Returns the other names of the host: its canonical name and the official name of its address
+*/
 void CSocketAddress::GetAliases(vector<string> *ret)
 {
-   HOSTENT *lpHost = gethostbyname(GetIP());
-   if(lpHost == NULL) return;
-   char **tmp = (char **)lpHost->h_aliases;
-   if(tmp == NULL)
-      return;
-   else
-   {
-      int i = 0;
-      while(true)
-      {
-         if(tmp[i] == NULL) break;
-         else ret->push_back(tmp[i]);
-      }
-   }
+   string name;
+   const char *official;
+
+   if(CResolver::GetCanonicalName(m_strHostName.c_str(), &name, RESOLVE_TIMEOUT_MS) && name != m_strHostName)
+      ret->push_back(name);
+   official = GetName();
+   if(official != NULL && official != m_strHostName && official != name) ret->push_back(official);
 }
 
 /**
-* Returns the sockaddr_in. tries to bind with the server.
+* Returns the sockaddr_in (the first IPv4 address of the host).
 * throws CSocketException on failure.
 */
-SOCKADDR_IN CSocketAddress::GetSockAddrIn() throw (CSocketException)
+SOCKADDR_IN CSocketAddress::GetSockAddrIn()
 {
-   m_lpHostEnt = gethostbyname(m_strHostName.c_str());
-   if(!m_lpHostEnt)
+   SOCKADDR_STORAGE addrs[MAX_HOST_ADDRESSES];
+   int addrLens[MAX_HOST_ADDRESSES], numAddrs, n;
+
+   numAddrs = CResolver::Resolve(m_strHostName.c_str(), m_nPort, addrs, addrLens, MAX_HOST_ADDRESSES,
+                                 RESOLVE_TIMEOUT_MS);
+   for(n = 0; n < numAddrs; n++)
    {
-      int nret = WSAGetLastError();
-      throw CSocketException(nret, "Failed to resolve host:gethostbyname()");
+      if(addrs[n].ss_family == AF_INET)
+      {
+         m_sockAddrIn.sin_addr = ((SOCKADDR_IN *)&addrs[n])->sin_addr;
+         return m_sockAddrIn;
+      }
    }
-   m_sockAddrIn.sin_addr = *((LPIN_ADDR)*m_lpHostEnt->h_addr_list);
-   return m_sockAddrIn;
+   throw CSocketException(WSAHOST_NOT_FOUND, "Failed to resolve host:getaddrinfo()");
 }
 
 void CSocketAddress::operator = (CSocketAddress addr)
@@ -372,7 +812,8 @@ void CSocketAddress::operator = (CSocketAddress addr)
    m_sockAddrIn = addr.m_sockAddrIn;
    m_strHostName = addr.m_strHostName;
    m_nPort = addr.m_nPort;
-   m_lpHostEnt = addr.m_lpHostEnt;
+   m_strName = addr.m_strName;
+   m_bNameLookedUp = addr.m_bNameLookedUp;
 }
 
 CSocketAddress::~CSocketAddress()
@@ -5,18 +5,30 @@
 #include <string>
 using namespace std;
 #include <vector>
+#include <deque>
+#include <winsock2.h>
+#include <ws2tcpip.h>
 #include <windows.h>
+#include "trace.h"
 
 #define PORT         1270
 #define IPV4_STRING  "127.0.0.1"
 
+#define RESOLVE_TIMEOUT_MS 2000   /// longest wait for a host name to resolve
+#define RESOLVE_CACHE_SEC 300     /// how long a resolved host name is reused
+#define CONNECT_TIMEOUT_MS 3000   /// longest wait for a simulator to accept a connection
+#define MAX_HOST_ADDRESSES 8      /// addresses kept for one host name (IPv4 and IPv6)
+
 #pragma warning (disable : 4290)
-#pragma comment(lib,"wsock32")
+#pragma comment(lib,"ws2_32")
 
 namespace openutils
 {
 
    class CRobot;
+   class CSharedMemoryLink;
+   class CPreviewRenderer;
+   class CJobEstimator;
    class CSocketException;
    class CSocketAddress;
 
@@ -27,6 +39,19 @@ namespace openutils
       static void Finalize();/// WSACleanup
    };
 
+   /// Resolves host names with getaddrinfo (IPv4 and IPv6) on worker threads and keeps the results for
+   /// RESOLVE_CACHE_SEC, so a name is only looked up once and no caller waits longer than its timeout.
+   class CResolver
+   {
+   public:
+      static int Resolve(const char *host, int port, SOCKADDR_STORAGE *addrs, int *addrLens, int maxAddrs,
+                         int timeoutMs); /// gets the addresses of host with port set.  0 if failed or timed out
+      static bool GetCanonicalName(const char *host, string *name, int timeoutMs); /// official name of host
+   private:
+      static bool Start(const char *host); /// starts a lookup unless one is cached or running.  Locked
+      static void Lookup(string host); /// worker thread: runs getaddrinfo and stores the result
+   };
+
    class CServerSocket
    {
    private:
@@ -43,7 +68,9 @@ namespace openutils
       CServerSocket(int port, int queue); /// overloaded constructor
       ~CServerSocket(); /// default destructor
       void Bind(CSocketAddress *scok_addr);/// Binds the server to the given address.
-      CRobot *Accept() throw (CSocketException);/// Accepts a client connection.
+      CRobot *Accept();/// Accepts a client connection. Throws CSocketException
+      void Listen(bool bLocalOnly); /// Binds and listens without waiting for a client. Throws CSocketException
+      SOCKET GetSocket() { return m_socket; } /// returns the listening SOCKET (for select)
       void Close(); /// Closes the Socket.	
       bool IsListening(); /// returns the listening flag
 
@@ -61,26 +88,71 @@ namespace openutils
    private:
       SOCKET m_socket; /// SOCKET for communication
       CSocketAddress *m_clientAddr; /// Address details of this socket.
+      int m_nPacingMs; /// delay after every Send so the simulator keeps up (0 = none)
+      bool m_bWinSockStarted; /// true if this object called CWinSock::Initialize
+      CTraceRecorder *m_recorder; /// records every Send and Read when not NULL
+      CPreviewRenderer *m_preview; /// draws every Send when not NULL
+      CJobEstimator *m_estimator; /// times every Send when not NULL
+      bool m_bNullTransport; /// true to discard everything sent (benchmarks)
+      unsigned long m_nSends; /// number of Send calls
+      unsigned long long m_nBytesSent; /// number of bytes sent
+      bool m_bQueued; /// true to queue sends for SendQueued instead of writing them (see CExecutor)
+      deque<string> m_queue; /// data waiting for SendQueued
+      unsigned long long m_tReadyUs; /// TraceClockUs time the simulator can take the next queued send
+      CSharedMemoryLink *m_shm; /// shared memory link used instead of m_socket (NULL = TCP)
+      bool m_bSharedMemory; /// true to try a shared memory link before TCP when connecting to this host
+      int m_nConnectTimeoutMs; /// longest wait for Connect to get through all addresses of the host
+      bool m_bOfferBlocks; /// true to offer trajectory blocks when connecting (see trajblock.h)
+      bool m_bBlocks; /// true if the peer accepted trajectory blocks
+      friend class CServerSocket;
    public:
       CRobot(); /// Default constructor
       void SetSocket(SOCKET sock); /// Sets the SOCKET
+      SOCKET GetSocket() { return m_socket; } /// Returns the SOCKET (for select)
+      void SetPacing(int ms) { m_nPacingMs = ms; } /// Sets the delay after every Send
+      void SetConnectTimeout(int ms) { m_nConnectTimeoutMs = ms; } /// Sets the longest wait of Connect
+      void SetRecorder(CTraceRecorder *rec) { m_recorder = rec; } /// Records traffic to rec (NULL to stop)
+      void SetPreview(CPreviewRenderer *preview) { m_preview = preview; } /// Draws sends with preview (NULL to stop)
+      void SetEstimator(CJobEstimator *estimator) { m_estimator = estimator; } /// Times sends (NULL to stop)
+      void SetNullTransport(bool bNull) { m_bNullTransport = bNull; } /// Discards sends instead of writing them
+      unsigned long GetNumSends() { return m_nSends; } /// Returns the number of Send calls
+      unsigned long long GetNumBytesSent() { return m_nBytesSent; } /// Returns the number of bytes sent
+      void SetQueued(bool bQueued) { m_bQueued = bQueued; } /// Queues sends for SendQueued instead of writing them
+      size_t GetNumQueued() { return m_queue.size(); } /// Returns the number of sends waiting in the queue
+      void ClearQueue() { m_queue.clear(); } /// Drops the sends waiting in the queue (connection lost)
+      unsigned long long GetReadyTimeUs() { return m_tReadyUs; } /// Returns when the next queued send may be written
+      void SetSharedMemory(bool bAllow) { m_bSharedMemory = bAllow; } /// false to always Connect over TCP
+      void SetSharedMemoryLink(CSharedMemoryLink *link); /// Uses link instead of a socket (deleted by Close)
+      bool IsSharedMemory() { return m_shm != NULL; } /// true if connected through shared memory
+      void SetTrajectoryBlocks(bool bOffer) { m_bOfferBlocks = bOffer; } /// Offers trajectory blocks at Connect
+      bool HasTrajectoryBlocks() { return m_bBlocks; } /// true if trajectory blocks may be sent
       void SetClientAddr(SOCKADDR_IN addr); /// Sets address details
       int Connect(); /// Connects to a server
       int Connect(const char *host_name, int port); /// Connects to host
       CSocketAddress *GetAddress() { return m_clientAddr; } /// Returns the client address
-      int Send(const char *data) throw (CSocketException); /// Writes data to the socket
-      int Read(char *buffer, int len) throw (CSocketException); /// Reads data from the socket
+      int Send(const char *data); /// Writes data to the socket. Throws CSocketException
+      int Send(const char *data, int len); /// Writes len bytes of data. Throws CSocketException
+      int SendQueued(); /// Writes the oldest queued send without waiting for pacing. Throws CSocketException
+      int Read(char *buffer, int len); /// Reads data from the socket. Throws CSocketException
       void Close(); /// Closes the socket
-      int Initialize();
+      int Initialize(); /// Connects to the simulator on this host (console program: reports and waits on failure)
+      int Open(const char *host_name, int port); /// Starts WinSock for this object and connects (Close balances it)
       ~CRobot(); /// Destructor
+   private:
+      int Write(const char *data, int len); /// writes len bytes of data to the socket. Throws CSocketException
+      SOCKET ConnectSocket(const SOCKADDR *addr, int addrLen, unsigned long long tDeadlineUs); /// non-blocking
+      void NegotiateBlocks(); /// offers trajectory blocks and waits for the answer
+      bool WaitForData(int timeoutMs); /// true if data arrives within timeoutMs
    };
 
    class CSocketAddress
    {
    private:
       SOCKADDR_IN m_sockAddrIn; /// server info
-      LPHOSTENT m_lpHostEnt; /// used to obtain address by name
       string m_strHostName; /// host name
+      char m_strIP[INET6_ADDRSTRLEN]; /// IP address string
+      string m_strName; /// official name (reverse lookup of the IP address, done once)
+      bool m_bNameLookedUp; /// true once m_strName has been looked up
       int m_nPort; /// port 
    public:
       CSocketAddress(const char *host, int port); /// default constructor		
@@ -89,7 +161,7 @@ namespace openutils
       const char *GetName(); /// Returns the official address
       int GetPort() { return m_nPort; } /// Returns the port
       void GetAliases(vector<string> *ret); /// Returns aliases
-      SOCKADDR_IN GetSockAddrIn() throw (CSocketException); /// returns the sockaddr_in
+      SOCKADDR_IN GetSockAddrIn(); /// returns the sockaddr_in. Throws CSocketException
       void operator = (CSocketAddress addr); /// Assignment operation
       ~CSocketAddress(); /// Destructor
    };
@@ -0,0 +1,21 @@
+#include <string.h>  // string functions
+#include "scara.h"   // SCARA kinematics
+
+// all arm models that can be selected with the ARM_MODEL command.  The first one is the default.
+const SCARA_MODEL SCARA_MODELS[] = {makeScaraModel<SCARA_STANDARD>(), makeScaraModel<SCARA_COMPACT>(),
+                                    makeScaraModel<SCARA_EXTENDED>()};
+const char *const SCARA_MODEL_NAMES[] = {SCARA_STANDARD::NAME, SCARA_COMPACT::NAME, SCARA_EXTENDED::NAME};
+const int NUM_SCARA_MODELS = (int)(sizeof(SCARA_MODELS) / sizeof(SCARA_MODELS[0]));
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  finds an arm model by its keyword
+// ARGUMENTS:    name:  model keyword (upper case)
+// RETURN VALUE: the arm model, NULL if not found
+const SCARA_MODEL *findScaraModel(const char *name)
+{
+   for(int n = 0; n < NUM_SCARA_MODELS; n++)
+   {
+      if(strcmp(name, SCARA_MODELS[n].name) == 0) return &SCARA_MODELS[n];
+   }
+   return NULL;
+}
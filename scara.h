@@ -0,0 +1,204 @@
+#ifndef _SCARA_H_
+#define _SCARA_H_
+
+#include <math.h>    // math functions
+#include <float.h>   // DBL_MAX
+
+//---------------------------- Kinematic Constants --------------------------------------------------------------------
+constexpr double PI = 3.14159265358979323846;    // the one and only
+constexpr double ERROR_VALUE = DBL_MAX;          // value for angles when robot can't reach
+
+enum ARM { LEFT, RIGHT };                    // left arm or right arm configuration
+
+// simulator joint speed (degrees per second) at LOW, MEDIUM and HIGH motor speed.  The stand-in simulator moves at
+// it and the job duration estimator starts from it (-calibrate fits the real ones).
+constexpr double MOTOR_SPEED_DEG_PER_SEC[3] = {30.0, 60.0, 120.0};
+
+//---------------------------- Structure Definitions ------------------------------------------------------------------
+
+// SCARA tooltip coordinates
+typedef struct TOOL_POSITION
+{
+   double x, y;
+}
+TOOL_POSITION;
+
+// SCARA joint angles (degrees)
+typedef struct JOINT_ANGLES
+{
+   double theta1Deg, theta2Deg;
+}
+JOINT_ANGLES;
+
+// forward kinematics solution data 
+typedef struct FORWARD_SOLUTION
+{
+   TOOL_POSITION toolPos;  // tool tip coordinates
+   bool bCanReach;         // true if robot can reach, false if not
+}
+FORWARD_SOLUTION;
+
+// inverse kinematics solution data 
+typedef struct INVERSE_SOLUTION
+{
+   JOINT_ANGLES jointAngles[2];  // joint angles (in degrees).  Left and Right arm solutions
+   bool bCanReach[2];            // true if robot can reach, false if not.  Left and right arm configurations
+}
+INVERSE_SOLUTION;
+
+// arm model selected at run time.  Function pointers lead to kinematics specialized for the model (see below).
+typedef struct SCARA_MODEL
+{
+   const char *name;                       // model keyword (ARM_MODEL command)
+   double L1, L2;                          // inner and outer arm lengths
+   double absTheta1DegMax;                 // maximum magnitude of shoulder angle in degrees
+   double absTheta2DegMax;                 // maximum magnitude of elbow angle in degrees
+   double LMIN, LMAX;                      // minimum and maximum reach
+   INVERSE_SOLUTION (*inverseKinematics)(TOOL_POSITION tp);
+   FORWARD_SOLUTION (*forwardKinematics)(JOINT_ANGLES ja);
+}
+SCARA_MODEL;
+
+extern const SCARA_MODEL SCARA_MODELS[];          // all arm models.  The first one is the default.
+extern const char *const SCARA_MODEL_NAMES[];     // arm model keywords (same order as SCARA_MODELS)
+extern const int NUM_SCARA_MODELS;                // number of arm models
+const SCARA_MODEL *findScaraModel(const char *name); // finds an arm model by keyword.  NULL if not found.
+
+//---------------------------- Arm Model Geometry ---------------------------------------------------------------------
+// Every arm model is a struct of constexpr geometry.  Add a struct here and an entry in SCARA_MODELS and
+// SCARA_MODEL_NAMES (scara.cpp) to support another arm size.
+
+struct SCARA_STANDARD  // the lab SCARA robot
+{
+   static constexpr const char *NAME = "STANDARD";
+   static constexpr double L1 = 350.0;
+   static constexpr double L2 = 250.0;
+   static constexpr double ABS_THETA1_DEG_MAX = 150.0;
+   static constexpr double ABS_THETA2_DEG_MAX = 170.0;
+};
+
+struct SCARA_COMPACT  // short arm for small work areas
+{
+   static constexpr const char *NAME = "COMPACT";
+   static constexpr double L1 = 250.0;
+   static constexpr double L2 = 200.0;
+   static constexpr double ABS_THETA1_DEG_MAX = 150.0;
+   static constexpr double ABS_THETA2_DEG_MAX = 160.0;
+};
+
+struct SCARA_EXTENDED  // long reach arm
+{
+   static constexpr const char *NAME = "EXTENDED";
+   static constexpr double L1 = 450.0;
+   static constexpr double L2 = 300.0;
+   static constexpr double ABS_THETA1_DEG_MAX = 160.0;
+   static constexpr double ABS_THETA2_DEG_MAX = 170.0;
+};
+
+//---------------------------- Specialized Kinematics -----------------------------------------------------------------
+// Compile time helpers.  std::cos and std::sqrt are not constexpr so the reach limits use these instead.
+
+// cosine by Taylor series.  Accurate to double precision for |x| <= PI.
+constexpr double constexprCos(double x)
+{
+   double term = 1.0, sum = 1.0;
+   for(int n = 1; n < 30; n++)
+   {
+      term *= -x * x / ((2.0 * n - 1.0) * (2.0 * n));
+      sum += term;
+   }
+   return sum;
+}
+
+// square root by Newton iteration (x >= 0)
+constexpr double constexprSqrt(double x)
+{
+   double r = (x > 1.0 ? x : 1.0);
+   for(int n = 0; n < 100; n++) r = 0.5 * (r + x / r);
+   return r;
+}
+
+// geometry derived from an arm model at compile time
+template<class MODEL> struct SCARA_LIMITS
+{
+   static constexpr double LMAX = MODEL::L1 + MODEL::L2;   // max L -> maximum reach of robot
+   static constexpr double LMIN = constexprSqrt(MODEL::L1 * MODEL::L1 + MODEL::L2 * MODEL::L2 - 2.0 * MODEL::L1 *
+                                  MODEL::L2 * constexprCos(PI - MODEL::ABS_THETA2_DEG_MAX * PI / 180.0)); // min L
+};
+
+// maps an angle in radians into -PI <= ang <= +PI
+inline double mapAngleRad(double angRad)
+{
+   angRad = fmod(angRad, 2.0 * PI);
+   if(angRad > PI)
+      angRad -= 2.0 * PI;
+   else if(angRad < -PI)
+      angRad += 2.0 * PI;
+   return angRad;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  computes the left and right arm joint angles for a tool tip position
+// ARGUMENTS:    tp:  tool tip position
+// RETURN VALUE: left/right joint angles (degrees) and whether each configuration can reach the point
+template<class MODEL> INVERSE_SOLUTION inverseKinematicsFor(TOOL_POSITION tp)
+{
+   constexpr double L1 = MODEL::L1, L2 = MODEL::L2;
+   INVERSE_SOLUTION isol;                          // the solution
+   double L = sqrt(tp.x * tp.x + tp.y * tp.y);     // distance from shoulder to tool tip
+   double beta, theta1, theta2, c2;                // angles (radians), cos(theta2)
+   int arm;                                        // arm index
+
+   for(arm = LEFT; arm <= RIGHT; arm++)
+   {
+      isol.jointAngles[arm].theta1Deg = ERROR_VALUE;
+      isol.jointAngles[arm].theta2Deg = ERROR_VALUE;
+      isol.bCanReach[arm] = false;
+   }
+
+   if(L < SCARA_LIMITS<MODEL>::LMIN || L > SCARA_LIMITS<MODEL>::LMAX) return isol;
+
+   beta = atan2(tp.y, tp.x);
+   c2 = (L * L - (L1 * L1 + L2 * L2)) * (1.0 / (2.0 * L1 * L2));
+   c2 = fmax(-1.0, fmin(1.0, c2));  // guard round-off at the edges of the workspace
+
+   for(arm = LEFT; arm <= RIGHT; arm++)
+   {
+      theta2 = (arm == LEFT ? -acos(c2) : acos(c2));
+      theta1 = beta - atan2(L2 * sin(theta2), L1 + L2 * cos(theta2));
+
+      isol.jointAngles[arm].theta1Deg = mapAngleRad(theta1) * (180.0 / PI);
+      isol.jointAngles[arm].theta2Deg = mapAngleRad(theta2) * (180.0 / PI);
+      isol.bCanReach[arm] = fabs(isol.jointAngles[arm].theta1Deg) <= MODEL::ABS_THETA1_DEG_MAX
+                         && fabs(isol.jointAngles[arm].theta2Deg) <= MODEL::ABS_THETA2_DEG_MAX;
+   }
+
+   return isol;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// DESCRIPTION:  computes the tool tip position for a set of joint angles
+// ARGUMENTS:    ja:  joint angles (degrees)
+// RETURN VALUE: tool tip position and whether the joint angles are within the robot limits
+template<class MODEL> FORWARD_SOLUTION forwardKinematicsFor(JOINT_ANGLES ja)
+{
+   FORWARD_SOLUTION fsol;                                      // the solution
+   double theta1 = ja.theta1Deg * (PI / 180.0);                // shoulder angle (radians)
+   double theta12 = (ja.theta1Deg + ja.theta2Deg) * (PI / 180.0); // absolute outer arm angle (radians)
+
+   fsol.toolPos.x = MODEL::L1 * cos(theta1) + MODEL::L2 * cos(theta12);
+   fsol.toolPos.y = MODEL::L1 * sin(theta1) + MODEL::L2 * sin(theta12);
+   fsol.bCanReach = fabs(ja.theta1Deg) <= MODEL::ABS_THETA1_DEG_MAX && fabs(ja.theta2Deg) <= MODEL::ABS_THETA2_DEG_MAX;
+
+   return fsol;
+}
+
+// run time description of an arm model with its specialized kinematics
+template<class MODEL> constexpr SCARA_MODEL makeScaraModel()
+{
+   return {MODEL::NAME, MODEL::L1, MODEL::L2, MODEL::ABS_THETA1_DEG_MAX, MODEL::ABS_THETA2_DEG_MAX,
+           SCARA_LIMITS<MODEL>::LMIN, SCARA_LIMITS<MODEL>::LMAX,
+           inverseKinematicsFor<MODEL>, forwardKinematicsFor<MODEL>};
+}
+
+#endif
@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <string.h>
+#include "shmlink.h"
+#include "trace.h"
+using namespace openutils;
+
+static const unsigned int SHM_LINK_MAGIC = 0x4B4E4C53;  // "SLNK"
+static const char *SHM_LINK_NAME = "Local\\ROBT1270_SCARA_%d";          // section name (port)
+static const char *SHM_EVENT_NAME = "Local\\ROBT1270_SCARA_%d_EVENT%d"; // event name (port, event index)
+
+CSharedMemoryLink::CSharedMemoryLink()
+{
+   m_hMapping = NULL;
+   m_link = NULL;
+   m_out = m_in = NULL;
+   for(int n = 0; n < 4; n++) m_hEvents[n] = NULL;
+   m_hOutData = m_hOutSpace = m_hInData = m_hInSpace = NULL;
+}
+
+CSharedMemoryLink::~CSharedMemoryLink()
+{
+   Close();
+}
+
+/**
+* Simulator side. Sets up the link of port and waits for a controller to take it (see IsConnected).
+* @param port simulator port the link is named after
+*/
+bool CSharedMemoryLink::Create(int port)
+{
+   if(!Map(port, true)) return false;
+   m_out = &m_link->rings[1];
+   m_in = &m_link->rings[0];
+   m_hOutData = m_hEvents[2];
+   m_hOutSpace = m_hEvents[3];
+   m_hInData = m_hEvents[0];
+   m_hInSpace = m_hEvents[1];
+   m_link->state.store(SHM_LINK_LISTENING);
+   m_link->magic.store(SHM_LINK_MAGIC);
+   return true;
+}
+
+/**
+* Controller side. Takes the link of a simulator listening on port. Fails if there is no such simulator or
+* another controller already has it.
+* @param port simulator port
+*/
+bool CSharedMemoryLink::Open(int port)
+{
+   unsigned int state = SHM_LINK_LISTENING;
+
+   if(!Map(port, false)) return false;
+   if(m_link->magic.load() != SHM_LINK_MAGIC || !m_link->state.compare_exchange_strong(state, SHM_LINK_CONNECTED))
+   {
+      Unmap();  // not ours: leave the state alone
+      return false;
+   }
+   m_out = &m_link->rings[0];
+   m_in = &m_link->rings[1];
+   m_hOutData = m_hEvents[0];
+   m_hOutSpace = m_hEvents[1];
+   m_hInData = m_hEvents[2];
+   m_hInSpace = m_hEvents[3];
+   return true;
+}
+
+/**
+* Simulator side. True once a controller has taken the link (it may already have closed it again).
+*/
+bool CSharedMemoryLink::IsConnected()
+{
+   return m_link != NULL && m_link->state.load() != SHM_LINK_LISTENING;
+}
+
+/**
+* Writes all of data, waiting while the ring is full. Returns the number of bytes written.
+* @param data data to write
+* @param len number of bytes
+*/
+int CSharedMemoryLink::Write(const char *data, int len)
+{
+   unsigned int head, tail, space, pos, n, first;
+   int nTotal = 0;
+
+   while(nTotal < len)
+   {
+      if(m_link->state.load() == SHM_LINK_CLOSED) return -1;
+
+      head = m_out->head.load(std::memory_order_relaxed);
+      tail = m_out->tail.load(std::memory_order_acquire);
+      space = SHM_RING_SIZE - (head - tail);
+      if(space == 0)
+      {
+         Wait(&m_out->bWriterWaiting, &m_out->tail, tail, m_hOutSpace);
+         continue;
+      }
+
+      n = (unsigned int)(len - nTotal) < space ? (unsigned int)(len - nTotal) : space;
+      pos = head & (SHM_RING_SIZE - 1);
+      first = SHM_RING_SIZE - pos < n ? SHM_RING_SIZE - pos : n;
+      memcpy(m_out->data + pos, data + nTotal, first);
+      memcpy(m_out->data, data + nTotal + first, n - first);
+      m_out->head.store(head + n);  // sequentially consistent: the waiting flag below is read after it
+      nTotal += n;
+
+      if(m_out->bReaderWaiting.load()) SetEvent(m_hOutData);
+   }
+   return nTotal;
+}
+
+/**
+* Reads the bytes that have arrived, waiting until there is at least one. Returns the number of bytes read or 0
+* if the peer closed the link and everything it wrote has been read.
+* @param buffer receives the data
+* @param len size of buffer
+*/
+int CSharedMemoryLink::Read(char *buffer, int len)
+{
+   unsigned int head, tail, avail, pos, n, first;
+
+   while(true)
+   {
+      tail = m_in->tail.load(std::memory_order_relaxed);
+      head = m_in->head.load(std::memory_order_acquire);
+      avail = head - tail;
+      if(avail > 0) break;
+      if(m_link->state.load() == SHM_LINK_CLOSED)
+      {
+         if(m_in->head.load() == tail) return 0;  // nothing was written before it closed
+         continue;
+      }
+      Wait(&m_in->bReaderWaiting, &m_in->head, head, m_hInData);
+   }
+
+   n = (unsigned int)len < avail ? (unsigned int)len : avail;
+   pos = tail & (SHM_RING_SIZE - 1);
+   first = SHM_RING_SIZE - pos < n ? SHM_RING_SIZE - pos : n;
+   memcpy(buffer, m_in->data + pos, first);
+   memcpy(buffer + first, m_in->data, n - first);
+   m_in->tail.store(tail + n);  // sequentially consistent: the waiting flag below is read after it
+
+   if(m_in->bWriterWaiting.load()) SetEvent(m_hInSpace);
+   return (int)n;
+}
+
+/**
+* Waits for data to read without reading it.
+* @param timeoutMs longest wait (give or take SHM_WAIT_MS)
+* @return true if there is data, or the peer has closed the link (Read returns at once)
+*/
+bool CSharedMemoryLink::WaitForData(int timeoutMs)
+{
+   unsigned long long tDeadlineUs = TraceClockUs() + (unsigned long long)timeoutMs * 1000;
+   unsigned int head;
+
+   while(true)
+   {
+      head = m_in->head.load(std::memory_order_acquire);
+      if(head != m_in->tail.load(std::memory_order_relaxed) || m_link->state.load() == SHM_LINK_CLOSED) return true;
+      if(TraceClockUs() >= tDeadlineUs) return false;
+      Wait(&m_in->bReaderWaiting, &m_in->head, head, m_hInData);
+   }
+}
+
+/**
+* Closes the link. A peer waiting in Read or Write is woken up and sees the link closed.
+*/
+void CSharedMemoryLink::Close()
+{
+   int n;
+
+   if(m_link != NULL)
+   {
+      m_link->state.store(SHM_LINK_CLOSED);
+      for(n = 0; n < 4; n++) if(m_hEvents[n] != NULL) SetEvent(m_hEvents[n]);
+   }
+   Unmap();
+}
+
+/**
+* Releases the view, the section and the events without changing the link state.
+*/
+void CSharedMemoryLink::Unmap()
+{
+   int n;
+
+   if(m_link != NULL) UnmapViewOfFile(m_link);
+   m_link = NULL;
+   for(n = 0; n < 4; n++)
+   {
+      if(m_hEvents[n] != NULL) CloseHandle(m_hEvents[n]);
+      m_hEvents[n] = NULL;
+   }
+   if(m_hMapping != NULL) CloseHandle(m_hMapping);
+   m_hMapping = NULL;
+   m_out = m_in = NULL;
+   m_hOutData = m_hOutSpace = m_hInData = m_hInSpace = NULL;
+}
+
+/**
+* Creates (simulator) or opens (controller) the shared memory section of port and its four events.
+* @param port simulator port
+* @param bCreate true to create, false to open
+*/
+bool CSharedMemoryLink::Map(int port, bool bCreate)
+{
+   char name[64];
+   int n;
+
+   Close();
+   sprintf_s(name, sizeof(name), SHM_LINK_NAME, port);
+   if(bCreate)
+   {
+      m_hMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(SHM_LINK), name);
+      if(m_hMapping != NULL && GetLastError() == ERROR_ALREADY_EXISTS)
+      {
+         CloseHandle(m_hMapping);  // another simulator has the port
+         m_hMapping = NULL;
+      }
+   }
+   else
+   {
+      m_hMapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+   }
+   if(m_hMapping == NULL) return false;
+
+   m_link = (SHM_LINK *)MapViewOfFile(m_hMapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(SHM_LINK));
+   if(m_link == NULL)
+   {
+      Unmap();
+      return false;
+   }
+
+   for(n = 0; n < 4; n++)
+   {
+      sprintf_s(name, sizeof(name), SHM_EVENT_NAME, port, n);
+      if(bCreate)
+         m_hEvents[n] = CreateEventA(NULL, FALSE, FALSE, name);  // auto-reset
+      else
+         m_hEvents[n] = OpenEventA(EVENT_MODIFY_STATE | SYNCHRONIZE, FALSE, name);
+      if(m_hEvents[n] == NULL)
+      {
+         Unmap();
+         return false;
+      }
+   }
+   return true;
+}
+
+/**
+* Sleeps until a ring index moves away from the value seen, after spinning briefly. The waiting flag is raised
+* before the index is checked the last time so the peer cannot move it without seeing the flag.
+* @param bWaiting waiting flag of this side
+* @param index ring index the peer moves
+* @param seen value of index that made this side wait
+* @param hEvent event the peer signals when it sees the flag
+*/
+void CSharedMemoryLink::Wait(std::atomic<unsigned int> *bWaiting, const std::atomic<unsigned int> *index,
+                             unsigned int seen, HANDLE hEvent)
+{
+   int n;
+
+   for(n = 0; n < SHM_SPIN_COUNT; n++)
+   {
+      if(index->load(std::memory_order_acquire) != seen) return;
+      YieldProcessor();
+   }
+
+   bWaiting->store(1);
+   if(index->load() == seen && m_link->state.load() != SHM_LINK_CLOSED) WaitForSingleObject(hEvent, SHM_WAIT_MS);
+   bWaiting->store(0);
+}
@@ -0,0 +1,64 @@
+#ifndef _SHMLINK_H_
+#define _SHMLINK_H_
+
+#include <atomic>
+#include <windows.h>
+
+#define SHM_RING_SIZE 65536      /// bytes in each direction (a power of 2)
+#define SHM_SPIN_COUNT 200       /// times the ring is checked again before sleeping on the event
+#define SHM_WAIT_MS 100          /// longest sleep before the peer state is checked again
+
+namespace openutils
+{
+
+   /// one direction of a shared memory link: a lock-free single producer, single consumer byte ring
+   struct SHM_RING
+   {
+      std::atomic<unsigned int> head; /// bytes ever written (changed by the producer only)
+      std::atomic<unsigned int> tail; /// bytes ever read (changed by the consumer only)
+      std::atomic<unsigned int> bReaderWaiting; /// consumer is going to sleep on the data event
+      std::atomic<unsigned int> bWriterWaiting; /// producer is going to sleep on the space event
+      char data[SHM_RING_SIZE]; /// ring contents
+   };
+
+   enum SHM_LINK_STATE { SHM_LINK_LISTENING, SHM_LINK_CONNECTED, SHM_LINK_CLOSED }; /// SHM_LINK::state
+
+   /// the shared memory of a link.  Named after the simulator port so a controller finds it like a TCP port.
+   struct SHM_LINK
+   {
+      std::atomic<unsigned int> magic; /// SHM_LINK_MAGIC once the simulator has set the link up
+      std::atomic<unsigned int> state; /// SHM_LINK_STATE
+      SHM_RING rings[2]; /// [0] controller to simulator, [1] simulator to controller
+   };
+
+   /// A connection between a controller and a simulator on the same host through two rings in a named
+   /// shared memory section. Like a futex, the rings are used without any system call while data flows; a
+   /// reader (or a writer of a full ring) only sleeps on a named event after raising its waiting flag, and the
+   /// other side only signals the event when it sees that flag.
+   class CSharedMemoryLink
+   {
+   private:
+      HANDLE m_hMapping; /// the shared memory section
+      SHM_LINK *m_link; /// mapped view of the section
+      SHM_RING *m_out, *m_in; /// ring written, ring read
+      HANDLE m_hEvents[4]; /// data and space events of rings[0], then of rings[1]
+      HANDLE m_hOutData, m_hOutSpace, m_hInData, m_hInSpace; /// events of m_out and m_in
+   public:
+      CSharedMemoryLink(); /// constructor
+      ~CSharedMemoryLink(); /// closes the link
+      bool Create(int port); /// simulator: sets up the link for port.  false if another simulator has it
+      bool Open(int port); /// controller: takes the link of a simulator on port.  false if there is none
+      bool IsConnected(); /// simulator: true once a controller has taken the link
+      int Write(const char *data, int len); /// writes all of data.  -1 if the peer has closed the link
+      int Read(char *buffer, int len); /// reads what has arrived (waits for 1 byte).  0 if the peer closed
+      bool WaitForData(int timeoutMs); /// true if there is data to read (or the peer closed) within timeoutMs
+      void Close(); /// closes the link (the peer sees the end of the stream)
+   private:
+      bool Map(int port, bool bCreate); /// creates or opens the section and the events
+      void Unmap(); /// releases the section and the events without closing the link
+      void Wait(std::atomic<unsigned int> *bWaiting, const std::atomic<unsigned int> *index, unsigned int seen,
+                HANDLE hEvent); /// sleeps until index moves away from seen (or the link closes)
+   };
+}
+
+#endif
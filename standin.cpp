@@ -0,0 +1,189 @@
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include "standin.h"
+#include "shmlink.h"
+#include "trajblock.h"
+#include "scara.h"
+using namespace openutils;
+
+CStandInSimulator::CStandInSimulator(int port) : m_server(port, 1)
+{
+   m_nLength = 0;
+   m_ang1 = m_ang2 = 0.0;
+   m_nSpeed = 1;
+   m_bShutdown = false;
+   m_shm = NULL;
+   m_recorder = NULL;
+}
+
+CStandInSimulator::~CStandInSimulator()
+{
+   if(m_shm != NULL) delete m_shm;
+}
+
+/**
+* Starts listening on the port and sets up its shared memory link (unless another simulator has it).
+*/
+void CStandInSimulator::Listen()
+{
+   m_server.Listen(true);
+   if(m_shm == NULL)
+   {
+      m_shm = new CSharedMemoryLink();
+      if(!m_shm->Create(m_server.GetPort()))
+      {
+         delete m_shm;
+         m_shm = NULL;
+      }
+   }
+}
+
+/**
+* Waits for a controller to connect over TCP or to take the shared memory link.
+*/
+CRobot *CStandInSimulator::Accept()
+{
+   CRobot *controller;
+   fd_set readSet;
+   timeval timeout;
+
+   while(true)
+   {
+      if(m_shm != NULL && m_shm->IsConnected())
+      {
+         controller = new CRobot();
+         controller->SetPacing(0);
+         controller->SetSharedMemoryLink(m_shm);
+         m_shm = NULL;
+         return controller;
+      }
+
+      FD_ZERO(&readSet);
+      FD_SET(m_server.GetSocket(), &readSet);
+      timeout.tv_sec = 0;
+      timeout.tv_usec = STANDIN_ACCEPT_POLL_MS * 1000;
+      if(select(0, &readSet, NULL, NULL, m_shm != NULL ? &timeout : NULL) > 0) return m_server.Accept();
+   }
+}
+
+/**
+* Waits for a controller to connect and consumes its commands until it disconnects or sends
+* SHUTDOWN_SIMULATION.
+* @param bRealTime true to take as long as the simulator would to carry out each joint move
+* @param stats receives the results
+*/
+void CStandInSimulator::Run(bool bRealTime, STANDIN_STATS *stats)
+{
+   CRobot *controller;
+   unsigned long long tStartUs;
+   char *eol;
+   int nRead, nLine, nBlock;
+
+   memset(stats, 0, sizeof(STANDIN_STATS));
+   Listen();
+   controller = Accept();
+   controller->SetPacing(0);  // answers are not paced
+   stats->bSharedMemory = controller->IsSharedMemory();
+   tStartUs = TraceClockUs();
+
+   try
+   {
+      while(!m_bShutdown)
+      {
+         if(m_recorder != NULL) m_recorder->Record(TRACE_READ, "\n", 1);  // waiting for data (a blank line)
+         nRead = controller->Read(m_buffer + m_nLength, STANDIN_BUFFER_SIZE - 1 - m_nLength);
+         if(nRead <= 0) break;
+         stats->numBytes += nRead;
+         m_nLength += nRead;
+
+         // handle every complete line and trajectory block
+         while(!m_bShutdown && (eol = (char *)memchr(m_buffer, '\n', m_nLength)) != NULL)
+         {
+            nLine = (int)(eol - m_buffer) + 1;
+            if((nBlock = GetTrajectoryBlockSize(m_buffer, nLine)) >= 0)
+            {
+               if(m_nLength < nLine + nBlock) break;  // the rest of the block has not arrived
+               HandleBlock(m_buffer + nLine, nBlock, bRealTime, stats);
+               nLine += nBlock;
+            }
+            else if(nLine == (int)strlen(TRAJ_PROTOCOL_LINE) && strncmp(m_buffer, TRAJ_PROTOCOL_LINE, nLine) == 0)
+            {
+               controller->Send(TRAJ_PROTOCOL_LINE);  // accepts trajectory blocks
+            }
+            else
+            {
+               if(m_recorder != NULL) m_recorder->Record(TRACE_READ, m_buffer, nLine);
+               *eol = '\0';
+               HandleLine(m_buffer, bRealTime, stats);
+            }
+            m_nLength -= nLine;
+            memmove(m_buffer, m_buffer + nLine, m_nLength);
+         }
+         if(m_nLength == STANDIN_BUFFER_SIZE - 1) m_nLength = 0;  // line too long.  Drop it.
+      }
+   }
+   catch(CSocketException e)
+   {
+      // the controller went away (the normal end of a session)
+   }
+
+   stats->elapsedSec = (TraceClockUs() - tStartUs) / 1.0e6;
+   controller->Close();
+   delete controller;
+   m_server.Close();
+   if(m_shm != NULL) delete m_shm;  // the controller came over TCP
+   m_shm = NULL;
+}
+
+/**
+* Simulates the command lines of a trajectory block one after the other. A damaged block is dropped.
+* @param payload block payload
+* @param len payload bytes
+*/
+void CStandInSimulator::HandleBlock(const char *payload, int len, bool bRealTime, STANDIN_STATS *stats)
+{
+   std::string text;
+   char *line, *eol;
+
+   if(DecodeTrajectoryBlock(payload, len, &text) < 0) return;
+   stats->numBlocks++;
+   for(line = &text[0]; (eol = strchr(line, '\n')) != NULL && !m_bShutdown; line = eol + 1)
+   {
+      if(m_recorder != NULL) m_recorder->Record(TRACE_READ, line, (int)(eol - line) + 1);
+      *eol = '\0';
+      HandleLine(line, bRealTime, stats);
+   }
+}
+
+/**
+* Simulates one command line. ROTATE_JOINT moves the joints at the current MOTOR_SPEED.
+*/
+void CStandInSimulator::HandleLine(const char *line, bool bRealTime, STANDIN_STATS *stats)
+{
+   double ang1, ang2, moveSec;
+
+   line += strspn(line, " \t\r");
+   if(*line == '\0') return;
+   stats->numCommands++;
+
+   if(sscanf_s(line, "ROTATE_JOINT ANG1 %lf ANG2 %lf", &ang1, &ang2) == 2)
+   {
+      moveSec = fmax(fabs(ang1 - m_ang1), fabs(ang2 - m_ang2)) / MOTOR_SPEED_DEG_PER_SEC[m_nSpeed];
+      stats->numRotations++;
+      stats->motionSec += moveSec;
+      if(bRealTime) Sleep((DWORD)(moveSec * 1000.0));
+      m_ang1 = ang1;
+      m_ang2 = ang2;
+   }
+   else if(strncmp(line, "MOTOR_SPEED ", 12) == 0)
+   {
+      if(strncmp(line + 12, "LOW", 3) == 0) m_nSpeed = 0;
+      else if(strncmp(line + 12, "MEDIUM", 6) == 0) m_nSpeed = 1;
+      else if(strncmp(line + 12, "HIGH", 4) == 0) m_nSpeed = 2;
+   }
+   else if(strncmp(line, "SHUTDOWN_SIMULATION", 19) == 0)
+   {
+      m_bShutdown = true;
+   }
+}
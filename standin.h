@@ -0,0 +1,53 @@
+#ifndef _STANDIN_H_
+#define _STANDIN_H_
+
+#include "robot.h"
+
+#define STANDIN_BUFFER_SIZE 8192   /// receive buffer (longest command line)
+#define STANDIN_ACCEPT_POLL_MS 20  /// how often a shared memory connection is checked for while waiting
+
+namespace openutils
+{
+
+   /// results of a stand-in simulator session
+   struct STANDIN_STATS
+   {
+      unsigned long numCommands; /// command lines received
+      unsigned long numBytes; /// bytes received
+      unsigned long numRotations; /// ROTATE_JOINT commands received
+      unsigned long numBlocks; /// trajectory blocks received (their lines are counted as commands)
+      double motionSec; /// time the arm would have spent moving
+      double elapsedSec; /// time from connection to disconnection
+      bool bSharedMemory; /// true if the controller connected through shared memory
+   };
+
+   /// Listens on the simulator port and accepts the commands a controller sends to the SCARA simulator, so
+   /// that controllers and trace replays can be measured without the simulator running. Joint motion time is
+   /// estimated from the motor speed; with bRealTime the stand-in also takes that long to consume each move.
+   /// Controllers on the same host can also connect through the shared memory link of the port. Trajectory
+   /// blocks (see trajblock.h) are accepted and the extension is answered when a controller offers it.
+   class CStandInSimulator
+   {
+   private:
+      CServerSocket m_server; /// listening socket
+      CSharedMemoryLink *m_shm; /// shared memory link waiting for a controller (NULL if none)
+      char m_buffer[STANDIN_BUFFER_SIZE]; /// received data not handled yet
+      int m_nLength; /// bytes in buffer
+      double m_ang1, m_ang2; /// current joint angles (deg)
+      int m_nSpeed; /// current motor speed (0 = LOW, 1 = MEDIUM, 2 = HIGH)
+      bool m_bShutdown; /// true after SHUTDOWN_SIMULATION
+      CTraceRecorder *m_recorder; /// records every line as it starts on it, and every wait for data, when not NULL
+   public:
+      CStandInSimulator(int port); /// constructor
+      ~CStandInSimulator(); /// closes the shared memory link if no controller took it
+      void SetRecorder(CTraceRecorder *rec) { m_recorder = rec; } /// Records the timing of the lines (NULL to stop)
+      void Listen(); /// starts listening before Run (when the controller is in this process). Throws CSocketException
+      void Run(bool bRealTime, STANDIN_STATS *stats); /// serves one controller. Throws CSocketException
+   private:
+      CRobot *Accept(); /// waits for a controller on the socket or the shared memory link
+      void HandleLine(const char *line, bool bRealTime, STANDIN_STATS *stats); /// simulates one command
+      void HandleBlock(const char *payload, int len, bool bRealTime, STANDIN_STATS *stats); /// simulates a block
+   };
+}
+
+#endif
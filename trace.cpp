@@ -0,0 +1,173 @@
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "trace.h"
+using namespace openutils;
+
+static const char TRACE_MAGIC[4] = {'R', 'T', 'R', 'C'};  // trace file signature
+static const int TRACE_VERSION = 1;                      // trace file format version
+
+unsigned long long openutils::TraceClockUs()
+{
+   return (unsigned long long)std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// class CTraceRecorder
+
+CTraceRecorder::CTraceRecorder()
+{
+   m_file = NULL;
+   m_tStartUs = m_tLastUs = 0;
+   m_nRecords = 0;
+}
+
+CTraceRecorder::~CTraceRecorder()
+{
+   Close();
+}
+
+/**
+* Starts a new trace file. Any trace already open is closed.
+* @param fileName trace file name
+*/
+bool CTraceRecorder::Open(const char *fileName)
+{
+   Close();
+   if(fopen_s(&m_file, fileName, "wb") != 0 || m_file == NULL)
+   {
+      m_file = NULL;
+      return false;
+   }
+
+   fwrite(TRACE_MAGIC, 1, sizeof(TRACE_MAGIC), m_file);
+   fputc(TRACE_VERSION, m_file);
+   m_tStartUs = TraceClockUs();
+   m_tLastUs = 0;
+   m_nRecords = 0;
+   return true;
+}
+
+/**
+* Writes one record stamped with the current time.
+* @param type TRACE_SEND or TRACE_READ
+* @param data bytes sent or read
+* @param len number of bytes
+*/
+void CTraceRecorder::Record(int type, const char *data, int len)
+{
+   unsigned long long tUs;
+
+   if(m_file == NULL || len <= 0) return;
+
+   tUs = TraceClockUs() - m_tStartUs;
+   fputc(type, m_file);
+   WriteVarint(tUs - m_tLastUs);
+   WriteVarint((unsigned long long)len);
+   fwrite(data, 1, len, m_file);
+   m_tLastUs = tUs;
+   m_nRecords++;
+}
+
+void CTraceRecorder::Close()
+{
+   if(m_file != NULL) fclose(m_file);
+   m_file = NULL;
+}
+
+void CTraceRecorder::WriteVarint(unsigned long long value)
+{
+   while(value >= 0x80)
+   {
+      fputc((int)(value & 0x7F) | 0x80, m_file);
+      value >>= 7;
+   }
+   fputc((int)value, m_file);
+}
+
+// class CTraceReader
+
+CTraceReader::CTraceReader()
+{
+   m_file = NULL;
+   m_tUs = 0;
+   m_data = NULL;
+   m_nCapacity = 0;
+}
+
+CTraceReader::~CTraceReader()
+{
+   Close();
+   free(m_data);
+}
+
+bool CTraceReader::Open(const char *fileName)
+{
+   char magic[sizeof(TRACE_MAGIC)];
+
+   Close();
+   if(fopen_s(&m_file, fileName, "rb") != 0 || m_file == NULL)
+   {
+      m_file = NULL;
+      return false;
+   }
+
+   if(fread(magic, 1, sizeof(magic), m_file) != sizeof(magic) || memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0
+      || fgetc(m_file) != TRACE_VERSION)
+   {
+      Close();
+      return false;
+   }
+
+   m_tUs = 0;
+   return true;
+}
+
+/**
+* Reads the next record. Returns false at the end of the trace (or if the trace is truncated).
+*/
+bool CTraceReader::Next(TRACE_RECORD *rec)
+{
+   unsigned long long dtUs, len;
+   int type;
+
+   if(m_file == NULL || (type = fgetc(m_file)) == EOF) return false;
+   if(!ReadVarint(&dtUs) || !ReadVarint(&len) || len > 0x7FFFFFFF) return false;
+
+   if((int)len > m_nCapacity)
+   {
+      char *data = (char *)realloc(m_data, (size_t)len);
+      if(data == NULL) return false;
+      m_data = data;
+      m_nCapacity = (int)len;
+   }
+   if(fread(m_data, 1, (size_t)len, m_file) != len) return false;
+
+   m_tUs += dtUs;
+   rec->type = type;
+   rec->timeUs = m_tUs;
+   rec->data = m_data;
+   rec->len = (int)len;
+   return true;
+}
+
+void CTraceReader::Close()
+{
+   if(m_file != NULL) fclose(m_file);
+   m_file = NULL;
+}
+
+bool CTraceReader::ReadVarint(unsigned long long *value)
+{
+   int ch, shift = 0;
+
+   *value = 0;
+   do
+   {
+      if((ch = fgetc(m_file)) == EOF || shift > 63) return false;
+      *value |= (unsigned long long)(ch & 0x7F) << shift;
+      shift += 7;
+   }
+   while(ch & 0x80);
+   return true;
+}
@@ -0,0 +1,62 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <cstdio>
+
+namespace openutils
+{
+
+   enum TRACE_TYPE { TRACE_SEND = 'S', TRACE_READ = 'R' }; /// record types
+
+   /// one record of a trace
+   struct TRACE_RECORD
+   {
+      int type; /// TRACE_SEND or TRACE_READ
+      unsigned long long timeUs; /// microseconds since recording started
+      const char *data; /// bytes sent or read (valid until the next CTraceReader::Next)
+      int len; /// number of bytes
+   };
+
+   /// Writes a compact binary trace of robot traffic:
+   ///    header:  "RTRC" + version byte
+   ///    record:  type byte, varint microseconds since previous record, varint length, data bytes
+   class CTraceRecorder
+   {
+   private:
+      FILE *m_file; /// trace file
+      unsigned long long m_tStartUs; /// clock when recording started
+      unsigned long long m_tLastUs; /// time of the last record (since start)
+      unsigned long m_nRecords; /// number of records written
+   public:
+      CTraceRecorder(); /// constructor
+      ~CTraceRecorder(); /// closes the trace
+      bool Open(const char *fileName); /// starts a new trace file
+      void Record(int type, const char *data, int len); /// writes one record
+      unsigned long GetNumRecords() { return m_nRecords; } /// returns number of records written
+      void Close(); /// closes the trace file
+   private:
+      void WriteVarint(unsigned long long value); /// writes an unsigned LEB128 number
+   };
+
+   /// Reads a trace written by CTraceRecorder
+   class CTraceReader
+   {
+   private:
+      FILE *m_file; /// trace file
+      unsigned long long m_tUs; /// time of the last record read
+      char *m_data; /// record data buffer
+      int m_nCapacity; /// size of record data buffer
+   public:
+      CTraceReader(); /// constructor
+      ~CTraceReader(); /// closes the trace
+      bool Open(const char *fileName); /// opens a trace file.  false if missing or not a trace
+      bool Next(TRACE_RECORD *rec); /// reads the next record.  false at the end of the trace
+      void Close(); /// closes the trace file
+   private:
+      bool ReadVarint(unsigned long long *value); /// reads an unsigned LEB128 number
+   };
+
+   unsigned long long TraceClockUs(); /// monotonic clock in microseconds
+}
+
+#endif
@@ -0,0 +1,168 @@
+#include <string.h>
+#include <math.h>
+#include "trajblock.h"
+#include "command.h"
+using namespace openutils;
+
+static const char *const TRAJ_SPEEDS[] = {"LOW", "MEDIUM", "HIGH"};  // MOTOR_SPEED keywords of TRAJ_SPEED events
+static const double TRAJ_UNITS_PER_DEG = 100.0;  // 10^TRAJ_DECIMALS
+static const int TRAJ_LINE_SIZE = 64;            // longest command line of a block
+
+/**
+* Reads a signed number (zigzag LEB128).
+* @param p read position (advanced)
+* @param end end of the payload
+* @param value receives the number
+* @return false if the payload ends inside the number
+*/
+static bool readVarint(const unsigned char **p, const unsigned char *end, long long *value)
+{
+   unsigned long long u = 0;
+   int shift = 0;
+
+   while(*p < end && shift < 64)
+   {
+      u |= (unsigned long long)(**p & 0x7F) << shift;
+      if((*(*p)++ & 0x80) == 0)
+      {
+         *value = (long long)(u >> 1) ^ -(long long)(u & 1);
+         return true;
+      }
+      shift += 7;
+   }
+   return false;
+}
+
+CTrajectoryBlock::CTrajectoryBlock()
+{
+   Clear();
+}
+
+void CTrajectoryBlock::Clear()
+{
+   m_payload.clear();
+   m_last1 = m_last2 = 0;
+   m_nEvents = 0;
+}
+
+/**
+* Appends a move. The angles are rounded to 0.01 deg as the ROTATE_JOINT text would be, including the sign of a
+* negative angle that rounds to 0.
+* @param ang1Deg shoulder angle
+* @param ang2Deg elbow angle
+*/
+void CTrajectoryBlock::Move(double ang1Deg, double ang2Deg)
+{
+   long long units1 = ScaleFixed(ang1Deg, TRAJ_DECIMALS), units2 = ScaleFixed(ang2Deg, TRAJ_DECIMALS);
+   int op = TRAJ_MOVE;
+
+   if(units1 == 0 && signbit(ang1Deg)) op |= TRAJ_NEGATIVE_ZERO1;
+   if(units2 == 0 && signbit(ang2Deg)) op |= TRAJ_NEGATIVE_ZERO2;
+   Event(op);
+   Varint(units1 - m_last1);
+   Varint(units2 - m_last2);
+   m_last1 = units1;
+   m_last2 = units2;
+}
+
+/**
+* Writes the block as it goes on the wire:  "TRAJECTORY_BLOCK <payload bytes>\n" and the payload.
+* @param wire receives the block
+* @return number of bytes
+*/
+int CTrajectoryBlock::Build(std::string *wire)
+{
+   char header[32];
+   CCommandWriter writer(header, sizeof(header));
+
+   writer.Begin(TRAJ_BLOCK_KEYWORD).Int((int)m_payload.size()).End();
+   wire->assign(header, writer.GetLength());
+   wire->append(m_payload);
+   return (int)wire->size();
+}
+
+void CTrajectoryBlock::Event(int op)
+{
+   m_payload.push_back((char)op);
+   m_nEvents++;
+}
+
+void CTrajectoryBlock::Varint(long long value)
+{
+   unsigned long long u = ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63);
+
+   while(u >= 0x80)
+   {
+      m_payload.push_back((char)((u & 0x7F) | 0x80));
+      u >>= 7;
+   }
+   m_payload.push_back((char)u);
+}
+
+/**
+* Gets the payload size of a block header line.
+* @param line start of a line
+* @param len bytes in line (up to or past its '\n')
+* @return payload bytes after the '\n', or -1 if the line is not a block header
+*/
+int openutils::GetTrajectoryBlockSize(const char *line, int len)
+{
+   const int keywordLen = (int)sizeof(TRAJ_BLOCK_KEYWORD) - 1;
+   int n, size = 0;
+
+   if(len <= keywordLen + 1 || strncmp(line, TRAJ_BLOCK_KEYWORD " ", keywordLen + 1) != 0) return -1;
+   for(n = keywordLen + 1; n < len && line[n] >= '0' && line[n] <= '9' && size <= TRAJ_BLOCK_MAX_BYTES; n++)
+      size = size * 10 + (line[n] - '0');
+   return n > keywordLen + 1 && size <= TRAJ_BLOCK_MAX_BYTES ? size : -1;
+}
+
+/**
+* Turns a block back into the command lines it stands for (ROTATE_JOINT, PEN_UP, PEN_DOWN and MOTOR_SPEED),
+* with the same text the controller would have sent without the extension.
+* @param payload block payload
+* @param len payload bytes
+* @param text receives the command lines
+* @return number of command lines, -1 if the payload is damaged
+*/
+int openutils::DecodeTrajectoryBlock(const char *payload, int len, std::string *text)
+{
+   const unsigned char *p = (const unsigned char *)payload, *end = p + len;
+   char line[TRAJ_LINE_SIZE];
+   CCommandWriter writer(line, TRAJ_LINE_SIZE);
+   long long units1 = 0, units2 = 0, d1, d2;
+   double ang1, ang2;
+   int op, numLines = 0;
+
+   text->clear();
+   while(p < end)
+   {
+      op = *p++;
+      switch(op & 3)
+      {
+      case TRAJ_MOVE:
+         if(!readVarint(&p, end, &d1) || !readVarint(&p, end, &d2)) return -1;
+         units1 += d1;
+         units2 += d2;
+         ang1 = units1 / TRAJ_UNITS_PER_DEG;
+         ang2 = units2 / TRAJ_UNITS_PER_DEG;
+         if(units1 == 0 && (op & TRAJ_NEGATIVE_ZERO1)) ang1 = -0.0;  // "-0.00" as the text has it
+         if(units2 == 0 && (op & TRAJ_NEGATIVE_ZERO2)) ang2 = -0.0;
+         writer.Begin("ROTATE_JOINT").Word("ANG1").Fixed(ang1, TRAJ_DECIMALS);
+         writer.Word("ANG2").Fixed(ang2, TRAJ_DECIMALS).End();
+         break;
+      case TRAJ_PEN_UP:
+         writer.Begin("PEN_UP").End();
+         break;
+      case TRAJ_PEN_DOWN:
+         writer.Begin("PEN_DOWN").End();
+         break;
+      default:
+         if((op >> 2) > 2) return -1;
+         writer.Begin("MOTOR_SPEED").Word(TRAJ_SPEEDS[op >> 2]).End();
+         break;
+      }
+      text->append(line, writer.GetLength());
+      numLines++;
+   }
+   return numLines;
+}
@@ -0,0 +1,52 @@
+#ifndef _TRAJBLOCK_H_
+#define _TRAJBLOCK_H_
+
+#include <string>
+
+#define TRAJ_PROTOCOL_LINE "PROTOCOL TRAJECTORY_BLOCK 1\n"  /// offer of the extension at connect time, and its answer
+#define TRAJ_BLOCK_KEYWORD "TRAJECTORY_BLOCK"  /// header line of a block:  keyword, payload bytes, '\n'
+#define TRAJ_BLOCK_MAX_BYTES 4096   /// largest payload (fits the stand-in simulator's receive buffer)
+#define TRAJ_MAX_EVENT_BYTES 21     /// longest event:  op byte and two 10 byte varints
+#define TRAJ_DECIMALS 2             /// joint angles are sent in 0.01 deg units, as ROTATE_JOINT text has 2 decimals
+#define TRAJ_NEGOTIATE_MS 500       /// longest wait for the answer to the offer
+
+namespace openutils
+{
+
+   /// events of a block:  the low 2 bits of an op byte.  TRAJ_SPEED has the motor speed in the next 2 bits.
+   enum TRAJ_OP { TRAJ_MOVE = 0, TRAJ_PEN_UP = 1, TRAJ_PEN_DOWN = 2, TRAJ_SPEED = 3 };
+
+   /// flags of a TRAJ_MOVE op byte:  the joint angle is negative but rounds to 0 units (the text has "-0.00")
+   enum TRAJ_MOVE_FLAG { TRAJ_NEGATIVE_ZERO1 = 4, TRAJ_NEGATIVE_ZERO2 = 8 };
+
+   /// Builds a trajectory block:  a whole joint path sent as one command instead of one ROTATE_JOINT line per
+   /// waypoint. The payload is a list of events. A move is its op byte and the changes of both joint angles since
+   /// the last move of the block (zigzag LEB128 varints of 0.01 deg units, from 0 at the start of every block), so
+   /// a step of a dense path takes 3 bytes instead of a line of about 36. Pen and motor speed events are one byte.
+   /// Only sent to a peer that answered TRAJ_PROTOCOL_LINE at connect time (see CRobot::SetTrajectoryBlocks).
+   class CTrajectoryBlock
+   {
+   private:
+      std::string m_payload; /// encoded events
+      long long m_last1, m_last2; /// joint angles of the last move (units)
+      int m_nEvents; /// number of events
+   public:
+      CTrajectoryBlock(); /// empty block
+      void Clear(); /// removes all events (after a Build)
+      void Move(double ang1Deg, double ang2Deg); /// ROTATE_JOINT
+      void PenUp() { Event(TRAJ_PEN_UP); } /// PEN_UP
+      void PenDown() { Event(TRAJ_PEN_DOWN); } /// PEN_DOWN
+      void Speed(int speed) { Event(TRAJ_SPEED | (speed << 2)); } /// MOTOR_SPEED (0 = LOW, 1 = MEDIUM, 2 = HIGH)
+      bool IsFull() { return m_payload.size() > TRAJ_BLOCK_MAX_BYTES - TRAJ_MAX_EVENT_BYTES; } /// true if full
+      int GetNumEvents() { return m_nEvents; } /// returns the number of events
+      int Build(std::string *wire); /// writes the header line and the payload.  Returns the number of bytes
+   private:
+      void Event(int op); /// appends an op byte
+      void Varint(long long value); /// appends a signed number (zigzag LEB128)
+   };
+
+   int GetTrajectoryBlockSize(const char *line, int len); /// payload bytes of a header line, -1 if not a header
+   int DecodeTrajectoryBlock(const char *payload, int len, std::string *text); /// command lines of a block
+}
+
+#endif
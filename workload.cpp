@@ -0,0 +1,226 @@
+#include <math.h>
+#include "workload.h"
+using namespace openutils;
+
+static const double WORKLOAD_PI = 3.14159265358979323846;
+static const double MAX_POINT_ANGLE_DEG = 100.0;   // points are placed within +/- this angle of the x axis
+static const double MAX_SHAPE_SIZE = 150.0;        // side of the square the points of one shape are placed in
+
+enum WORKLOAD_KIND { KIND_LINE, KIND_ARC, KIND_BEZIER, KIND_POLYGON, KIND_MOVE, KIND_TRANSFORM, KIND_COLOR,
+                     NUM_KINDS };
+
+CWorkloadGenerator::CWorkloadGenerator(unsigned long long seed, const WORKLOAD_MIX *mix, double LMIN, double LMAX)
+{
+   m_state = seed;
+   m_mix = *mix;
+   if(m_mix.maxTransformDepth < 1) m_mix.maxTransformDepth = 1;
+   m_rMin = LMIN + 0.3 * (LMAX - LMIN);
+   m_rMax = LMAX - MAX_SHAPE_SIZE;   // the other points of a shape can be MAX_SHAPE_SIZE / sqrt(2) further out
+   if(m_rMax < m_rMin) m_rMax = m_rMin;
+   m_rUnreachable = 1.25 * LMAX;
+   m_nDepth = 0;
+   m_x = m_y = 0.0;
+}
+
+void CWorkloadGenerator::GetDefaultMix(WORKLOAD_MIX *mix)
+{
+   mix->line = 30;
+   mix->arc = 20;
+   mix->bezier = 15;
+   mix->polygon = 10;
+   mix->move = 10;
+   mix->transform = 10;
+   mix->color = 5;
+   mix->maxTransformDepth = 3;
+   mix->unreachablePercent = 2;
+}
+
+/**
+* Writes numLines command lines picked at random according to the mix.
+* @param fo output file
+* @param numLines number of lines to write
+*/
+void CWorkloadGenerator::Generate(FILE *fo, unsigned long numLines)
+{
+   int weights[NUM_KINDS] = {m_mix.line, m_mix.arc, m_mix.bezier, m_mix.polygon, m_mix.move, m_mix.transform,
+                             m_mix.color};
+   int total = 0, r, kind;
+
+   for(kind = 0; kind < NUM_KINDS; kind++)
+   {
+      if(weights[kind] < 0) weights[kind] = 0;
+      total += weights[kind];
+   }
+   if(total == 0)
+   {
+      weights[KIND_LINE] = total = 1;
+   }
+
+   for(unsigned long n = 0; n < numLines; n++)
+   {
+      r = Pick(total);
+      for(kind = 0; r >= weights[kind]; kind++) r -= weights[kind];
+
+      if(kind == KIND_TRANSFORM)
+         WriteTransform(fo);
+      else if(kind == KIND_COLOR)
+         WriteColor(fo);
+      else
+         WriteShape(fo, kind);
+   }
+}
+
+void CWorkloadGenerator::WriteShape(FILE *fo, int kind)
+{
+   bool bUnreachable = Pick(100) < m_mix.unreachablePercent;
+   double r, ang0, ang1;
+
+   switch(kind)
+   {
+      case KIND_LINE:
+         fprintf(fo, "LINE");
+         WritePoint(fo, true, false);
+         WritePoint(fo, false, bUnreachable);
+         WriteResolution(fo);
+         break;
+
+      case KIND_ARC:
+         fprintf(fo, "ARC");
+         WritePoint(fo, true, bUnreachable);
+         r = Uniform(10.0, 0.5 * MAX_SHAPE_SIZE);
+         ang0 = Uniform(-180.0, 180.0);
+         ang1 = ang0 + Uniform(-270.0, 270.0);
+         fprintf(fo, " %.1f %.1f %.1f", r, ang0, ang1);
+         WriteResolution(fo);
+         break;
+
+      case KIND_BEZIER:
+         fprintf(fo, "QUADRATIC_BEZIER");
+         WritePoint(fo, true, false);
+         WritePoint(fo, false, false);
+         WritePoint(fo, false, bUnreachable);
+         WriteResolution(fo);
+         break;
+
+      case KIND_POLYGON:
+         if(Pick(2) == 0)
+         {
+            fprintf(fo, "TRIANGLE");
+            WritePoint(fo, true, false);
+            WritePoint(fo, false, false);
+         }
+         else
+         {
+            fprintf(fo, "RECTANGLE");
+            WritePoint(fo, true, false);
+         }
+         WritePoint(fo, false, bUnreachable);
+         WriteResolution(fo);
+         break;
+
+      default:
+         fprintf(fo, "MOVE_TO");
+         WritePoint(fo, true, bUnreachable);
+         r = Uniform(0.0, 3.0);   // 1 in 3 ask for an arm
+         fprintf(fo, "%s\n", r < 1.0 ? " LEFT" : r < 2.0 ? " RIGHT" : "");
+         break;
+   }
+}
+
+void CWorkloadGenerator::WriteTransform(FILE *fo)
+{
+   double dx, dy;
+
+   if(m_nDepth >= m_mix.maxTransformDepth)
+   {
+      fprintf(fo, "RESET_TRANSFORM_MATRIX\n");
+      m_nDepth = 0;
+      return;
+   }
+
+   switch(Pick(3))
+   {
+      case 0:  fprintf(fo, "ROTATE %.1f\n", Uniform(-20.0, 20.0)); break;
+      case 1:
+         dx = Uniform(-20.0, 20.0);
+         dy = Uniform(-20.0, 20.0);
+         fprintf(fo, "TRANSLATE %.1f %.1f\n", dx, dy);
+         break;
+      default: fprintf(fo, "SCALE %.2f\n", Uniform(0.95, 1.05)); break;
+   }
+   m_nDepth++;
+}
+
+void CWorkloadGenerator::WriteColor(FILE *fo)
+{
+   int r, g, b;
+
+   if(Pick(4) == 0)
+   {
+      fprintf(fo, "CYCLE_PEN_COLORS %s\n", Pick(2) == 0 ? "ON" : "OFF");
+      return;
+   }
+   // one call per statement so every compiler draws the numbers in the same order
+   r = Pick(256);
+   g = Pick(256);
+   b = Pick(256);
+   fprintf(fo, "PEN_COLOR %d %d %d\n", r, g, b);
+}
+
+/**
+* Writes a random point. The first point of a shape picks the area and the rest stay near it.
+* @param bFirst true for the first point of a shape
+* @param bUnreachable true to put the point out of reach (in the direction of the shape)
+*/
+void CWorkloadGenerator::WritePoint(FILE *fo, bool bFirst, bool bUnreachable)
+{
+   double r, ang, dx, dy;
+
+   if(bFirst)
+   {
+      r = Uniform(m_rMin, m_rMax);
+      ang = Uniform(-MAX_POINT_ANGLE_DEG, MAX_POINT_ANGLE_DEG) * WORKLOAD_PI / 180.0;
+      m_x = r * cos(ang);
+      m_y = r * sin(ang);
+   }
+
+   if(bUnreachable)
+   {
+      ang = atan2(m_y, m_x);
+      fprintf(fo, " %.1f %.1f", m_rUnreachable * cos(ang), m_rUnreachable * sin(ang));
+   }
+   else if(bFirst)
+   {
+      fprintf(fo, " %.1f %.1f", m_x, m_y);
+   }
+   else
+   {
+      dx = Uniform(-0.5, 0.5) * MAX_SHAPE_SIZE;
+      dy = Uniform(-0.5, 0.5) * MAX_SHAPE_SIZE;
+      fprintf(fo, " %.1f %.1f", m_x + dx, m_y + dy);
+   }
+}
+
+void CWorkloadGenerator::WriteResolution(FILE *fo)
+{
+   static const char *const strResolutions[] = {"", " LOW", " MEDIUM", " HIGH"};
+   fprintf(fo, "%s\n", strResolutions[Pick(4)]);
+}
+
+unsigned long long CWorkloadGenerator::Next()
+{
+   unsigned long long z = (m_state += 0x9E3779B97F4A7C15ULL);
+   z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+   z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+   return z ^ (z >> 31);
+}
+
+double CWorkloadGenerator::Uniform(double a, double b)
+{
+   return a + (b - a) * ((Next() >> 11) * (1.0 / 9007199254740992.0));
+}
+
+int CWorkloadGenerator::Pick(int n)
+{
+   return (int)(Next() % (unsigned long long)n);
+}
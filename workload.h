@@ -0,0 +1,50 @@
+#ifndef _WORKLOAD_H_
+#define _WORKLOAD_H_
+
+#include <cstdio>
+
+namespace openutils
+{
+
+   /// relative weights of the generated commands (a weight of 0 leaves that command out)
+   struct WORKLOAD_MIX
+   {
+      int line; /// LINE
+      int arc; /// ARC
+      int bezier; /// QUADRATIC_BEZIER
+      int polygon; /// TRIANGLE and RECTANGLE
+      int move; /// MOVE_TO
+      int transform; /// ROTATE, TRANSLATE and SCALE
+      int color; /// PEN_COLOR and CYCLE_PEN_COLORS
+      int maxTransformDepth; /// transforms stacked before RESET_TRANSFORM_MATRIX
+      int unreachablePercent; /// percentage of shapes given a point out of reach
+   };
+
+   /// Writes reproducible command files for benchmarks. The same seed and mix always give the same file.
+   /// Points are placed inside the reach of the arm model passed in, except for the unreachable ones.
+   class CWorkloadGenerator
+   {
+   private:
+      unsigned long long m_state; /// random number generator state
+      WORKLOAD_MIX m_mix; /// command mix
+      double m_rMin, m_rMax; /// radius band for reachable points
+      double m_rUnreachable; /// radius for unreachable points
+      int m_nDepth; /// transforms applied since the last reset
+      double m_x, m_y; /// first point of the shape being written
+   public:
+      CWorkloadGenerator(unsigned long long seed, const WORKLOAD_MIX *mix, double LMIN, double LMAX);
+      static void GetDefaultMix(WORKLOAD_MIX *mix); /// a mix resembling the lab command files
+      void Generate(FILE *fo, unsigned long numLines); /// writes numLines command lines
+   private:
+      void WriteShape(FILE *fo, int kind); /// writes one LINE, ARC, QUADRATIC_BEZIER, TRIANGLE or RECTANGLE
+      void WriteTransform(FILE *fo); /// writes one transform (or a reset at the depth limit)
+      void WriteColor(FILE *fo); /// writes one pen color command
+      void WritePoint(FILE *fo, bool bFirst, bool bUnreachable); /// writes " x y" for a random point
+      void WriteResolution(FILE *fo); /// writes an optional resolution keyword and the newline
+      unsigned long long Next(); /// next random number (splitmix64)
+      double Uniform(double a, double b); /// random number in [a, b)
+      int Pick(int n); /// random integer in [0, n)
+   };
+}
+
+#endif